@@ -0,0 +1,162 @@
+// Measures system calls and wakeups per MB for the _all paths of net_socket:
+//  - recv_all with MSG_WAITALL (no timeout) versus the recv loop (timeout set)
+//  - header and body sends with and without MSG_MORE
+//
+// recv, send and select (used to wait when a timeout is set) are interposed
+// to count the calls made by net_socket.
+// Wakeups are the receiving thread's voluntary context switches.
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <dlfcn.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/resource.h>
+#include <linux/tcp.h>
+#include "net_socket.h"
+
+using std::string;
+using std::vector;
+using std::unique_ptr;
+using network_socket::net_socket;
+
+static std::atomic<uint64_t> recv_calls{0};
+static std::atomic<uint64_t> send_calls{0};
+static std::atomic<uint64_t> select_calls{0};
+
+extern "C" ssize_t recv(int fd, void *buf, size_t n, int flags) {
+	static auto real = reinterpret_cast<ssize_t (*)(int, void*, size_t, int)>(dlsym(RTLD_NEXT, "recv"));
+	++recv_calls;
+	return real(fd, buf, n, flags);
+}
+
+extern "C" ssize_t send(int fd, const void *buf, size_t n, int flags) {
+	static auto real = reinterpret_cast<ssize_t (*)(int, const void*, size_t, int)>(dlsym(RTLD_NEXT, "send"));
+	++send_calls;
+	return real(fd, buf, n, flags);
+}
+
+extern "C" int select(int n, fd_set *r, fd_set *w, fd_set *e, struct timeval *t) {
+	static auto real = reinterpret_cast<int (*)(int, fd_set*, fd_set*, fd_set*, struct timeval*)>(
+		dlsym(RTLD_NEXT, "select"));
+	++select_calls;
+	return real(n, r, w, e, t);
+}
+
+static long thread_wakeups() {
+	struct rusage ru;
+	getrusage(RUSAGE_THREAD, &ru);
+	return ru.ru_nvcsw;
+}
+
+static uint64_t segments_out(const net_socket &s) {
+	struct tcp_info info{};
+	socklen_t len = sizeof(info);
+	getsockopt(s.get_socket_descriptor(), IPPROTO_TCP, TCP_INFO, &info, &len);
+	return info.tcpi_segs_out;
+}
+
+static unsigned short bench_port() {
+	return 20000 + std::chrono::steady_clock::now().time_since_epoch().count()%20000;
+}
+
+static void connect_pair(net_socket &server, net_socket &client, unique_ptr<net_socket> &worker) {
+	unsigned short port = bench_port();
+	server.listen("127.0.0.1", port);
+	client.connect("127.0.0.1", port);
+	worker = server.accept();
+}
+
+static void report(const string &name, double mb, double recvs, double sends, double wakeups,
+	double segs, double secs) {
+
+	std::cout << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(1)
+		<< std::setw(10) << recvs/mb << std::setw(10) << sends/mb << std::setw(10) << wakeups/mb
+		<< std::setw(10) << segs/mb << std::setw(10) << mb/secs << '\n';
+}
+
+// The sender writes `count` messages of `msg_size` bytes in 16 KiB pieces
+// while the receiver reads each message with recv_all
+static void bench_recv_all(const string &name, bool timeout, size_t msg_size, int count) {
+	net_socket server, client;
+	unique_ptr<net_socket> worker;
+	connect_pair(server, client, worker);
+	if( timeout ) {
+		worker->set_timeout(10.0);
+	}
+
+	vector<char> buf(msg_size);
+	std::thread tx([&client, msg_size, count]() {
+		vector<char> data(msg_size, 'x');
+		for( int i = 0; i < count; ++i ) {
+			for( size_t off = 0; off < data.size(); off += 16384 ) {
+				client.send_all(data.data() + off, std::min<size_t>(16384, data.size() - off));
+			}
+		}
+	});
+
+	recv_calls = 0;
+	select_calls = 0;
+	long w0 = thread_wakeups();
+	auto t0 = std::chrono::steady_clock::now();
+	for( int i = 0; i < count; ++i ) {
+		worker->recv_all(buf.data(), buf.size());
+	}
+	auto t1 = std::chrono::steady_clock::now();
+	long w1 = thread_wakeups();
+	tx.join();
+
+	double mb = static_cast<double>(msg_size)*count/(1 << 20);
+	report(name, mb, recv_calls + select_calls, 0, w1-w0, 0, std::chrono::duration<double>(t1-t0).count());
+}
+
+// Each message is a small header followed by its body in a second send
+static void bench_header_body(const string &name, int flags, size_t body_size, int count) {
+	net_socket server, client;
+	unique_ptr<net_socket> worker;
+	connect_pair(server, client, worker);
+
+	const size_t hdr_size = 16;
+	std::thread rx([&worker, hdr_size, body_size, count]() {
+		vector<char> buf(hdr_size + body_size);
+		for( int i = 0; i < count; ++i ) {
+			worker->recv_all(buf.data(), buf.size());
+		}
+	});
+
+	vector<char> hdr(hdr_size, 'h'), body(body_size, 'b');
+	send_calls = 0;
+	uint64_t s0 = segments_out(client);
+	long w0 = thread_wakeups();
+	auto t0 = std::chrono::steady_clock::now();
+	for( int i = 0; i < count; ++i ) {
+		client.send_all(hdr.data(), hdr.size(), flags);
+		client.send_all(body.data(), body.size());
+	}
+	rx.join();
+	auto t1 = std::chrono::steady_clock::now();
+	long w1 = thread_wakeups();
+	uint64_t s1 = segments_out(client);
+
+	double mb = static_cast<double>(hdr_size + body_size)*count/(1 << 20);
+	report(name, mb, 0, send_calls, w1-w0, s1-s0, std::chrono::duration<double>(t1-t0).count());
+}
+
+int main() {
+	std::cout << std::left << std::setw(28) << "per MB" << std::right
+		<< std::setw(10) << "recv+sel" << std::setw(10) << "sends" << std::setw(10) << "wakeups"
+		<< std::setw(10) << "segments" << std::setw(10) << "MB/s" << '\n';
+
+	bench_recv_all("recv_all loop (timeout)", true, 1 << 20, 256);
+	bench_recv_all("recv_all MSG_WAITALL", false, 1 << 20, 256);
+	bench_header_body("header, body", 0, 200, 100000);
+	bench_header_body("header MSG_MORE, body", MSG_MORE, 200, 100000);
+
+	return 0;
+}
@@ -0,0 +1,167 @@
+// Measures the per-call cost net_socket adds over the raw send and recv
+// system calls: each send and recv overload runs the same workload as the raw
+// call (small messages over a loopback connection) and the difference in
+// ns/call is reported, along with heap allocations per call.
+//
+// Sends are timed while the receive buffer has room, and receives while the
+// data is already queued, so that neither waits on the other end.
+
+#include <iostream>
+#include <iomanip>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <functional>
+#include <new>
+#include <cstdlib>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "net_socket.h"
+
+using std::string;
+using std::vector;
+using std::unique_ptr;
+using network_socket::net_socket;
+
+static std::atomic<uint64_t> allocations{0};
+
+// Not inlined, so that the compiler doesn't pair the malloc and free inside
+// them with new and delete expressions
+__attribute__((noinline)) void* operator new(size_t n) {
+	++allocations;
+	void *p = std::malloc(n == 0 ? 1 : n);
+	if( p == nullptr ) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept {
+	std::free(p);
+}
+
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept {
+	std::free(p);
+}
+
+static const size_t message_size = 64;
+static const size_t batch = 256;
+static const size_t rounds = 400;
+
+struct result {
+	double ns_per_call;
+	double allocs_per_call;
+};
+
+static unsigned short bench_port() {
+	return 20000 + std::chrono::steady_clock::now().time_since_epoch().count()%20000;
+}
+
+static void set_buffers(int sd) {
+	int size = 4 << 20;
+	int one = 1;
+	setsockopt(sd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+	setsockopt(sd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+static void drain(int sd, size_t bytes) {
+	vector<char> buf(bytes);
+	::recv(sd, buf.data(), bytes, MSG_WAITALL);
+}
+
+static void fill(int sd, size_t bytes) {
+	vector<char> buf(bytes, 'w');
+	::send(sd, buf.data(), bytes, 0);
+}
+
+// Time `batch` calls of `call` per round; `between` runs untimed after each
+// round to reset the connection.
+static result run(const std::function<void()> &call, const std::function<void()> &between) {
+	std::chrono::nanoseconds elapsed{0};
+	uint64_t allocs = 0;
+
+	for( size_t r = 0; r <= rounds; ++r ) {
+		uint64_t a0 = allocations;
+		auto t0 = std::chrono::steady_clock::now();
+		for( size_t i = 0; i < batch; ++i ) {
+			call();
+		}
+		auto t1 = std::chrono::steady_clock::now();
+		uint64_t a1 = allocations;
+		between();
+
+		// The first round warms up
+		if( r > 0 ) {
+			elapsed += t1 - t0;
+			allocs += a1 - a0;
+		}
+	}
+
+	double calls = static_cast<double>(rounds*batch);
+	return {static_cast<double>(elapsed.count())/calls, static_cast<double>(allocs)/calls};
+}
+
+static void report(const string &name, const result &r, const result &raw) {
+	std::cout << std::left << std::setw(34) << name << std::right << std::fixed << std::setprecision(1)
+		<< std::setw(12) << r.ns_per_call << std::setw(12) << r.ns_per_call - raw.ns_per_call
+		<< std::setw(14) << std::setprecision(2) << r.allocs_per_call << '\n';
+}
+
+int main() {
+	unsigned short port = bench_port();
+	net_socket server, client;
+	server.listen("127.0.0.1", port);
+	client.connect("127.0.0.1", port);
+	unique_ptr<net_socket> worker = server.accept();
+	int csd = client.get_socket_descriptor();
+	int wsd = worker->get_socket_descriptor();
+	set_buffers(csd);
+	set_buffers(wsd);
+
+	const size_t batch_bytes = batch*message_size;
+	char buf[message_size] = {};
+	const string str(message_size, 's');
+	const vector<char> vec(message_size, 'v');
+
+	std::cout << std::left << std::setw(34) << "path" << std::right
+		<< std::setw(12) << "ns/call" << std::setw(12) << "overhead" << std::setw(14) << "allocs/call" << '\n';
+
+	// Sends: the receiver is drained between rounds
+	auto drain_worker = [wsd, batch_bytes]() {drain(wsd, batch_bytes);};
+	result raw = run([&]() {::send(csd, buf, message_size, 0);}, drain_worker);
+	report("::send", raw, raw);
+	report("send(void*)", run([&]() {client.send(buf, message_size);}, drain_worker), raw);
+	report("send_all(void*)", run([&]() {client.send_all(buf, message_size);}, drain_worker), raw);
+	report("send(string)", run([&]() {client.send(str);}, drain_worker), raw);
+	report("send_all(string)", run([&]() {client.send_all(str);}, drain_worker), raw);
+	report("send(vector<char>)", run([&]() {client.send(vec);}, drain_worker), raw);
+	report("send_all(vector<char>)", run([&]() {client.send_all(vec);}, drain_worker), raw);
+
+	// Receives: the next round's data is queued between rounds
+	auto fill_worker = [csd, wsd, batch_bytes]() {
+		fill(csd, batch_bytes);
+
+		// Wait for loopback to queue all of it at the receiver
+		int queued = 0;
+		while( static_cast<size_t>(queued) < batch_bytes ) {
+			ioctl(wsd, FIONREAD, &queued);
+		}
+	};
+	fill_worker();
+	string rstr;
+	vector<char> rvec;
+	raw = run([&]() {::recv(wsd, buf, message_size, 0);}, fill_worker);
+	report("::recv", raw, raw);
+	report("recv(void*)", run([&]() {worker->recv(buf, message_size);}, fill_worker), raw);
+	report("recv_all(void*)", run([&]() {worker->recv_all(buf, message_size);}, fill_worker), raw);
+	report("recv(string)", run([&]() {worker->recv(rstr, message_size);}, fill_worker), raw);
+	report("recv_all(string)", run([&]() {worker->recv_all(rstr, message_size);}, fill_worker), raw);
+	report("recv(vector<char>)", run([&]() {worker->recv(rvec, message_size);}, fill_worker), raw);
+	report("recv_all(vector<char>)", run([&]() {worker->recv_all(rvec, message_size);}, fill_worker), raw);
+
+	return 0;
+}
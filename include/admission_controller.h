@@ -0,0 +1,105 @@
+#ifndef __ADMISSION_CONTROLLER_H
+#define __ADMISSION_CONTROLLER_H
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include "net_socket.h"
+
+namespace network_socket {
+
+/// \brief Admission decisions made by an admission_controller.
+struct admission_statistics {
+	uint64_t admitted{0};
+	uint64_t shed{0};
+	/// Number of intervals that ended overloaded
+	uint64_t overloaded_intervals{0};
+};
+
+/// \brief Sheds work early when queueing delay shows the server is
+/// overloaded.
+///
+/// Work (a connection or a request) is admitted or shed by how long it waited
+/// before the server got to it, its sojourn time. As in CoDel, a short spike
+/// is tolerated: the server is only considered overloaded when even the
+/// shortest sojourn seen during an `interval` exceeded `target`, i.e., a
+/// standing queue persisted for the whole interval. While not overloaded,
+/// only work that waited longer than `interval` is shed; while overloaded,
+/// anything that waited longer than `target` is shed. Shedding stale work
+/// quickly keeps the queue short, so the work that is admitted still meets
+/// its latency target instead of everyone timing out.
+///
+/// All members are thread-safe.
+class admission_controller {
+public:
+	using clock = std::chrono::steady_clock;
+	using duration = std::chrono::nanoseconds;
+
+	/// \param target Acceptable standing queueing delay.
+	/// \param interval Time a standing queue must persist to be an overload,
+	/// and the longest delay tolerated when not overloaded; should be on the
+	/// order of a request's round trip.
+	explicit admission_controller(duration target = std::chrono::milliseconds(5),
+		duration interval = std::chrono::milliseconds(100));
+
+	admission_controller(const admission_controller&) = delete;
+	admission_controller& operator=(const admission_controller&) = delete;
+
+	duration get_target() const {return _target;}
+	duration get_interval() const {return _interval;}
+	/// Test if the last complete interval was overloaded.
+	bool is_overloaded() const;
+	admission_statistics get_statistics() const;
+
+	/// \brief Decide whether to admit work that waited `sojourn`.
+	/// \param now Time of the decision.
+	/// \return true to admit, false to shed.
+	bool admit(duration sojourn, clock::time_point now = clock::now());
+	/// \brief Decide whether to admit work queued at `enqueued`.
+	bool admit(clock::time_point enqueued) {
+		auto now = clock::now();
+		return admit(now - enqueued, now);
+	}
+	/// \brief Decide whether to admit a request by how long its data waited
+	/// in the socket.
+	///
+	/// `received` is the receive timestamp returned by
+	/// `net_socket::recv(void*, size_t, socket_timestamp&)`; receive
+	/// timestamps must be enabled. Work without a timestamp is admitted.
+	bool admit(const socket_timestamp &received);
+
+	/// \brief Accept the next connection that is admitted.
+	///
+	/// Each accepted connection is judged by how long it waited in the accept
+	/// queue (see `connection_sojourn`). Shed connections are passed to the
+	/// rejection handler and then closed, so that its reply is delivered, or
+	/// reset if there is no handler, and the next connection is accepted.
+	std::unique_ptr<net_socket> accept(net_socket &listener);
+	/// \brief Set the handler called with shed connections before they are
+	/// closed, e.g., to send a short "busy" response.
+	void set_rejection_handler(std::function<void(net_socket&)> handler);
+
+	/// \brief Time since a connection last received data, or since the
+	/// handshake completed if it received none.
+	///
+	/// For a newly accepted connection this is the time it spent in the
+	/// accept queue (millisecond resolution).
+	static duration connection_sojourn(const net_socket &s);
+
+private:
+	const duration _target;
+	const duration _interval;
+	mutable std::mutex _mutex;
+	bool _started{false};
+	clock::time_point _interval_end;
+	duration _min_sojourn{duration::max()};
+	bool _overloaded{false};
+	admission_statistics _stats;
+	std::function<void(net_socket&)> _reject;
+};
+
+} // namespace network_socket
+
+#endif
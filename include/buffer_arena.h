@@ -0,0 +1,137 @@
+#ifndef __BUFFER_ARENA_H
+#define __BUFFER_ARENA_H
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <memory>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+namespace network_socket {
+
+/// \brief Memory for socket buffers backed by huge pages.
+///
+/// Large, long-lived buffers spread over many 4 KiB pages cost TLB misses
+/// on every pass over the data. The arena maps its memory in huge-page
+/// sized, huge-page aligned regions, trying in turn:
+///  -# explicit huge pages (`MAP_HUGETLB`), which require pages reserved with
+///  `vm.nr_hugepages`,
+///  -# transparent huge pages (`madvise(MADV_HUGEPAGE)`), and
+///  -# normal pages.
+///
+/// Each thread allocates from its own sub-arena without locking: it takes a
+/// chunk of `chunk_size` bytes from the arena at a time and carves blocks from
+/// it. Block sizes are rounded up to a power of two (at least a cache line)
+/// and freed blocks are kept on per-size free lists for reuse. Chunks are
+/// aligned to their size and start with a pointer to the sub-arena that owns
+/// them, so a block is always returned to its owner: blocks freed by another
+/// thread (e.g., a buffer received on one thread and released on another)
+/// are pushed onto a lock-free list of the owner, which takes them over when
+/// its own list runs out. When a thread exits, its sub-arenas, with their
+/// free blocks and the rest of their chunks, are handed back to their arenas
+/// and adopted by threads that allocate later. Blocks larger than a quarter
+/// of a chunk get regions of their own, which are unmapped when freed. All
+/// other memory is returned to the system only when the arena is destroyed.
+class buffer_arena {
+public:
+	/// How a region of the arena is backed.
+	enum page_kind {huge_pages, transparent_huge_pages, normal_pages};
+
+	static constexpr size_t huge_page_size = 2 << 20;
+	/// Alignment of every block.
+	static constexpr size_t min_block_size = 64;
+
+	/// Bytes currently mapped by the arena, by the kind of pages backing them.
+	struct statistics {
+		uint64_t huge_pages{0};
+		uint64_t transparent_huge_pages{0};
+		uint64_t normal_pages{0};
+		uint64_t chunks{0};            ///< Chunks taken by sub-arenas
+		uint64_t large_blocks{0};      ///< Live blocks with regions of their own
+	};
+
+	/// \param chunk_size Bytes a sub-arena takes at a time; rounded up to a
+	/// multiple of the huge page size.
+	/// \param try_hugetlb Try explicit huge pages before transparent ones.
+	explicit buffer_arena(size_t chunk_size = 8*huge_page_size, bool try_hugetlb = true);
+	/// Unmaps all memory; no block may be used afterwards.
+	~buffer_arena();
+
+	buffer_arena(const buffer_arena&) = delete;
+	buffer_arena& operator=(const buffer_arena&) = delete;
+
+	size_t get_chunk_size() const {return _chunk_size;}
+	statistics get_statistics() const;
+
+	/// \brief Allocate a block of at least `size` bytes.
+	///
+	/// Throws `std::bad_alloc` if memory can't be mapped.
+	void* allocate(size_t size);
+	/// Free a block returned by `allocate(size)`.
+	void deallocate(void *p, size_t size) noexcept;
+
+	/// The arena used by default by `arena_allocator`; it is never destroyed.
+	static buffer_arena& global();
+
+private:
+	static constexpr size_t classes = 64;
+	struct sub_arena;
+	struct thread_subs;
+
+	const size_t _chunk_size;
+	const bool _try_hugetlb;
+	const uint64_t _id;
+	mutable std::mutex _mutex;
+	std::unordered_map<char*, std::pair<size_t, page_kind>> _regions;
+	std::vector<std::unique_ptr<sub_arena>> _subs;
+	std::vector<sub_arena*> _orphans;   // Handed back by exited threads
+	statistics _stats;
+
+	sub_arena* local();
+	sub_arena* adopt();
+	void orphan(sub_arena *s);
+	void* carve(sub_arena &s, size_t size);
+	sub_arena*& chunk_owner(void *p) const;
+	char* map_region(size_t size, size_t align = huge_page_size);
+	void unmap_region(char *p);
+	uint64_t& mapped_bytes(page_kind kind);
+};
+
+/// \brief Standard allocator drawing from a `buffer_arena`, e.g., for the
+/// vectors passed to `net_socket::recv` and `send`.
+///
+/// Allocators compare equal if they use the same arena.
+template<typename T>
+class arena_allocator {
+public:
+	using value_type = T;
+
+	static_assert(alignof(T) <= buffer_arena::min_block_size, "Alignment exceeds arena block alignment");
+
+	/// Allocate from `buffer_arena::global()`.
+	arena_allocator() noexcept : _arena(&buffer_arena::global()) {}
+	explicit arena_allocator(buffer_arena &arena) noexcept : _arena(&arena) {}
+	template<typename U>
+		arena_allocator(const arena_allocator<U> &other) noexcept : _arena(&other.get_arena()) {}
+
+	T* allocate(size_t n) {return static_cast<T*>(_arena->allocate(n*sizeof(T)));}
+	void deallocate(T *p, size_t n) noexcept {_arena->deallocate(p, n*sizeof(T));}
+	buffer_arena& get_arena() const noexcept {return *_arena;}
+
+	template<typename U>
+		bool operator==(const arena_allocator<U> &other) const noexcept {return _arena == &other.get_arena();}
+
+private:
+	buffer_arena *_arena;
+};
+
+/// A vector whose elements are stored in a `buffer_arena`.
+template<typename T>
+	using arena_vector = std::vector<T, arena_allocator<T>>;
+
+} // namespace network_socket
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef __BUFFER_BUDGET_H
+#define __BUFFER_BUDGET_H
+
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+#include <cstdint>
+#include <sys/types.h>
+#include "net_socket.h"
+
+namespace network_socket {
+
+/// \brief State of the sockets managed by a buffer_budget, as of the last
+/// `check`.
+struct buffer_budget_statistics {
+	uint64_t sockets{0};           ///< Sockets managed
+	uint64_t shrunk{0};            ///< Sockets whose buffers are shrunk
+	uint64_t buffer_limits{0};     ///< Sum of send and receive buffer limits
+	uint64_t memory{0};            ///< Kernel memory charged to the sockets
+	uint64_t shrinks{0};           ///< Times buffers were shrunk, in total
+	uint64_t restores{0};          ///< Times buffers were restored, in total
+	uint64_t failed_restores{0};   ///< Restores that fell short of the recorded sizes
+};
+
+/// \brief Keeps the kernel buffers of many connections within a budget by
+/// shrinking the buffers of idle ones.
+///
+/// Each connection's buffers may grow to megabytes, so with many connections
+/// the kernel's socket memory can reach tens of gigabytes. Each `check` (to
+/// be called periodically) reads every managed socket's buffer limits and
+/// memory (`SO_MEMINFO`) and when it last sent or received data (`TCP_INFO`).
+/// While the sum of the send and receive buffer limits exceeds the budget,
+/// the buffers of the longest idle connections are shrunk to
+/// `idle_buffer_size` (`SO_SNDBUF` and `SO_RCVBUF`). A connection counts as
+/// idle when it has neither sent nor received data for `idle_after` and has
+/// nothing queued. Once a shrunk connection is active again, the next
+/// `check` restores the sizes it had when it was shrunk.
+///
+/// Setting a buffer size ends the kernel's automatic tuning of that buffer
+/// for good (`SOCK_SNDBUF_LOCK`, `SOCK_RCVBUF_LOCK`), so a connection that
+/// was shrunk keeps the restored sizes and no longer grows. Sizes above
+/// `net.core.wmem_max` and `net.core.rmem_max` are only set with
+/// `CAP_NET_ADMIN` (`SO_SNDBUFFORCE`, `SO_RCVBUFFORCE`); without it, buffers
+/// that autotuning grew to megabytes are restored to those maximums (e.g.,
+/// 416 KiB). Restores that don't reach the recorded sizes are counted as
+/// `failed_restores` rather than `restores`.
+///
+/// Only each socket's descriptor and the identity of the open socket (its
+/// device and inode) are kept, and the kernel is asked directly, so sockets
+/// may be used, closed or destroyed on other threads. `check` drops sockets
+/// whose descriptor was closed or now refers to another socket. All members
+/// are thread-safe.
+class buffer_budget {
+public:
+	using duration = std::chrono::milliseconds;
+
+	/// \param budget Bytes of send and receive buffer limits allowed in sum.
+	/// \param idle_after Time without data after which a connection is idle.
+	/// \param idle_buffer_size Size each buffer of an idle connection is
+	/// shrunk to (before the kernel doubles it).
+	explicit buffer_budget(uint64_t budget, duration idle_after = std::chrono::seconds(10),
+		int idle_buffer_size = 4096);
+	/// Restores the buffers of the shrunk sockets still managed.
+	~buffer_budget();
+
+	buffer_budget(const buffer_budget&) = delete;
+	buffer_budget& operator=(const buffer_budget&) = delete;
+
+	uint64_t get_budget() const {return _budget;}
+	duration get_idle_after() const {return _idle_after;}
+
+	/// \brief Manage the buffers of a connected TCP socket.
+	///
+	/// Throws `std::invalid_argument` if the socket isn't connected.
+	void add(net_socket &s);
+	/// \brief Stop managing a socket, restoring its buffers if they are
+	/// shrunk.
+	///
+	/// Closed sockets need not be removed.
+	void remove(net_socket &s);
+
+	/// \brief Restore active connections and shrink idle ones to meet the
+	/// budget.
+	buffer_budget_statistics check();
+	buffer_budget_statistics get_statistics() const;
+
+private:
+	// The open socket a descriptor refers to
+	struct identity {
+		dev_t dev{0};
+		ino_t ino{0};
+
+		bool operator==(const identity&) const = default;
+	};
+
+	struct entry {
+		identity id;
+		bool shrunk{false};
+		// Sizes to restore, as reported by the kernel
+		int sndbuf{0};
+		int rcvbuf{0};
+	};
+
+	const uint64_t _budget;
+	const duration _idle_after;
+	const int _idle_buffer_size;
+	mutable std::mutex _mutex;
+	std::unordered_map<int, entry> _sockets;  // By descriptor
+	buffer_budget_statistics _stats;
+
+	static bool identify(int fd, identity &id);
+	static bool restore(int fd, entry &e);
+	static bool get_buffers(int fd, int &sndbuf, int &rcvbuf);
+	static bool set_buffers(int fd, int sndbuf, int rcvbuf);
+};
+
+} // namespace network_socket
+
+#endif
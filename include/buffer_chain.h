@@ -0,0 +1,99 @@
+#ifndef __BUFFER_CHAIN_H
+#define __BUFFER_CHAIN_H
+
+#include <deque>
+#include <vector>
+#include <memory>
+#include <span>
+#include <cstddef>
+#include <sys/uio.h>
+
+namespace network_socket {
+
+/// \brief A sequence of bytes stored in reference-counted blocks that are
+/// shared rather than copied.
+///
+/// The chain is a list of segments, each a view of part of a block. Copying a
+/// chain, taking a `slice`, or appending one chain to another shares the
+/// blocks, so a payload can be forwarded to several sockets or handed to
+/// another thread without copying its bytes; a block is freed when the last
+/// segment viewing it is gone. Headers and trailers are added with `prepend`
+/// and `append` in blocks of their own. Received data is written into free
+/// room at the end of the last block (`prepare` and `commit`), which is only
+/// done while no other chain shares that block, so shared bytes never change.
+///
+/// `net_socket` receives into chains and sends them with a single gather
+/// write. Blocks are allocated from `buffer_arena::global()` and, when the
+/// last chain viewing them is released on another thread, go back to the
+/// allocating thread for reuse. A chain may be used by one thread at a time;
+/// different chains sharing blocks may be used by different threads.
+class buffer_chain {
+public:
+	/// Size of blocks allocated for appended and received data.
+	static constexpr size_t default_block_size = 16384;
+
+	buffer_chain() = default;
+	/// Create a chain holding a copy of `size` bytes at `data`.
+	buffer_chain(const void *data, size_t size) {append(data, size);}
+
+	/// Number of bytes in the chain.
+	size_t size() const {return _size;}
+	bool empty() const {return _size == 0;}
+	size_t get_segment_count() const {return _segments.size();}
+	/// Bytes of segment `i`.
+	std::span<const char> get_segment(size_t i) const;
+
+	/// Copy `size` bytes to the end of the chain.
+	void append(const void *data, size_t size);
+	/// Add the bytes of `other` to the end of the chain without copying them.
+	void append(const buffer_chain &other);
+	/// Copy `size` bytes to the start of the chain.
+	void prepend(const void *data, size_t size);
+	/// Add the bytes of `other` to the start of the chain without copying them.
+	void prepend(const buffer_chain &other);
+
+	/// \brief Get `length` bytes starting at `offset`, sharing the blocks.
+	///
+	/// Throws `std::out_of_range` if the range exceeds the chain.
+	buffer_chain slice(size_t offset, size_t length) const;
+	/// Remove the first `size` bytes and return them.
+	buffer_chain split(size_t size);
+	/// Remove the first `size` bytes.
+	void trim_front(size_t size);
+	/// Remove the last `size` bytes.
+	void trim_back(size_t size);
+	void clear();
+
+	/// \brief Copy `length` bytes starting at `offset` to `dest`.
+	///
+	/// Throws `std::out_of_range` if the range exceeds the chain.
+	void copy_to(void *dest, size_t offset, size_t length) const;
+	/// The segments as `iovec`s, e.g., for `writev` or `sendmsg`.
+	std::vector<struct iovec> get_iovecs() const;
+
+	/// \brief Get writable room of at least `min_size` bytes at the end of the
+	/// chain.
+	///
+	/// The room stays outside the chain until `commit` is called; it is
+	/// valid until the chain is next changed.
+	std::span<char> prepare(size_t min_size);
+	/// Add the first `size` bytes of the room returned by `prepare`.
+	void commit(size_t size);
+
+private:
+	struct segment {
+		std::shared_ptr<char[]> block;
+		size_t capacity;
+		size_t offset;
+		size_t length;
+	};
+
+	std::deque<segment> _segments;
+	size_t _size{0};
+
+	static segment allocate(size_t capacity);
+};
+
+} // namespace network_socket
+
+#endif
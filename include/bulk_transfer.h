@@ -0,0 +1,163 @@
+#ifndef __BULK_TRANSFER_H
+#define __BULK_TRANSFER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <cstdint>
+#include "net_socket.h"
+#include "buffer_arena.h"
+
+namespace network_socket {
+
+/// \brief Called with the number of bytes transferred so far and the total.
+///
+/// Progress handlers may be called from several threads, but never
+/// concurrently.
+using progress_handler = std::function<void(uint64_t transferred, uint64_t total)>;
+
+/// \brief Sends a buffer or file over several parallel TCP connections.
+///
+/// A single TCP connection over a long, fast path is limited by its window
+/// and by the CPU of one thread. A bulk_sender opens `connections` net_socket
+/// connections to a bulk_receiver and splits the data into chunks of
+/// `chunk_size` bytes. One thread per connection repeatedly takes the next
+/// unsent chunk and sends it, so faster connections carry more chunks. Each
+/// chunk carries its offset, which lets the receiver put the data back in
+/// order.
+///
+/// Each connection starts with a 20-byte header: a magic number, the
+/// connection's index, the number of connections (32-bit values) and the
+/// total size (64-bit). Each chunk is preceded by its offset (64-bit) and
+/// length (32-bit); a zero length ends the connection. All values are
+/// unsigned integers in *network* byte order.
+class bulk_sender {
+public:
+	explicit bulk_sender(unsigned int connections = 4, size_t chunk_size = 1 << 20);
+
+	bulk_sender(const bulk_sender&) = delete;
+	bulk_sender& operator=(const bulk_sender&) = delete;
+
+	unsigned int get_connection_count() const {return _conn_count;}
+	size_t get_chunk_size() const {return _chunk_size;}
+	/// \brief Bind connections to local addresses.
+	///
+	/// Connection `i` binds to `addrs[i % addrs.size()]`, spreading the
+	/// connections over several local interfaces. Must be called before
+	/// `connect`.
+	void set_source_addresses(const std::vector<address> &addrs);
+	/// Set the handler called after each chunk is sent.
+	void set_progress_handler(progress_handler handler) {_progress = std::move(handler);}
+	/// Number of payload bytes sent by the current or last transfer.
+	uint64_t get_bytes_transferred() const {return _transferred;}
+	bool is_connected() const {return !_sockets.empty();}
+
+	/// Open all connections to the receiver at `host` and `port`.
+	void connect(const std::string &host, unsigned short port);
+	/// Close all connections.
+	void close();
+
+	/// \brief Send `size` bytes starting at `data`.
+	///
+	/// Blocks until all data is sent and closes the connections.
+	/// \return The number of bytes sent.
+	uint64_t send(const void *data, uint64_t size);
+	/// \details See `send(void*)`.
+	uint64_t send(const std::vector<char> &data) {return send(data.data(), data.size());}
+	/// \brief Send the contents of the file at `path`.
+	/// \details See `send(void*)`.
+	uint64_t send_file(const std::string &path);
+
+private:
+	unsigned int _conn_count;
+	size_t _chunk_size;
+	std::vector<address> _sources;
+	std::vector<std::unique_ptr<net_socket>> _sockets;
+	progress_handler _progress;
+	std::mutex _progress_mutex;
+	std::atomic<uint64_t> _transferred{0};
+
+	uint64_t transfer(uint64_t size,
+		const std::function<void(uint64_t offset, size_t len, arena_vector<char> &buf, net_socket &s)> &send_chunk);
+};
+
+/// \brief Receives data sent by a bulk_sender and reassembles it in order.
+///
+/// The receiver listens for the connections of one transfer; the number of
+/// connections and the total size are taken from the connection headers (see
+/// bulk_sender). One thread per connection receives chunks directly into
+/// their place in the destination. A transfer fails if its chunks overlap or
+/// leave part of the data unsent.
+class bulk_receiver {
+public:
+	bulk_receiver() = default;
+
+	bulk_receiver(const bulk_receiver&) = delete;
+	bulk_receiver& operator=(const bulk_receiver&) = delete;
+
+	/// Listen for connections on the specified interface and port.
+	void listen(const std::string &host, unsigned short port);
+	/// Listen for connections on any interface on specified port.
+	void listen(unsigned short port) {listen("", port);}
+	/// Stop listening.
+	void close() {_listener.close();}
+	bool is_passively_opened() const {return _listener.is_passively_opened();}
+	/// Get the address the receiver is listening on.
+	address get_local_address() const {return _listener.get_local_address();}
+
+	/// \brief Set the timeout for receiving from each connection.
+	///
+	/// See `net_socket::set_timeout`. A `timeout_exception` is thrown from
+	/// `receive` if a connection stalls, or if a connection, including the
+	/// first, isn't made within the timeout (e.g., a sender opening fewer
+	/// connections than it announced).
+	void set_timeout(double s);
+	double get_timeout() const {return _timeout;}
+	/// \brief Set the largest number of connections a transfer may use.
+	///
+	/// The count is chosen by the sender, and each connection gets a thread,
+	/// so transfers announcing more connections are rejected.
+	void set_max_connections(unsigned int count);
+	unsigned int get_max_connections() const {return _max_conns;}
+	/// \brief Set the largest total size a transfer may have.
+	///
+	/// The size is chosen by the sender and the destination is sized to it
+	/// before any data arrives, so larger transfers are rejected. Defaults to
+	/// 4 GiB.
+	void set_max_size(uint64_t size) {_max_size = size;}
+	uint64_t get_max_size() const {return _max_size;}
+	/// Set the handler called after each chunk is received.
+	void set_progress_handler(progress_handler handler) {_progress = std::move(handler);}
+	/// Number of payload bytes received by the current or last transfer.
+	uint64_t get_bytes_transferred() const {return _transferred;}
+
+	/// \brief Receive one transfer into `data`.
+	///
+	/// The vector is resized to the total size of the transfer.
+	/// \return The number of bytes received.
+	uint64_t receive(std::vector<char> &data);
+	/// \brief Receive one transfer into the file at `path`.
+	///
+	/// The file is created or truncated.
+	/// \return The number of bytes received.
+	uint64_t receive_file(const std::string &path);
+
+private:
+	net_socket _listener;
+	double _timeout{0.0};
+	unsigned int _max_conns{64};
+	uint64_t _max_size{uint64_t(1) << 32};
+	progress_handler _progress;
+	std::mutex _progress_mutex;
+	std::atomic<uint64_t> _transferred{0};
+
+	uint64_t transfer(const std::function<void(uint64_t total)> &prepare,
+		const std::function<void(uint64_t offset, size_t len, arena_vector<char> &buf, net_socket &s)> &recv_chunk);
+};
+
+} // namespace network_socket
+
+#endif
@@ -0,0 +1,147 @@
+#ifndef __FEED_HANDLER_H
+#define __FEED_HANDLER_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "net_socket.h"
+#include "multicast_socket.h"
+
+namespace network_socket {
+
+/// \brief Counters describing the messages seen by a feed_handler.
+struct feed_statistics {
+	uint64_t delivered{0};     ///< Messages passed to the delivery handler
+	uint64_t duplicates{0};    ///< Messages dropped as already seen
+	uint64_t gaps{0};          ///< Missing sequence numbers detected
+	uint64_t recovered{0};     ///< Missing messages that later arrived
+	uint64_t lost{0};          ///< Missing messages skipped without delivery
+	uint64_t malformed{0};     ///< Messages without a sequence number or too large to buffer
+	uint64_t first_on_a{0};    ///< Accepted messages that arrived first on line A
+	uint64_t first_on_b{0};    ///< Accepted messages that arrived first on line B
+	uint64_t first_on_recovery{0}; ///< Accepted messages that arrived by retransmission
+};
+
+/// \brief Merges redundant, sequenced feeds into one in-order message stream.
+///
+/// Market-data style feeds publish every message on two lines (A and B),
+/// usually separate multicast groups, each message carrying a sequence
+/// number. The feed_handler arbitrates between the lines: the first copy of
+/// each sequence number is accepted and later copies are dropped as
+/// duplicates. Accepted messages are delivered in sequence order. Messages
+/// that arrive ahead of a gap are held in a window of `window` preallocated
+/// slots until the gap is filled by the other line, by retransmission, or is
+/// abandoned.
+///
+/// Gaps are requested over a TCP net_socket with `request_retransmission`.
+/// Each request is 16 bytes: the first missing sequence number followed by
+/// the number of consecutive missing messages, both 64-bit unsigned integers
+/// in *network* byte order. The retransmitted messages are given back to the
+/// handler with `on_message(line::recovery, ...)`.
+///
+/// No memory is allocated while processing messages; messages in sequence
+/// are delivered straight from the caller's buffer and only out-of-order
+/// messages are copied into the window.
+class feed_handler {
+public:
+	/// The line a message arrived on.
+	enum class line {A, B, recovery};
+
+	/// \brief Extracts the sequence number of a message.
+	///
+	/// Returns false if the message has no valid sequence number.
+	using sequence_extractor =
+		std::function<bool(const char *data, size_t size, uint64_t &seq)>;
+	/// Receives each accepted message, in sequence order.
+	using delivery_handler =
+		std::function<void(uint64_t seq, const char *data, size_t size)>;
+
+	/// \param window Number of out-of-order messages that can be held.
+	/// \param max_message_size Largest message that can be held in the window.
+	/// \param extract Finds the sequence number of each message.
+	/// \param deliver Called for each message in sequence order.
+	feed_handler(size_t window, size_t max_message_size,
+		sequence_extractor extract, delivery_handler deliver);
+
+	feed_handler(const feed_handler&) = delete;
+	feed_handler& operator=(const feed_handler&) = delete;
+
+	/// \brief Extractor for a sequence number stored as a 64-bit unsigned
+	/// integer in *network* byte order at `offset` bytes into the message.
+	static sequence_extractor big_endian_u64(size_t offset = 0);
+
+	size_t get_window() const {return _window;}
+	size_t get_max_message_size() const {return _max_size;}
+	/// \brief Next sequence number to be delivered.
+	///
+	/// Until the first message arrives (or `set_expected_sequence` is called),
+	/// the handler synchronizes to the sequence number of the first message.
+	uint64_t get_expected_sequence() const {return _expected;}
+	/// \brief Set the next sequence number to deliver.
+	///
+	/// Held messages before `seq` are delivered and missing ones are counted
+	/// as lost. Only allowed before the first message or to move forward.
+	void set_expected_sequence(uint64_t seq);
+	/// Highest sequence number seen so far.
+	uint64_t get_highest_sequence() const {return _highest_next - 1;}
+	/// Test if there are missing messages before the highest seen message.
+	bool has_gap() const {return _highest_next > _expected;}
+	const feed_statistics& get_statistics() const {return _stats;}
+
+	/// \brief Process one message received on line `l`.
+	void on_message(line l, const char *data, size_t size);
+	/// Process every datagram of a batch received on line `l`.
+	void on_batch(line l, const datagram_batch &batch);
+
+	/// \brief Wait for datagrams on either line and process them.
+	///
+	/// Waits up to `timeout` seconds (indefinitely when 0) for either socket to
+	/// become readable, then receives and processes the waiting datagrams of
+	/// each readable socket using `batch`. A `timeout_exception` is thrown if
+	/// no datagram arrives before the timeout.
+	/// \return The number of datagrams processed.
+	size_t poll(multicast_socket &a, multicast_socket &b, datagram_batch &batch,
+		double timeout = 0);
+
+	/// \brief Request retransmission of missing messages.
+	///
+	/// Sends a request (see class description) for each range of missing
+	/// messages that has not already been requested.
+	/// \return The number of missing messages requested.
+	uint64_t request_retransmission(net_socket &recovery);
+
+	/// \brief Abandon the first gap.
+	///
+	/// The missing messages of the first gap are counted as lost and any held
+	/// messages after the gap are delivered up to the next gap.
+	void skip_gap();
+
+private:
+	size_t _window;
+	size_t _max_size;
+	sequence_extractor _extract;
+	delivery_handler _deliver;
+	bool _synced{false};
+	uint64_t _expected{0};
+	uint64_t _highest_next{0};     // One past the highest sequence number seen
+	uint64_t _requested_next{0};   // One past the highest sequence number requested
+	feed_statistics _stats;
+
+	// Window slots, indexed by sequence number modulo the window size
+	arena_vector<char> _storage;
+	std::vector<size_t> _lengths;
+	std::vector<uint64_t> _seqs;
+	std::vector<unsigned char> _present;
+
+	size_t slot(uint64_t seq) const {return seq % _window;}
+	bool held(uint64_t seq) const;
+	void sync(uint64_t seq);
+	void deliver(uint64_t seq, const char *data, size_t size);
+	void drain();
+	void advance_to(uint64_t seq);
+	void count_arrival(line l);
+};
+
+} // namespace network_socket
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef __LISTENER_SET_H
+#define __LISTENER_SET_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <sys/time.h>
+#include "net_socket.h"
+
+namespace network_socket {
+
+/// \brief A set of listening sockets that accepts connections from all of
+/// them.
+///
+/// `net_socket::listen` binds the first usable address only, so a server
+/// listens on either IPv4 or IPv6 and on one interface. A listener_set binds
+/// every address it is given, e.g., both the IPv4 and IPv6 wildcard
+/// addresses, several interfaces, or several ports, and `accept` waits on all
+/// of them at once with a single `poll`. Ready listeners are served in turn
+/// so that a busy one can't starve the others.
+///
+/// IPv6 listeners are opened with `IPV6_V6ONLY` set by default, so that IPv4
+/// and IPv6 wildcard listeners can share a port (see `set_v6_only`).
+class listener_set {
+public:
+	listener_set() = default;
+
+	listener_set(const listener_set&) = delete;
+	listener_set& operator=(const listener_set&) = delete;
+
+	/// \brief Listen on every local address of `host` and `port`.
+	///
+	/// All addresses returned by `getaddrinfo` are bound; if `host` is empty,
+	/// these are the IPv4 and IPv6 wildcard addresses. Throws an exception if
+	/// none can be bound.
+	/// \return The number of listeners added.
+	size_t add(const std::string &host, unsigned short port);
+	/// \brief Listen on every wildcard address on `port`.
+	/// \details See `add(std::string, unsigned short)`.
+	size_t add(unsigned short port) {return add("", port);}
+	/// \brief Listen on the address and port of `addr`.
+	///
+	/// Throws an exception if the address can't be bound.
+	void add(const address &addr);
+	/// Stop listening on all addresses.
+	void close() {_listeners.clear();}
+
+	// Getter and setter members
+	/// Number of listening sockets.
+	size_t size() const {return _listeners.size();}
+	bool empty() const {return _listeners.empty();}
+	/// Get the local address of listener `i`, in the order added.
+	address get_local_address(size_t i) const;
+	/// Get the local addresses of all listeners, in the order added.
+	std::vector<address> get_local_addresses() const;
+	int get_backlog() const {return _backlog;}
+	/// \brief Set the pending connection backlog of listeners added later.
+	///
+	/// \param backlog Must be non-negative.
+	void set_backlog(int backlog);
+	bool get_v6_only() const {return _v6_only;}
+	/// \brief Set `IPV6_V6ONLY` on IPv6 listeners added later.
+	///
+	/// With `v6_only` false, an IPv6 wildcard listener also accepts IPv4
+	/// connections and an IPv4 wildcard listener can't use the same port.
+	void set_v6_only(bool v6_only) {_v6_only = v6_only;}
+	bool multipath_enabled() const {return _multipath;}
+	/// \brief Use MPTCP on listeners added later (see
+	/// `net_socket::set_multipath`).
+	void set_multipath(bool enable) {_multipath = enable;}
+	bool timeout_is_set() const {return _do_timeout;}
+	/// \brief Get the current timeout interval.
+	/// \return 0 if timeouts are disabled.
+	double get_timeout() const;
+	/// \brief Set how long accept waits for a connection.
+	///
+	/// Setting the timeout to 0 disables timeout operation similar to
+	/// clear_timeout().
+	void set_timeout(double s);
+	/// Disable timeout operation.
+	void clear_timeout() {_do_timeout = false;}
+
+	/// \brief Accept a new connection on any of the listeners.
+	///
+	/// Waits until a connection is pending on one of the listeners (subject to
+	/// the timeout, in which case a `timeout_exception` is thrown). The
+	/// returned socket is connected and ready to use.
+	/// \param index If not null, receives the index of the listener that
+	/// accepted the connection.
+	std::unique_ptr<net_socket> accept(size_t *index = nullptr);
+
+private:
+	std::vector<net_socket> _listeners;
+	int _backlog{5};
+	bool _v6_only{true};
+	bool _multipath{false};
+	bool _do_timeout{false};
+	struct timeval _timeout{};
+	size_t _next{0};
+
+	void listen(const address &addr);
+};
+
+} // namespace network_socket
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef __METRICS_H
+#define __METRICS_H
+
+#include <atomic>
+#include <array>
+#include <string>
+#include <thread>
+#include <cstdint>
+#include "net_socket.h"
+
+namespace network_socket {
+
+/// \brief Number of cells a metric is spread over.
+///
+/// Each thread updates one cell (threads share cells round-robin), so that
+/// threads doing I/O concurrently rarely contend for a cache line; readers
+/// add the cells up.
+constexpr size_t metrics_cells = 16;
+
+/// \brief A monotonically increasing count, updated and read lock-free.
+class metrics_counter {
+public:
+	void add(uint64_t n = 1) {_cells[cell_index()].value.fetch_add(n, std::memory_order_relaxed);}
+	uint64_t get() const;
+
+	/// Cell of the calling thread.
+	static size_t cell_index();
+
+private:
+	struct alignas(64) cell {
+		std::atomic<uint64_t> value{0};
+	};
+	std::array<cell, metrics_cells> _cells;
+};
+
+/// \brief A distribution of observed values in power-of-two buckets,
+/// updated and read lock-free.
+///
+/// Bucket `i` counts the values no greater than 2^i; the last bucket counts
+/// all larger values.
+class metrics_histogram {
+public:
+	static constexpr size_t buckets = 32;
+
+	/// Values read at one point in time.
+	struct snapshot {
+		std::array<uint64_t, buckets> counts{};
+		uint64_t count{0};
+		uint64_t sum{0};
+	};
+
+	void observe(uint64_t value);
+	snapshot get() const;
+	/// Upper bound of bucket `i`, or 0 for the last (unbounded) bucket.
+	static uint64_t upper_bound(size_t i) {return (i + 1 < buckets) ? (uint64_t(1) << i) : 0;}
+
+private:
+	struct alignas(64) cell {
+		std::array<std::atomic<uint64_t>, buckets> counts{};
+		std::atomic<uint64_t> sum{0};
+	};
+	std::array<cell, metrics_cells> _cells;
+};
+
+/// \brief Process-wide counters of all net_sockets.
+struct library_metrics {
+	metrics_counter connections_opened;    ///< Successful connects
+	metrics_counter connections_accepted;
+	metrics_counter connections_closed;    ///< Connected sockets closed
+	metrics_counter bytes_sent;
+	metrics_counter bytes_received;
+	metrics_counter send_calls;            ///< Send system calls
+	metrics_counter recv_calls;            ///< Receive system calls
+	metrics_counter timeouts;
+	/// Bytes returned by each receive system call
+	metrics_histogram recv_bytes;
+	/// Milliseconds accepted connections waited in the accept queue, if
+	/// accept latency monitoring is enabled on the listener
+	metrics_histogram accept_queue_wait;
+
+	/// \brief Format the metrics in the Prometheus text exposition format.
+	///
+	/// The host-wide `ListenOverflows` and `ListenDrops` counters are
+	/// included.
+	std::string prometheus_text() const;
+};
+
+/// Get the metrics updated by all net_sockets.
+library_metrics& get_library_metrics();
+
+/// \brief Serves `get_library_metrics` over HTTP in the Prometheus text
+/// format.
+///
+/// The server runs on its own thread on a `net_socket` listening on loopback
+/// by default. Every request is answered with the current metrics, read
+/// without locking, and the connection is closed.
+class metrics_server {
+public:
+	metrics_server() = default;
+	metrics_server(const metrics_server&) = delete;
+	metrics_server& operator=(const metrics_server&) = delete;
+	/// Stops the server.
+	~metrics_server();
+
+	/// \brief Start serving on `host` and `port`.
+	///
+	/// A port of 0 lets the kernel choose one; see `get_local_address`.
+	void start(unsigned short port, const std::string &host = "127.0.0.1");
+	/// Stop serving and close the listening socket.
+	void stop();
+	bool is_running() const {return _thread.joinable();}
+	address get_local_address() const {return _listener.get_local_address();}
+
+private:
+	net_socket _listener;
+	std::thread _thread;
+	std::atomic<bool> _stop{false};
+
+	void serve();
+};
+
+} // namespace network_socket
+
+#endif
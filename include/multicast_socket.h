@@ -0,0 +1,189 @@
+#ifndef __MULTICAST_SOCKET_H
+#define __MULTICAST_SOCKET_H
+
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include "net_socket.h"
+#include "buffer_arena.h"
+
+namespace network_socket {
+
+/// \brief Preallocated storage for receiving several datagrams in one call.
+///
+/// The batch owns `count` buffers of `datagram_size` bytes each, allocated
+/// once at construction. `multicast_socket::recv_batch` fills as many buffers
+/// as there are datagrams waiting (at least one) without further allocation.
+/// Datagrams larger than `datagram_size` are truncated and flagged.
+class datagram_batch {
+public:
+	datagram_batch(size_t count, size_t datagram_size);
+
+	datagram_batch(const datagram_batch&) = delete;
+	datagram_batch& operator=(const datagram_batch&) = delete;
+
+	/// Maximum number of datagrams received by one call.
+	size_t capacity() const {return _msgs.size();}
+	/// Number of datagrams received by the last call to `recv_batch`.
+	size_t size() const {return _received;}
+	bool empty() const {return _received == 0;}
+	size_t get_datagram_size() const {return _dgram_size;}
+
+	/// \brief Payload of datagram `i`.
+	///
+	/// The pointer remains valid, and the contents unchanged, until the next
+	/// call to `recv_batch` with this batch.
+	const char* data(size_t i) const;
+	/// Number of payload bytes stored for datagram `i`.
+	size_t length(size_t i) const;
+	/// True if datagram `i` was larger than the buffer and was truncated.
+	bool truncated(size_t i) const;
+	/// Address of the sender of datagram `i`.
+	address source(size_t i) const;
+
+private:
+	friend class multicast_socket;
+
+	size_t _dgram_size;
+	size_t _received{0};
+	arena_vector<char> _buffer;
+	std::vector<struct iovec> _iovs;
+	std::vector<struct sockaddr_storage> _sources;
+	std::vector<struct mmsghdr> _msgs;
+
+	void reset();
+	void check_index(size_t i) const;
+};
+
+/// \brief UDP socket for sending to and receiving from multicast groups.
+///
+/// A multicast_socket sends datagrams to a group with `send_to` and receives
+/// datagrams after it is `bind`ed to the group port and has `join`ed the
+/// group. Groups can be joined on a specific interface and, for
+/// source-specific multicast, restricted to a single sender. Interfaces are
+/// named either by interface name (e.g., "eth0") or by one of the interface's
+/// addresses (e.g., "127.0.0.1"); an empty string lets the kernel choose.
+///
+/// The underlying socket is created on first use and closed by `close` or the
+/// destructor. Only IPv4 and IPv6 are supported; the network protocol cannot
+/// be ANY since group addresses are family specific.
+class multicast_socket {
+public:
+	explicit multicast_socket(
+		net_socket::network_protocol net = net_socket::network_protocol::IPv4);
+
+	multicast_socket(const multicast_socket&) = delete;
+	multicast_socket& operator=(const multicast_socket&) = delete;
+
+	/// Destructor
+	///
+	/// The destructor closes the socket and releases resources to the OS.
+	~multicast_socket() noexcept;
+
+	// Getter and setter members
+	/// \brief Get the socket descriptor (file descriptor).
+	/// \return -1 if the socket is not open.
+	int get_socket_descriptor() const {return _sock_desc;}
+	net_socket::network_protocol get_network_protocol() const {return _net_proto;}
+	bool is_bound() const {return _bound;}
+	bool timeout_is_set() const {return _do_timeout;}
+	/// \brief Get the current timeout interval.
+	/// \return 0 if timeouts are disabled.
+	double get_timeout() const;
+	/// \brief Set the timeout interval for receive operations.
+	///
+	/// Setting the timeout to 0 disables timeout operation similar to
+	/// clear_timeout().
+	void set_timeout(double s);
+	/// Disable timeout operation.
+	void clear_timeout() {_do_timeout = false;}
+
+	/// \brief Get the time-to-live (hop limit) of sent datagrams.
+	int get_ttl() const;
+	/// \brief Set the time-to-live (hop limit) of sent datagrams.
+	///
+	/// \param hops Must be in the range [0, 255]. The default is 1, which
+	/// keeps datagrams on the local network.
+	void set_ttl(int hops);
+	/// Test if datagrams sent by this host are looped back to local receivers.
+	bool get_loopback() const;
+	/// Control whether datagrams sent by this host are looped back to local
+	/// receivers.
+	void set_loopback(bool enable);
+	/// \brief Select the interface used for sending datagrams.
+	///
+	/// An empty string restores the kernel's default choice.
+	void set_interface(const std::string &interface);
+
+	/// \brief Bind to a group and port to receive datagrams.
+	///
+	/// Binding to the group address (rather than to any address) filters out
+	/// datagrams for other groups using the same port. Several sockets may
+	/// bind the same group and port.
+	void bind(const std::string &group, unsigned short port);
+	/// Bind to any address on the port to receive datagrams.
+	void bind(unsigned short port);
+
+	/// Join a group on the interface (any-source multicast).
+	void join(const std::string &group, const std::string &interface = "");
+	/// Join a group on the interface and only accept datagrams from `source`
+	/// (source-specific multicast).
+	void join(const std::string &group, const std::string &source,
+		const std::string &interface);
+	/// Leave a group joined with `join(group, interface)`.
+	void leave(const std::string &group, const std::string &interface = "");
+	/// Leave a group joined with `join(group, source, interface)`.
+	void leave(const std::string &group, const std::string &source,
+		const std::string &interface);
+
+	/// Close the socket, leaving all groups.
+	void close();
+
+	/// \brief Send a datagram of `size` bytes to `dest`.
+	/// \return The number of bytes sent.
+	ssize_t send_to(const void *data, size_t size, const address &dest);
+	/// \brief Send the string data *and* a NULL to `dest`.
+	/// \details See `net_socket::send(std::string)`.
+	ssize_t send_to(const std::string &data, const address &dest);
+	/// Send a datagram to `port` of `group`.
+	ssize_t send_to(const void *data, size_t size, const std::string &group,
+		unsigned short port);
+
+	/// \brief Receive one datagram of at most `max_size` bytes.
+	///
+	/// If `source` is not null, it receives the sender's address. Throws a
+	/// `timeout_exception` if a timeout is set and no datagram arrives.
+	/// \return The number of bytes received. Bytes beyond `max_size` are
+	/// discarded.
+	ssize_t recv_from(void *data, size_t max_size, address *source = nullptr);
+	/// \brief Receive as many waiting datagrams as fit in `batch`.
+	///
+	/// Waits for at least one datagram (subject to the timeout) and then
+	/// collects any others already queued, all with a single system call.
+	/// \return The number of datagrams received, also available as
+	/// batch.size().
+	size_t recv_batch(datagram_batch &batch);
+
+private:
+	int _sock_desc{-1};
+	net_socket::network_protocol _net_proto{net_socket::network_protocol::IPv4};
+	bool _bound{false};
+	bool _do_timeout{false};
+	struct timeval _timeout{};
+
+	void open();
+	int get_af() const;
+	int get_level() const;
+	void wait_readable(const char *func) const;
+	struct sockaddr_storage group_address(const std::string &group,
+		unsigned short port, const char *func) const;
+	unsigned int interface_index(const std::string &interface,
+		const char *func) const;
+	void membership(int option, const std::string &group,
+		const std::string &source, const std::string &interface,
+		const char *func);
+};
+
+} // namespace network_socket
+
+#endif
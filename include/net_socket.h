@@ -4,9 +4,18 @@
 #include <string>
 #include <memory>
 #include <vector>
+#include <utility>
+#include <algorithm>
+#include <span>
 #include <random>
 #include <stdexcept>
+#include <ctime>
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
 #include <netinet/ip.h>
+#include "recv_range.h"
+#include "wire_types.h"
 
 namespace network_socket {
 
@@ -99,6 +108,31 @@ private:
 };
 bool operator!=(const address&, const address&);
 
+/// \brief Kernel timestamps of received or sent data.
+///
+/// Receive timestamps record when the kernel received the data; comparing
+/// them with the time the application reads the data gives the time spent in
+/// kernel queues. Transmit timestamps record when sent data reached a
+/// `stage` of transmission and identify the data by `id`, the byte offset of
+/// the last byte of the send within the connection (starting at 0 when
+/// transmit timestamping is enabled). Timestamps that are not available are
+/// zero.
+struct socket_timestamp {
+	/// Transmit stage the timestamp refers to.
+	enum tx_stage {none, scheduled, sent, acknowledged};
+
+	struct timespec software{};   ///< Kernel software clock (CLOCK_REALTIME)
+	struct timespec hardware{};   ///< Raw network interface hardware clock
+	tx_stage stage{none};         ///< Transmit stage, none for receive timestamps
+	uint32_t id{0};               ///< Transmit byte offset, 0 for receive timestamps
+
+	bool has_software() const {return software.tv_sec != 0 || software.tv_nsec != 0;}
+	bool has_hardware() const {return hardware.tv_sec != 0 || hardware.tv_nsec != 0;}
+};
+
+class source_address_pool;
+class buffer_chain;
+
 /// \brief C++ network socket class that mimics the socket API with support for
 /// some STL classes.
 class net_socket{
@@ -109,6 +143,11 @@ public:
 	/// enum for possible transport-layer protocols.
 	enum transport_protocol {UDP, TCP};
 
+	/// Smallest receive size chosen by the adaptive receive size.
+	static constexpr size_t min_adaptive_recv_size = 256;
+	/// Largest receive size chosen by the adaptive receive size.
+	static constexpr size_t max_adaptive_recv_size = 64*1024;
+
 	explicit net_socket(
 		network_protocol net = network_protocol::ANY,
 		transport_protocol tran = transport_protocol::TCP
@@ -167,6 +206,114 @@ public:
 	/// Receive functions that specify a size of zero (the default) will use
 	/// this size to determine how many bytes to receive.
 	void set_default_recv_size(size_t s) {_recv_size = s;}
+	bool adaptive_recv_size_enabled() const {return _adaptive_recv;}
+	/// \brief Adapt the receive size to the traffic instead of using the
+	/// default receive size.
+	///
+	/// When enabled, receive functions that specify a size of zero use the
+	/// larger of the number of bytes already queued on the socket
+	/// (`FIONREAD`) and an estimate from recent receives. The estimate doubles
+	/// whenever a receive fills the whole buffer and otherwise decays towards
+	/// the sizes actually received, within `min_adaptive_recv_size` and
+	/// `max_adaptive_recv_size`. Bulk flows quickly reach large reads while
+	/// chatty connections keep small ones. The estimate starts from the
+	/// default receive size. Sockets returned by `accept` inherit the
+	/// setting and the estimate, but not the default receive size.
+	void set_adaptive_recv_size(bool enable);
+	/// \brief Get the size the next zero-size receive would use, not counting
+	/// queued bytes.
+	size_t get_recv_size_estimate() const {return _adaptive_recv ? _recv_estimate : _recv_size;}
+	/// Test if connect binds to a source address (`set_source_address`).
+	bool source_address_is_set() const {return _bind_source;}
+	/// \brief Get the source address used by connect.
+	///
+	/// Throws an exception if no source address is set.
+	address get_source_address() const;
+	/// \brief Set the local address that connect binds to before connecting.
+	///
+	/// By default the kernel chooses the local address and port. Setting a
+	/// source address selects the local interface (and port, if non-zero) of
+	/// outgoing connections. Only remote addresses of the same family as the
+	/// source address are tried. Replaces any source address pool.
+	void set_source_address(const address &addr);
+	/// Let the kernel choose the local address of outgoing connections.
+	void clear_source_address() {_bind_source = false;}
+	std::shared_ptr<source_address_pool> get_source_address_pool() const {return _source_pool;}
+	/// \brief Bind outgoing connections to the next address of `pool`.
+	///
+	/// Sockets sharing a pool spread their connections across its addresses,
+	/// see `source_address_pool`. Only remote addresses of a family present in
+	/// the pool are tried. Replaces any source address; a null pool lets the
+	/// kernel choose the local address again.
+	void set_source_address_pool(std::shared_ptr<source_address_pool> pool);
+	/// Test if listen sets `IPV6_V6ONLY` (`set_v6_only`).
+	bool v6_only_is_set() const {return _v6_only_set;}
+	/// \brief Get the `IPV6_V6ONLY` value used by listen.
+	/// \return false if not set (the system default applies).
+	bool get_v6_only() const {return _v6_only_set && _v6_only;}
+	/// \brief Control whether an IPv6 listening socket also accepts IPv4
+	/// connections (as IPv4-mapped addresses).
+	///
+	/// When `v6_only` is true, an IPv6 socket only accepts IPv6 connections,
+	/// which lets an IPv4 socket listen on the same port. The option is
+	/// applied when `listen` opens an IPv6 socket; by default the system
+	/// setting (`net.ipv6.bindv6only`) applies.
+	void set_v6_only(bool v6_only) {_v6_only_set = true; _v6_only = v6_only;}
+	/// Use the system default for `IPV6_V6ONLY`.
+	void clear_v6_only() {_v6_only_set = false;}
+	bool multipath_enabled() const {return _multipath;}
+	/// \brief Use Multipath TCP (MPTCP) for TCP connections.
+	///
+	/// The setting applies when the socket is opened by `listen` or
+	/// `connect`; sockets returned by `accept` inherit it. MPTCP connections
+	/// can use several paths (subflows) between the hosts at once, as the
+	/// kernel's path manager (`ip mptcp`) allows. Connections fall back to
+	/// plain TCP transparently if the peer doesn't support MPTCP, and sockets
+	/// are plain TCP sockets if the kernel doesn't (or `net.mptcp.enabled` is
+	/// 0); see `is_multipath`.
+	void set_multipath(bool enable) {_multipath = enable;}
+	/// \brief Test if the socket is using MPTCP: MPTCP was enabled and is
+	/// supported by the kernel and, for a connection, by the peer.
+	bool is_multipath() const;
+	/// State of an MPTCP socket.
+	struct multipath_info {
+		unsigned subflows{0};            ///< Subflows beyond the initial one
+		unsigned subflows_max{0};        ///< Path manager limit on subflows
+		unsigned add_addr_signal{0};     ///< Local addresses announced to the peer
+		unsigned add_addr_accepted{0};   ///< Peer addresses accepted for subflows
+		unsigned local_addr_used{0};     ///< Local addresses used by subflows
+		unsigned local_addr_max{0};      ///< Path manager limit on local addresses
+		uint32_t token{0};               ///< Local connection token
+		bool fallback{false};            ///< The connection fell back to TCP
+	};
+	/// \brief Get the MPTCP state (`MPTCP_INFO`).
+	///
+	/// An exception is thrown if the socket is not an MPTCP socket (see
+	/// `set_multipath`); a connection accepted from a peer without MPTCP is
+	/// a plain TCP socket. Only `fallback` is valid if a connection fell back
+	/// to TCP.
+	multipath_info get_multipath_info() const;
+	/// \brief Get the local and remote addresses of each subflow of a
+	/// connection.
+	///
+	/// A plain TCP connection, including one that fell back from MPTCP, has
+	/// one subflow.
+	std::vector<std::pair<address, address>> get_subflow_addresses() const;
+	bool rx_timestamps_enabled() const {return _rx_timestamps;}
+	bool tx_timestamps_enabled() const {return _tx_timestamps;}
+	/// \brief Enable kernel timestamping (`SO_TIMESTAMPING`) of received and
+	/// sent data.
+	///
+	/// The setting may be changed at any time and is applied when the socket
+	/// is opened; sockets returned by `accept` inherit it. Software
+	/// timestamps are always generated; hardware timestamps are reported when
+	/// the network interface has been configured to generate them. When
+	/// timestamping is first enabled in a process, the kernel may take a
+	/// moment before it starts timestamping incoming data.
+	/// \param rx Report receive timestamps with `recv(void*, size_t,
+	/// socket_timestamp&)`.
+	/// \param tx Queue transmit timestamps, read with `get_tx_timestamp`.
+	void set_timestamps(bool rx, bool tx);
 
 	/// \brief Listen for connections on the specified interface and port or service
 	/// name.
@@ -178,15 +325,56 @@ public:
 	void listen(const std::string &service);
 	/// Listen for connections on any interface on specified port.
 	void listen(unsigned short port);
+	/// Listen for connections on the address and port of `addr`.
+	void listen(const address &addr);
 	/// Connect to the specified host and port or service name.
 	void connect(const std::string &host, const std::string &service);
 	/// Connect to the specified host and port.
 	void connect(const std::string &host, unsigned short port);
 	/// Connect to the specified address.
 	void connect(const address &addr);
+	/// \brief Take over an open socket descriptor, e.g., one inherited from
+	/// systemd or from the parent process in a hot restart.
+	///
+	/// The network and transport protocols and whether the socket listens
+	/// (`SO_ACCEPTCONN`) or is connected are read from the descriptor
+	/// (`SO_DOMAIN`, `SO_TYPE`, `SO_PROTOCOL`), so a listening socket keeps its
+	/// accept queue and `accept` may be called at once. The socket owns the
+	/// descriptor afterwards and closes it. Settings applied when a socket is
+	/// opened (e.g., timestamps) are applied; the backlog is left as the
+	/// descriptor's. Throws `std::runtime_error` if this socket is open or
+	/// `fd` isn't a socket, and `std::invalid_argument` if it is neither
+	/// listening nor connected or not an IPv4 or IPv6 TCP socket.
+	/// \param accepted Whether a connected descriptor was accepted (e.g.,
+	/// passed by systemd with `Accept=yes`) rather than connected by this
+	/// side, which decides its role in `negotiate_byte_order`.
+	void adopt(int fd, bool accepted = false);
 	/// Close any active connections.
 	void close();
 
+	/// A socket passed by systemd socket activation.
+	struct listen_fd {
+		int fd;
+		/// Name from `FileDescriptorName=` (`LISTEN_FDNAMES`); empty if unset.
+		std::string name;
+	};
+	/// \brief Get the sockets passed by systemd socket activation, as
+	/// `sd_listen_fds` does.
+	///
+	/// The descriptors start at 3 and are counted by `LISTEN_FDS`; they are
+	/// only meant for this process if `LISTEN_PID` is its pid. They are
+	/// marked close-on-exec.
+	/// \param unset_environment Remove `LISTEN_PID`, `LISTEN_FDS` and
+	/// `LISTEN_FDNAMES`, so that child processes don't see them.
+	/// \return No descriptors if none were passed to this process.
+	static std::vector<listen_fd> get_listen_fds(bool unset_environment = true);
+	/// \brief Adopt each socket passed by systemd socket activation.
+	///
+	/// See `get_listen_fds` and `adopt`. Connected descriptors (systemd's
+	/// `Accept=yes`) are adopted as accepted connections. Descriptors that
+	/// can't be adopted are left open and skipped.
+	static std::vector<std::unique_ptr<net_socket>> adopt_listen_fds(bool unset_environment = true);
+
 	/// \brief Accept a new connection.
 	///
 	/// A new, connected socket is returned. The original socket remains
@@ -194,6 +382,78 @@ public:
 	/// connected and ready to use.
 	std::unique_ptr<net_socket> accept();
 
+	/// \brief Accept queue state and connection drops of a listening socket.
+	struct listen_statistics {
+		uint32_t queue_length{0};        ///< Connections waiting to be accepted
+		uint32_t queue_max{0};           ///< Effective backlog
+		/// Host-wide SYNs and connections dropped since the socket started
+		/// listening because an accept queue was full (`ListenOverflows`) or
+		/// for any reason (`ListenDrops`).
+		uint64_t listen_overflows{0};
+		uint64_t listen_drops{0};
+		/// Connections accepted while accept latency monitoring was enabled,
+		/// and the total and longest time they waited in the accept queue.
+		uint64_t accepted{0};
+		std::chrono::milliseconds total_accept_latency{0};
+		std::chrono::milliseconds max_accept_latency{0};
+		/// \brief The backlog is smaller than the system limit
+		/// (`somaxconn`) while the accept queue is full or connections have
+		/// been dropped: increase the backlog with `set_backlog`.
+		bool backlog_limited{false};
+	};
+	/// \brief Report the accept queue of a passively opened TCP socket.
+	///
+	/// The queue length and capacity are read with `TCP_INFO`, and drops from
+	/// `/proc/net/netstat`.
+	listen_statistics get_listen_statistics() const;
+	bool accept_latency_monitoring_enabled() const {return _accept_latency;}
+	/// \brief Record how long each accepted connection waited in the accept
+	/// queue (`get_listen_statistics`), at the cost of a `getsockopt` per
+	/// accept.
+	void set_accept_latency_monitoring(bool enable) {_accept_latency = enable;}
+	/// \brief Get the system limit on the backlog (`net.core.somaxconn`).
+	/// \return 0 if unknown.
+	static int get_somaxconn();
+	/// \brief Get the host-wide `ListenOverflows` and `ListenDrops` counters
+	/// from `/proc/net/netstat`.
+	/// \retval False: the counters are not available.
+	static bool get_host_listen_drops(uint64_t &overflows, uint64_t &drops);
+
+	/// \brief Kernel memory of a socket (`SO_MEMINFO`), in bytes.
+	///
+	/// Summed over sockets by `get_process_memory_info`.
+	struct memory_info {
+		uint64_t sockets{0};           ///< Number of sockets summed
+		uint64_t rmem_alloc{0};        ///< Receive queue
+		uint64_t rcvbuf{0};            ///< Receive buffer limit
+		uint64_t wmem_alloc{0};        ///< Data in flight below the socket
+		uint64_t sndbuf{0};            ///< Send buffer limit
+		uint64_t fwd_alloc{0};         ///< Reserved and not yet used
+		uint64_t wmem_queued{0};       ///< Send queue
+		uint64_t optmem{0};            ///< Options and filters
+		uint64_t backlog{0};           ///< Received while the socket was busy
+		uint64_t drops{0};             ///< Packets dropped (a count)
+
+		/// Memory charged to the socket(s): queues, reserve and options.
+		uint64_t get_total() const {return rmem_alloc + wmem_queued + fwd_alloc + optmem + backlog;}
+		memory_info& operator+=(const memory_info &other);
+	};
+	/// \brief Report the kernel memory used by the open socket.
+	///
+	/// Throws `std::runtime_error` if the socket isn't open or the kernel
+	/// doesn't report it.
+	memory_info get_memory_info() const;
+	/// \brief Report the kernel memory used by the socket descriptor `sd`.
+	///
+	/// For sockets not owned by a net_socket; see `get_memory_info()`.
+	static memory_info get_memory_info(int sd);
+	/// \brief Sum the kernel memory of every socket of the process.
+	///
+	/// Each socket descriptor listed in `/proc/self/fd` is asked with
+	/// `SO_MEMINFO`, so sockets not opened with this library count too. The
+	/// sum is a snapshot: sockets opened and closed meanwhile may be missed.
+	static memory_info get_process_memory_info();
+
 	/// \brief Get the local socket address (name) information.
 	///
 	/// An exception is thrown if the socket is not connected and not passively
@@ -207,14 +467,18 @@ public:
 	/// \brief Send `max_size` bytes of data starting at memory location `data`.
 	///
 	/// A wrapper around the socket API `send` function. Throws an exception if
-	/// the net_socket is not connected or upon error.
-	ssize_t send(const void *data, size_t max_size) const;
+	/// the net_socket is not connected or upon error. `flags` are passed to
+	/// `send`; e.g., `MSG_MORE` holds the data in the kernel so that it is sent
+	/// in the same segment as the next send (a header followed by its body).
+	ssize_t send(const void *data, size_t max_size, int flags = 0) const;
 	/// \brief Sends data from the vector.
 	///
 	/// Sends data in *network* byte order after conversion. Original object
-	/// remains unchanged.
-	template<typename T>
-		ssize_t send(const std::vector<T> data, size_t max_size = 0) const;
+	/// remains unchanged. Only elements of arithmetic types are converted;
+	/// others, such as structs and the wire-order types of `big_endian`, are
+	/// sent as they are in memory.
+	template<typename T, typename Alloc>
+		ssize_t send(const std::vector<T, Alloc> data, size_t max_size = 0) const;
 	/// \brief Send the string data *and* a NULL.
 	///
 	/// The function always sends a NULL character, even if the string is
@@ -231,8 +495,8 @@ public:
 	/// determined by the _drop_rate parameter at compile time.
 	ssize_t packet_error_send(const void *data, size_t max_size) const;
 	/// \details See `send(std::vector)` and `packet_error_send(void*)`.
-	template<typename T>
-		ssize_t packet_error_send(const std::vector<T> data,
+	template<typename T, typename Alloc>
+		ssize_t packet_error_send(const std::vector<T, Alloc> data,
 			size_t max_size = 0) const;
 	/// \details See `send(std::string)` and `packet_error_send(void*)`.
 	ssize_t packet_error_send(const std::string &data, size_t max_size = 0)
@@ -240,14 +504,22 @@ public:
 
 	/// \brief Attempt to send all the requested data.
 	///
-	/// Multiple calls to `send` may take place, if required.
+	/// Multiple calls to `send` may take place, if required. `flags` are
+	/// passed to each call (see `send(void*)`).
 	/// \return The actual number of bytes sent.
-	ssize_t send_all(const void *data, size_t exact_size) const;
+	ssize_t send_all(const void *data, size_t exact_size, int flags = 0) const;
 	/// \details See `send_all(void*)` and `send(std::vector)`.
-	template<typename T>
-		ssize_t send_all(const std::vector<T> data) const;
+	template<typename T, typename Alloc>
+		ssize_t send_all(const std::vector<T, Alloc> data) const;
 	/// \details See `send_all(void*)` and `send(std::string)`.
 	ssize_t send_all(const std::string &data, size_t max_size = 0) const;
+	/// \brief Send the bytes of a buffer chain with one gather write.
+	///
+	/// The segments are sent in place by `sendmsg`, without copying them
+	/// into one buffer. Otherwise the same as `send(void*)`.
+	ssize_t send(const buffer_chain &data, int flags = 0) const;
+	/// \details See `send_all(void*)` and `send(buffer_chain)`.
+	ssize_t send_all(const buffer_chain &data, int flags = 0) const;
 
 	/// \brief Attempt to receive `max_size` bytes of data.
 	///
@@ -257,12 +529,29 @@ public:
 	/// occurs, a `timeout_exception` is thrown. Exceptions also thrown if the
 	/// net_socket is not connected or upon error.
 	ssize_t recv(void *data, size_t max_size, int flags = 0);
+	/// \brief Receive data and the time the kernel received it.
+	///
+	/// Same as `recv(void*)` but also returns the receive timestamp of the
+	/// data in `ts`, if receive timestamps are enabled (`set_timestamps`).
+	/// When several segments are read at once, the timestamp is that of the
+	/// most recent segment.
+	ssize_t recv(void *data, size_t max_size, socket_timestamp &ts, int flags = 0);
 	/// \brief Receive data into a vector.
 	///
 	/// Receives data in *network* byte order and converts elements to *host*
-	/// byte order before returning.
-	template<typename T>
-		ssize_t recv(std::vector<T> &data, size_t max_size = 0);
+	/// byte order before returning. The vector may use any allocator, e.g.,
+	/// an `arena_vector` backed by huge pages. A vector of wire-order types
+	/// (`be_u16`, `be_u32`, `be_u64`, `be_f64`) is filled without a conversion
+	/// pass; each element is converted when it is read.
+	///
+	/// Only whole elements are returned: the bytes of a partially received
+	/// trailing element are kept in the receive buffer (see `recv_view`) and
+	/// returned first by the next receive, and a read of less than one
+	/// element waits for the rest of it. Throws `std::invalid_argument` if
+	/// `max_size` is smaller than one element.
+	/// \return The number of bytes of the returned elements.
+	template<typename T, typename Alloc>
+		ssize_t recv(std::vector<T, Alloc> &data, size_t max_size = 0);
 	/// \brief Receive a string.
 	///
 	/// If `max_size` equals zero (the default), then `recv(std::string)`
@@ -271,24 +560,156 @@ public:
 	/// reached. If `max_size` is non-zero, the function will receive bytes
 	/// until it finds a NULL or until it receives the first `max_size` bytes
 	/// into the string. Any remaining characters after `max_size`, including
-	/// NULL, will remain in the OS buffer. WARNING: If recv finds neither a
-	/// NULL nor `max_size` bytes, then it will loop indefinitely.
+	/// NULL, remain in the OS buffer. If bytes are buffered (see
+	/// `recv_view`), they are received instead of reading the socket.
 	ssize_t recv(std::string &data, size_t max_size = 0);
+	/// \brief Receive up to `max_size` bytes and append them to a buffer
+	/// chain.
+	///
+	/// The bytes are received directly into the chain's blocks. If
+	/// `max_size` is zero (the default), the default receive size is used.
+	/// Otherwise the same as `recv(void*)`.
+	ssize_t recv(buffer_chain &data, size_t max_size = 0);
 
 	/// \brief Attempt to receive all the requested data.
 	///
 	/// Similar to `recv(void*)` except multiple attempts are made to receive
-	/// `exact_size` bytes of data.
+	/// `exact_size` bytes of data. Without a timeout, `MSG_WAITALL` lets the
+	/// kernel wait for all the data, so usually only one call (and one wakeup)
+	/// takes place.
 	/// \return The actual number of bytes received, which may be less than
 	/// `exact_size`.
 	ssize_t recv_all(void *data, size_t exact_size);
 	/// \details See `recv_all(void*)` and `recv(std::vector)`. If `exact_size`
 	/// equals zero (the default), then attempt to recive data.size() bytes. If
-	/// both are zero, then attempt to receive the default receive size.
-	template<typename T>
-		ssize_t recv_all(std::vector<T> &data, size_t exact_size = 0);
+	/// both are zero, then attempt to receive the default receive size. As
+	/// with `recv(std::vector)`, a partial trailing element is kept, and a
+	/// size smaller than one element is rejected.
+	template<typename T, typename Alloc>
+		ssize_t recv_all(std::vector<T, Alloc> &data, size_t exact_size = 0);
 	/// \details See `recv_all(void*)` and `recv(std::string)`.
 	ssize_t recv_all(std::string &data, size_t exact_size = 0);
+	/// \details See `recv_all(void*)` and `recv(buffer_chain)`. The bytes
+	/// received before a timeout are kept in the chain.
+	ssize_t recv_all(buffer_chain &data, size_t exact_size);
+
+	/// \brief Lazily receive the stream as chunks of up to `max_size` bytes.
+	///
+	/// Each chunk is what one `recv(std::vector)` returns; if `max_size` is
+	/// zero, the default (or adaptive) receive size is used. See `recv_range`.
+	recv_range<std::vector<char>> chunks(size_t max_size = 0);
+	/// \brief Lazily receive the stream as records of exactly `record_size`
+	/// bytes.
+	///
+	/// Uses `recv_all`; an incomplete record at the end of the stream is
+	/// dropped. See `recv_range`.
+	recv_range<std::vector<char>> records(size_t record_size);
+	/// \brief Lazily receive the stream as NULL-terminated strings.
+	///
+	/// Each string is what one `recv_all(std::string, max_size)` returns. See
+	/// `recv_range`.
+	recv_range<std::string> strings(size_t max_size = 0);
+
+	bool zerocopy_receive_enabled() const {return _zerocopy;}
+	size_t get_zerocopy_region_size() const {return _zerocopy_size;}
+	/// \brief Enable receiving with `recv_zerocopy` by mapping the kernel's
+	/// pages instead of copying.
+	///
+	/// A region of `region_size` bytes (a multiple of the page size) is mapped
+	/// onto the socket when first needed, and `TCP_ZEROCOPY_RECEIVE` maps whole
+	/// pages of received data into it. Data that doesn't fill a page, or that
+	/// the kernel can't map, is copied. Sockets returned by `accept` inherit
+	/// the setting.
+	void set_zerocopy_receive(bool enable, size_t region_size = 1 << 21);
+	/// Bytes received by `recv_zerocopy` by mapping and by copying.
+	struct zerocopy_statistics {
+		uint64_t mapped{0};
+		uint64_t copied{0};
+	};
+	const zerocopy_statistics& get_zerocopy_statistics() const {return _zc_stats;}
+	/// \brief Receive up to `max_size` bytes without copying them, if
+	/// possible.
+	///
+	/// Returns a read-only view of the received data that stays valid until
+	/// the next call to `recv_zerocopy` or until the socket is closed. If
+	/// `max_size` is zero (the default), up to the zero-copy region size is
+	/// received. If zero-copy receive is not enabled or not supported, the data
+	/// is copied into an internal buffer. Otherwise the same as `recv(void*)`:
+	/// an empty view is returned (and the socket closed) when the peer closes
+	/// the connection, and the timeout applies.
+	///
+	/// Bytes the kernel copies alongside the mapped pages (the part of the
+	/// data that doesn't fill a page) are kept in the receive buffer (see
+	/// `recv_view`), so any receive that follows, zero-copy or not, returns
+	/// them first and the stream stays in order.
+	std::span<const char> recv_zerocopy(size_t max_size = 0);
+
+	/// \brief Look at received bytes in place, without copying them.
+	///
+	/// Returns the unconsumed bytes of an internal receive buffer, reading
+	/// from the socket only while fewer than `min_bytes` are buffered. Reads
+	/// take at least the default receive size, so later views are often
+	/// served without a system call. The view is valid until the next call to
+	/// `recv_view` or `consume`; call `consume(n)` once its first `n` bytes
+	/// have been parsed. All other receive functions return buffered bytes
+	/// before reading from the socket. Meant for stream (TCP) sockets, since
+	/// datagram boundaries are not kept.
+	///
+	/// Buffered bytes are invisible to polling the descriptor
+	/// (`get_socket_descriptor`): check `get_buffered_size` before waiting for
+	/// it to become readable. Only `recv_view`, and partial elements kept by
+	/// the vector receives, leave bytes buffered. The buffer is discarded by
+	/// `close`, but kept when the peer closes the connection.
+	///
+	/// If the peer closes the connection, the view may be shorter than
+	/// `min_bytes` (and is empty at the end of the stream). If `min_bytes` is
+	/// zero, only the bytes already buffered are returned. On a timeout the
+	/// bytes received stay buffered and the `timeout_exception` reports their
+	/// number as its partial data size.
+	std::span<const std::byte> recv_view(size_t min_bytes = 1);
+	/// \brief Drop the first `size` bytes of the view returned by `recv_view`.
+	///
+	/// Throws `std::out_of_range` if fewer bytes are buffered.
+	void consume(size_t size);
+	/// \brief Number of received bytes buffered by `recv_view` and not
+	/// consumed; polling the descriptor doesn't see them.
+	size_t get_buffered_size() const;
+
+	/// \brief Agree with the peer to send vectors in the native byte order
+	/// if both ends share it.
+	///
+	/// Opt-in handshake, called by both ends right after the connection is
+	/// established. The connecting end sends an 8-byte hello stating its
+	/// byte order and waits for the reply; the accepting end waits for the
+	/// hello and replies only if it receives one. If the orders match, the
+	/// vector `send` and `recv` functions skip converting elements to and
+	/// from network byte order.
+	///
+	/// Only vectors of plain arithmetic (and enumeration) types change: the
+	/// wire-order types (`big_endian`, e.g., `be_u32`) are always big-endian.
+	/// Both ends must then use the same kind of element, since a
+	/// `vector<uint32_t>` sent in the native order reads byte-swapped as a
+	/// `vector<be_u32>`, and vice versa.
+	///
+	/// Otherwise data stays in network byte order. The accepting end stays
+	/// compatible with peers that don't negotiate: bytes that aren't a hello
+	/// are kept for the next receive, and nothing is sent. Set a timeout so
+	/// that waiting for a peer that sends nothing first ends; a timeout also
+	/// leaves network byte order in place. The connecting end may only
+	/// negotiate with peers that do, since they receive the hello.
+	/// \return Whether both ends share the byte order.
+	bool negotiate_byte_order();
+	/// Whether `negotiate_byte_order` found the peer sharing the byte order.
+	bool peer_byte_order_matches() const {return _same_byte_order;}
+
+	/// \brief Retrieve the next queued transmit timestamp.
+	///
+	/// Transmit timestamps, if enabled (`set_timestamps`), are queued by the
+	/// kernel as sent data is scheduled, handed to the network interface and
+	/// acknowledged by the peer. This call does not wait for timestamps.
+	/// \retval True: a timestamp was stored in `ts`.
+	/// \retval False: no timestamp is queued.
+	bool get_tx_timestamp(socket_timestamp &ts);
 
 private:
 	int _sock_desc{-1};
@@ -300,6 +721,31 @@ private:
 	bool _do_timeout{false};
 	struct timeval _timeout{};
 	size_t _recv_size{1400};
+	bool _adaptive_recv{false};
+	size_t _recv_estimate{1400};
+	bool _v6_only_set{false};
+	bool _v6_only{false};
+	bool _multipath{false};
+	bool _bind_source{false};
+	address _source;
+	std::shared_ptr<source_address_pool> _source_pool;
+	bool _rx_timestamps{false};
+	bool _tx_timestamps{false};
+	bool _zerocopy{false};
+	size_t _zerocopy_size{1 << 21};
+	struct zerocopy_state;
+	std::unique_ptr<zerocopy_state> _zc;
+	zerocopy_statistics _zc_stats;
+	struct recv_buffer;
+	std::unique_ptr<recv_buffer> _rbuf;
+	bool _accepted_connection{false};
+	bool _same_byte_order{false};
+	bool _accept_latency{false};
+	uint64_t _overflows_base{0};
+	uint64_t _drops_base{0};
+	uint64_t _accepted{0};
+	std::chrono::milliseconds _accept_latency_total{0};
+	std::chrono::milliseconds _accept_latency_max{0};
 	// % chance to drop a packet for packet_error_send
 	const unsigned short _drop_rate{15};
 	std::unique_ptr<std::default_random_engine> _rng;
@@ -308,8 +754,21 @@ private:
 	void move(net_socket *other);
 	int get_af() const;
 	int get_socktype() const;
-	template<typename T> void ntoh_swap(std::vector<T> &data) const;
-	template<typename T> void hton_swap(std::vector<T> &data) const;
+	int open_socket(int family, int socktype, int protocol) const;
+	void wait_readable(const char *func) const;
+	ssize_t recv_socket(void *data, size_t max_size, int flags);
+	size_t recv_buffered(void *data, size_t max_size, int flags);
+	void unread(const void *data, size_t size);
+	ssize_t recv_elements(void *data, size_t max_size, size_t element_size);
+	ssize_t recv_all_elements(void *data, size_t exact_size, size_t element_size);
+	static void count_recv(size_t received, int flags);
+	static bool read_memory_info(int sd, memory_info &info);
+	size_t auto_recv_size() const;
+	void update_recv_estimate(size_t requested, ssize_t received);
+	int bind_source(int sd, int af) const;
+	void apply_timestamps(int sd) const;
+	template<typename T, typename Alloc> void ntoh_swap(std::vector<T, Alloc> &data) const;
+	template<typename T, typename Alloc> void hton_swap(std::vector<T, Alloc> &data) const;
 };
 
 // Helper output operators
@@ -318,8 +777,8 @@ std::ostream& operator<<(std::ostream&, const address&);
 //
 // send/recv template definitions
 //
-template<typename T>
-ssize_t net_socket::send(std::vector<T> data, size_t max_size) const {
+template<typename T, typename Alloc>
+ssize_t net_socket::send(std::vector<T, Alloc> data, size_t max_size) const {
 	if( (max_size == 0) || (max_size > data.size()*sizeof(T)) ) {
 		max_size = data.size()*sizeof(T);
 	}
@@ -329,8 +788,8 @@ ssize_t net_socket::send(std::vector<T> data, size_t max_size) const {
 	return send(data.data(), max_size);
 }
 
-template<typename T>
-ssize_t net_socket::packet_error_send(std::vector<T> data,
+template<typename T, typename Alloc>
+ssize_t net_socket::packet_error_send(std::vector<T, Alloc> data,
 	size_t max_size) const {
 
 	if( (max_size == 0) || (max_size > data.size()*sizeof(T)) ) {
@@ -341,18 +800,20 @@ ssize_t net_socket::packet_error_send(std::vector<T> data,
 	return packet_error_send(data.data(), max_size);
 }
 
-template<typename T>
-ssize_t net_socket::send_all(std::vector<T> data) const {
+template<typename T, typename Alloc>
+ssize_t net_socket::send_all(std::vector<T, Alloc> data) const {
 	hton_swap(data);
 	return send_all(data.data(), data.size()*sizeof(T));
 }
 
-template<typename T>
-ssize_t net_socket::recv(std::vector<T> &data, size_t max_size) {
+template<typename T, typename Alloc>
+ssize_t net_socket::recv(std::vector<T, Alloc> &data, size_t max_size) {
+	bool adapt = false;
 	if( max_size == 0 ) {
 		if( data.empty() ) {
-			data.resize(_recv_size);
-			max_size = _recv_size;
+			max_size = std::max(auto_recv_size(), sizeof(T));
+			data.resize(max_size);
+			adapt = true;
 		}
 		else {
 			max_size = data.size()*sizeof(T);
@@ -362,7 +823,10 @@ ssize_t net_socket::recv(std::vector<T> &data, size_t max_size) {
 		data.resize(max_size);
 	}
 
-	ssize_t ss = recv(data.data(), max_size);
+	ssize_t ss = recv_elements(data.data(), max_size, sizeof(T));
+	if( adapt ) {
+		update_recv_estimate(max_size, ss);
+	}
 	if( ss >= 0 ) {
 		data.resize(ss/sizeof(T));
 	}
@@ -372,12 +836,14 @@ ssize_t net_socket::recv(std::vector<T> &data, size_t max_size) {
 	return ss;
 }
 
-template<typename T>
-ssize_t net_socket::recv_all(std::vector<T> &data, size_t exact_size) {
+template<typename T, typename Alloc>
+ssize_t net_socket::recv_all(std::vector<T, Alloc> &data, size_t exact_size) {
+	bool adapt = false;
 	if( exact_size == 0 ) {
 		if( data.empty() ) {
-			data.resize(_recv_size);
-			exact_size = _recv_size;
+			exact_size = std::max(auto_recv_size(), sizeof(T));
+			data.resize(exact_size);
+			adapt = true;
 		}
 		else {
 			exact_size = data.size()*sizeof(T);
@@ -387,7 +853,10 @@ ssize_t net_socket::recv_all(std::vector<T> &data, size_t exact_size) {
 		data.resize(exact_size);
 	}
 
-	ssize_t ss = recv_all(data.data(), exact_size);
+	ssize_t ss = recv_all_elements(data.data(), exact_size, sizeof(T));
+	if( adapt ) {
+		update_recv_estimate(exact_size, ss);
+	}
 	if( ss >= 0 ) {
 		data.resize(ss/sizeof(T));
 	}
@@ -397,40 +866,21 @@ ssize_t net_socket::recv_all(std::vector<T> &data, size_t exact_size) {
 	return ss;
 }
 
-template<typename T>
-void net_socket::hton_swap(std::vector<T> &data) const {
-	if( sizeof(T) > 1 ) {
-		for( auto itr : data ) {
-			if( sizeof(T) == 2 ) {
-				itr = htons(itr);
-			}
-			else if( sizeof(T) == 4 ) {
-				itr = htonl(itr);
-			}
-			else {
-				throw std::runtime_error("Unable to handle arrays with elements \
-					larger than 4 bytes.");
-			}
+template<typename T, typename Alloc>
+void net_socket::hton_swap(std::vector<T, Alloc> &data) const {
+	if constexpr( (sizeof(T) > 1) && (std::is_arithmetic_v<T> || std::is_enum_v<T>) ) {
+		if( _same_byte_order ) {
+			return;
+		}
+		for( auto &itr : data ) {
+			itr = network_order(itr);
 		}
 	}
 }
 
-template<typename T>
-void net_socket::ntoh_swap(std::vector<T> &data) const {
-	if( sizeof(T) > 1 ) {
-		for( auto itr : data ) {
-			if( sizeof(T) == 2 ) {
-				itr = ntohs(itr);
-			}
-			else if( sizeof(T) == 4 ) {
-				itr = ntohl(itr);
-			}
-			else {
-				throw std::runtime_error("Unable to handle arrays with elements \
-					larger than 4 bytes.");
-			}
-		}
-	}
+template<typename T, typename Alloc>
+void net_socket::ntoh_swap(std::vector<T, Alloc> &data) const {
+	hton_swap(data);
 }
 
 } // namespace network_socket
@@ -0,0 +1,186 @@
+#ifndef __PACKET_CAPTURE_H
+#define __PACKET_CAPTURE_H
+
+#include <string>
+#include <functional>
+#include <cstdint>
+#include <ctime>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
+#include "net_socket.h"
+
+struct tpacket3_hdr;
+
+namespace network_socket {
+
+/// \brief Decoded, read-only view of one captured frame.
+///
+/// The view points directly into the capture ring and is only valid inside
+/// the handler passed to `packet_capture::dispatch`. The IP header and, when
+/// present, the TCP or UDP header are located once on construction; accessors
+/// for headers that are absent (or were cut off by the snap length) return
+/// null pointers or empty addresses.
+class packet_view {
+public:
+	explicit packet_view(const struct tpacket3_hdr *hdr);
+
+	/// Start of the captured frame, including the link-layer header.
+	const unsigned char* data() const {return _frame;}
+	/// Number of captured bytes available at data().
+	size_t length() const {return _snap_len;}
+	/// Length of the frame on the wire, which may exceed length().
+	size_t original_length() const {return _wire_len;}
+	/// Time the kernel received (or sent) the frame.
+	struct timespec get_timestamp() const {return _ts;}
+	/// Index of the interface the frame was captured on.
+	int get_interface_index() const {return _ifindex;}
+	/// Link-layer protocol (ETH_P_* value) in *host* byte order.
+	uint16_t get_ethertype() const {return _ethertype;}
+	/// Test if the frame was sent by this host rather than received.
+	bool is_outgoing() const;
+
+	bool is_ipv4() const {return _ip_version == 4;}
+	bool is_ipv6() const {return _ip_version == 6;}
+	/// IP protocol (IPPROTO_* value) of the transport header, or -1 if the
+	/// frame is not IP.
+	int get_ip_protocol() const {return _ip_protocol;}
+	bool is_tcp() const {return _tcp != nullptr;}
+	bool is_udp() const {return _udp != nullptr;}
+	const unsigned char* network_header() const {return _net;}
+	const struct tcphdr* tcp() const {return _tcp;}
+	const struct udphdr* udp() const {return _udp;}
+
+	/// \brief Source IP address, and port for TCP and UDP.
+	///
+	/// Throws an exception if the frame is not IP.
+	address get_source() const;
+	/// \brief Destination IP address, and port for TCP and UDP.
+	///
+	/// Throws an exception if the frame is not IP.
+	address get_destination() const;
+
+	/// Transport-layer payload, or null if the transport header is unknown.
+	const unsigned char* payload() const {return _payload;}
+	/// Number of captured payload bytes at payload().
+	size_t payload_length() const {return _payload_len;}
+
+private:
+	const unsigned char *_frame;
+	size_t _snap_len;
+	size_t _wire_len;
+	struct timespec _ts;
+	int _ifindex;
+	uint16_t _ethertype;
+	unsigned char _pkttype;
+	int _ip_version{0};
+	int _ip_protocol{-1};
+	const unsigned char *_net{nullptr};
+	const struct tcphdr *_tcp{nullptr};
+	const struct udphdr *_udp{nullptr};
+	const unsigned char *_payload{nullptr};
+	size_t _payload_len{0};
+
+	void decode_ipv4(const unsigned char *end);
+	void decode_ipv6(const unsigned char *end);
+	void decode_transport(const unsigned char *transport, const unsigned char *end);
+	address make_address(bool source) const;
+};
+
+/// \brief Packet capture statistics kept by the kernel.
+struct capture_statistics {
+	uint64_t packets{0};          ///< Frames passed to the ring
+	uint64_t drops{0};            ///< Frames dropped because the ring was full
+	uint64_t freeze_count{0};     ///< Times the ring was full
+};
+
+/// \brief Captures frames from an interface without a system call per frame.
+///
+/// Uses an `AF_PACKET` socket with a memory-mapped `TPACKET_V3` ring. The
+/// kernel fills fixed-size blocks with frames and hands a block to user space
+/// when it is full or when the block timeout expires. `dispatch` walks every
+/// frame of the next ready block and then retires the whole block back to the
+/// kernel, so the cost of waking up is shared by all frames in the block.
+///
+/// Several packet_capture objects (typically one per thread) can share the
+/// frames of an interface with `set_fanout`. Opening a capture requires the
+/// CAP_NET_RAW capability.
+class packet_capture {
+public:
+	/// Distribution of frames among the members of a fanout group.
+	enum class fanout_mode {hash, load_balance, cpu, rollover, random, queue_mapping};
+
+	packet_capture() = default;
+	packet_capture(const packet_capture&) = delete;
+	packet_capture& operator=(const packet_capture&) = delete;
+
+	/// Destructor
+	///
+	/// The destructor unmaps the ring and closes the socket.
+	~packet_capture() noexcept;
+
+	/// \brief Start capturing on `interface`.
+	///
+	/// \param interface Interface name, or all interfaces if empty.
+	/// \param block_size Bytes per ring block; must be a multiple of the page
+	/// size.
+	/// \param block_count Number of blocks in the ring.
+	/// \param block_timeout_ms Milliseconds after which a partially filled
+	/// block is handed to user space.
+	void open(const std::string &interface = "", size_t block_size = 1 << 20,
+		unsigned int block_count = 8, unsigned int block_timeout_ms = 10);
+	/// Stop capturing and release the ring.
+	void close();
+
+	/// \brief Join fanout group `group_id` to share frames with other captures.
+	///
+	/// Must be called after `open`. All members of a group must use the same
+	/// mode.
+	void set_fanout(uint16_t group_id, fanout_mode mode = fanout_mode::hash);
+	/// \brief Control capture of frames sent by this host.
+	///
+	/// Must be called after `open`.
+	void set_ignore_outgoing(bool ignore);
+
+	// Getter and setter members
+	/// \brief Get the socket descriptor (file descriptor).
+	/// \return -1 if the capture is not open.
+	int get_socket_descriptor() const {return _sock_desc;}
+	bool is_open() const {return _sock_desc != -1;}
+	size_t get_block_size() const {return _block_size;}
+	unsigned int get_block_count() const {return _block_count;}
+	bool timeout_is_set() const {return _do_timeout;}
+	/// \brief Get the current timeout interval.
+	/// \return 0 if timeouts are disabled.
+	double get_timeout() const;
+	/// \brief Set how long dispatch waits for a block.
+	///
+	/// Setting the timeout to 0 disables timeout operation similar to
+	/// clear_timeout().
+	void set_timeout(double s);
+	/// Disable timeout operation.
+	void clear_timeout() {_do_timeout = false;}
+
+	/// \brief Process the frames of the next ready block.
+	///
+	/// Waits for a block (subject to the timeout, in which case a
+	/// `timeout_exception` is thrown), calls `handler` for each frame in the
+	/// block, and returns the block to the kernel.
+	/// \return The number of frames in the block.
+	size_t dispatch(const std::function<void(const packet_view&)> &handler);
+
+	/// \brief Retrieve and reset the kernel's capture statistics.
+	capture_statistics get_statistics();
+
+private:
+	int _sock_desc{-1};
+	unsigned char *_ring{nullptr};
+	size_t _block_size{0};
+	unsigned int _block_count{0};
+	unsigned int _current_block{0};
+	bool _do_timeout{false};
+	struct timeval _timeout{};
+};
+
+} // namespace network_socket
+
+#endif
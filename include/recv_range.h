@@ -0,0 +1,102 @@
+#ifndef __RECV_RANGE_H
+#define __RECV_RANGE_H
+
+#include <functional>
+#include <iterator>
+#include <ranges>
+#include <cstddef>
+
+namespace network_socket {
+
+class net_socket;
+
+/// \brief A lazy input range of values received from a net_socket.
+///
+/// Each value (a chunk, a record, or a string, see `net_socket::chunks`,
+/// `net_socket::records`, and `net_socket::strings`) is received when the
+/// iterator is first dereferenced or compared to the end, so only the current
+/// value is held in memory and nothing is received until it is needed. The
+/// range ends when the peer closes the connection. Exceptions from the
+/// receive, including `timeout_exception`, propagate out of these
+/// operations.
+///
+/// The range is a single-pass view that can be composed with the standard
+/// range adaptors:
+///
+/// ```
+/// for( auto &line : s.strings() | std::views::filter(is_valid) | std::views::take(10) ) {
+///     process(line);
+/// }
+/// ```
+///
+/// The socket must outlive the range and should not be used for receiving
+/// by other means while the range is being iterated.
+template<typename T>
+class recv_range : public std::ranges::view_interface<recv_range<T>> {
+public:
+	/// \brief Function that receives the next value into its second argument.
+	/// \return false at the end of the stream.
+	using fetch_function = std::function<bool(net_socket&, T&)>;
+
+	class iterator {
+	public:
+		using value_type = T;
+		using difference_type = std::ptrdiff_t;
+		using iterator_concept = std::input_iterator_tag;
+
+		iterator() = default;
+		explicit iterator(recv_range *r) : _range(r) {}
+
+		const T& operator*() const {return _range->current();}
+		const T* operator->() const {return &_range->current();}
+		iterator& operator++() {_range->next(); return *this;}
+		void operator++(int) {++*this;}
+		bool operator==(std::default_sentinel_t) const {
+			return (_range == nullptr) || _range->at_end();
+		}
+
+	private:
+		recv_range *_range{nullptr};
+	};
+
+	recv_range() = default;
+	recv_range(net_socket &s, fetch_function fetch) : _sock(&s), _fetch(std::move(fetch)) {}
+
+	/// \brief Get an iterator to the first value.
+	///
+	/// As with any input range, `begin` may only be called once.
+	iterator begin() {return iterator(this);}
+	std::default_sentinel_t end() const {return std::default_sentinel;}
+
+private:
+	net_socket *_sock{nullptr};
+	fetch_function _fetch;
+	T _value{};
+	bool _done{false};
+	// Values are received on first access rather than on increment, so that
+	// adaptors such as take don't receive a value that is never used
+	bool _pending{true};
+
+	void fetch() {
+		if( _pending && !_done ) {
+			_done = (_sock == nullptr) || !_fetch(*_sock, _value);
+		}
+		_pending = false;
+	}
+	const T& current() {
+		fetch();
+		return _value;
+	}
+	bool at_end() {
+		fetch();
+		return _done;
+	}
+	void next() {
+		fetch();
+		_pending = true;
+	}
+};
+
+} // namespace network_socket
+
+#endif
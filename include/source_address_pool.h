@@ -0,0 +1,82 @@
+#ifndef __SOURCE_ADDRESS_POOL_H
+#define __SOURCE_ADDRESS_POOL_H
+
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include "net_socket.h"
+
+namespace network_socket {
+
+/// \brief A pool of local addresses that outgoing connections are spread
+/// across.
+///
+/// The kernel identifies a connection by its local and remote addresses and
+/// ports, so one local address can only have as many connections to a given
+/// remote endpoint as there are ephemeral ports. Sockets that share a pool
+/// (`net_socket::set_source_address_pool`) take its addresses in turn, which
+/// multiplies that limit by the number of addresses.
+///
+/// The sockets bind with `IP_BIND_ADDRESS_NO_PORT`, which defers the choice
+/// of port until connect, when the kernel knows the remote endpoint and can
+/// reuse a port that is in use towards other destinations. An optional port
+/// range (`IP_LOCAL_PORT_RANGE`, Linux 6.3 and later; ignored elsewhere)
+/// narrows the ephemeral ports for the pool's connections.
+///
+/// Selecting an address is thread-safe, so one pool can be shared by the
+/// sockets of several threads. Adding addresses is not.
+class source_address_pool {
+public:
+	source_address_pool() = default;
+	/// Create a pool of `addrs`. See `add`.
+	explicit source_address_pool(const std::vector<address> &addrs);
+
+	source_address_pool(const source_address_pool&) = delete;
+	source_address_pool& operator=(const source_address_pool&) = delete;
+
+	/// \brief Add a local address to the pool.
+	///
+	/// The port of `addr` must be 0; the kernel chooses the port.
+	void add(const address &addr);
+	/// \brief Add `count` consecutive addresses starting at `first`.
+	///
+	/// E.g., `add_range(127.0.0.1, 100)` adds 127.0.0.1 through 127.0.0.100.
+	void add_range(const address &first, size_t count);
+
+	size_t size() const {return _addrs.size();}
+	bool empty() const {return _addrs.empty();}
+	/// Get address `i`, in the order added.
+	const address& get(size_t i) const;
+
+	/// Test if a local port range is set.
+	bool local_port_range_is_set() const {return _port_range != 0;}
+	/// Lowest port of the local port range, or 0 if not set.
+	uint16_t get_local_port_low() const {return _port_range & 0xffff;}
+	/// Highest port of the local port range, or 0 if not set.
+	uint16_t get_local_port_high() const {return _port_range >> 16;}
+	/// \brief Restrict the ephemeral ports of the pool's connections to
+	/// `low` through `high`.
+	///
+	/// The range must lie within `net.ipv4.ip_local_port_range` to have an
+	/// effect. Setting both to 0 clears the range.
+	void set_local_port_range(uint16_t low, uint16_t high);
+	/// Let the kernel use its whole ephemeral port range.
+	void clear_local_port_range() {_port_range = 0;}
+
+	/// \brief Select the next address of family `af` (AF_INET or AF_INET6).
+	///
+	/// Addresses are selected round-robin. Throws an exception if the pool has
+	/// no address of the family.
+	const address& next(int af);
+	/// Test if the pool has an address of family `af`.
+	bool has_family(int af) const;
+
+private:
+	std::vector<address> _addrs;
+	std::atomic<size_t> _next{0};
+	uint32_t _port_range{0};
+};
+
+} // namespace network_socket
+
+#endif
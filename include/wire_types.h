@@ -0,0 +1,80 @@
+#ifndef __WIRE_TYPES_H
+#define __WIRE_TYPES_H
+
+#include <bit>
+#include <type_traits>
+#include <cstdint>
+
+namespace network_socket {
+
+/// \brief Convert an arithmetic value between host and network (big-endian)
+/// byte order.
+///
+/// The conversion is its own inverse, so it is used in both directions.
+/// Floating-point values are converted by their bit patterns.
+template<typename T>
+constexpr T network_order(T value) {
+	static_assert(std::is_arithmetic_v<T> || std::is_enum_v<T>, "Only arithmetic values have a byte order");
+	static_assert((sizeof(T) == 1) || (sizeof(T) == 2) || (sizeof(T) == 4) || (sizeof(T) == 8),
+		"Unable to convert values larger than 8 bytes");
+
+	if constexpr( (sizeof(T) == 1) || (std::endian::native == std::endian::big) ) {
+		return value;
+	}
+	else if constexpr( sizeof(T) == 2 ) {
+		return std::bit_cast<T>(__builtin_bswap16(std::bit_cast<uint16_t>(value)));
+	}
+	else if constexpr( sizeof(T) == 4 ) {
+		return std::bit_cast<T>(__builtin_bswap32(std::bit_cast<uint32_t>(value)));
+	}
+	else {
+		return std::bit_cast<T>(__builtin_bswap64(std::bit_cast<uint64_t>(value)));
+	}
+}
+
+/// \brief A value stored in network (big-endian) byte order and converted
+/// only when it is read or assigned.
+///
+/// A `big_endian<T>` has the size and layout of the `T` on the wire, so
+/// received data can be kept as it arrived: `net_socket` sends and receives
+/// vectors of these types without a byte-swapping pass over the data, and a
+/// consumer that reads a few fields, or forwards the data unchanged, never
+/// pays for converting the rest.
+template<typename T>
+class big_endian {
+	static_assert(std::is_arithmetic_v<T> && ((sizeof(T) == 2) || (sizeof(T) == 4) || (sizeof(T) == 8)),
+		"big_endian holds 2, 4 or 8 byte arithmetic values");
+	// Floating-point values are kept as integers so that swapped bit patterns
+	// (e.g., signaling NaNs) pass through unchanged
+	using storage = std::conditional_t<sizeof(T) == 2, uint16_t,
+		std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>>;
+
+public:
+	using value_type = T;
+
+	big_endian() = default;
+	big_endian(T value) : _wire(network_order(std::bit_cast<storage>(value))) {}
+
+	/// The value in host byte order.
+	T get() const {return std::bit_cast<T>(network_order(_wire));}
+	operator T() const {return get();}
+	big_endian& operator=(T value) {
+		_wire = network_order(std::bit_cast<storage>(value));
+		return *this;
+	}
+
+	/// Compares the wire representations.
+	bool operator==(const big_endian&) const = default;
+
+private:
+	storage _wire{0};
+};
+
+using be_u16 = big_endian<uint16_t>;
+using be_u32 = big_endian<uint32_t>;
+using be_u64 = big_endian<uint64_t>;
+using be_f64 = big_endian<double>;
+
+} // namespace network_socket
+
+#endif
@@ -0,0 +1,121 @@
+#include "admission_controller.h"
+#include <stdexcept>
+#include <cstring>
+#include <ctime>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+using std::string;
+
+namespace network_socket {
+
+admission_controller::admission_controller(duration target, duration interval) :
+	_target(target), _interval(interval) {
+
+	if( (target <= duration::zero()) || (interval < target) ) {
+		throw std::invalid_argument(
+			"admission_controller::admission_controller(): Target must be positive and no longer than interval");
+	}
+}
+
+bool admission_controller::is_overloaded() const {
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _overloaded;
+}
+
+admission_statistics admission_controller::get_statistics() const {
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _stats;
+}
+
+bool admission_controller::admit(duration sojourn, clock::time_point now) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if( !_started ) {
+		_started = true;
+		_interval_end = now + _interval;
+	}
+	else if( now >= _interval_end ) {
+		// Overloaded if the queue never drained below target; if a whole
+		// interval has since passed without work, there is no queue
+		_overloaded = (_min_sojourn != duration::max()) && (_min_sojourn > _target)
+			&& (now < _interval_end + _interval);
+		if( _overloaded ) {
+			++_stats.overloaded_intervals;
+		}
+		_min_sojourn = duration::max();
+		_interval_end = now + _interval;
+	}
+
+	_min_sojourn = std::min(_min_sojourn, sojourn);
+
+	if( sojourn > (_overloaded ? _target : _interval) ) {
+		++_stats.shed;
+		return false;
+	}
+
+	++_stats.admitted;
+	return true;
+}
+
+bool admission_controller::admit(const socket_timestamp &received) {
+	if( !received.has_software() ) {
+		return admit(duration::zero());
+	}
+
+	// Receive timestamps are taken from CLOCK_REALTIME
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	duration sojourn = std::chrono::seconds(now.tv_sec - received.software.tv_sec)
+		+ std::chrono::nanoseconds(now.tv_nsec - received.software.tv_nsec);
+
+	return admit(std::max(sojourn, duration::zero()));
+}
+
+std::unique_ptr<net_socket> admission_controller::accept(net_socket &listener) {
+	while( true ) {
+		std::unique_ptr<net_socket> s = listener.accept();
+		if( admit(connection_sojourn(*s)) ) {
+			return s;
+		}
+
+		std::function<void(net_socket&)> reject;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			reject = _reject;
+		}
+		if( reject ) {
+			try {
+				reject(*s);
+			}
+			catch( std::runtime_error& ) {
+				// The connection is dropped regardless
+			}
+			// A reset would discard the reply, so it is followed by a normal close
+			shutdown(s->get_socket_descriptor(), SHUT_WR);
+		}
+		else {
+			// Reset rather than close gracefully, freeing the connection at once
+			struct linger lg = {1, 0};
+			setsockopt(s->get_socket_descriptor(), SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+		}
+		s->close();
+	}
+}
+
+void admission_controller::set_rejection_handler(std::function<void(net_socket&)> handler) {
+	std::lock_guard<std::mutex> lock(_mutex);
+	_reject = std::move(handler);
+}
+
+admission_controller::duration admission_controller::connection_sojourn(const net_socket &s) {
+	struct tcp_info info{};
+	socklen_t len = sizeof(info);
+	if( getsockopt(s.get_socket_descriptor(), IPPROTO_TCP, TCP_INFO, &info, &len) == -1 ) {
+		throw std::runtime_error(string("admission_controller::connection_sojourn(): ") + string(strerror(errno)));
+	}
+
+	return std::chrono::milliseconds(info.tcpi_last_data_recv);
+}
+
+} // namespace network_socket
@@ -0,0 +1,318 @@
+#include "buffer_arena.h"
+#include <array>
+#include <bit>
+#include <fstream>
+#include <string>
+#include <new>
+#include <unordered_set>
+#include <sys/mman.h>
+
+using std::string;
+
+namespace network_socket {
+
+namespace {
+
+std::atomic<uint64_t> next_arena_id{1};
+
+// Transparent huge pages can be advised unless they are disabled entirely
+bool transparent_huge_pages_enabled() {
+	static const bool enabled = []() {
+		std::ifstream f("/sys/kernel/mm/transparent_hugepage/enabled");
+		string mode;
+		return std::getline(f, mode) && (mode.find("[never]") == string::npos);
+	}();
+
+	return enabled;
+}
+
+// Power-of-two size class of a block
+size_t size_class(size_t size) {
+	return std::bit_width(std::max(size, buffer_arena::min_block_size) - 1);
+}
+
+// Map `size` bytes at a multiple of `align`, with `slack` extra bytes mapped
+// to find one and unmapped again
+char* map_aligned(size_t size, size_t align, size_t slack, int flags) {
+	size_t len = size + slack;
+	void *m = mmap(nullptr, len, PROT_READ | PROT_WRITE, flags, -1, 0);
+	if( m == MAP_FAILED ) {
+		return nullptr;
+	}
+
+	char *start = static_cast<char*>(m);
+	char *aligned = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(start) + align - 1)/align*align);
+	if( aligned > start ) {
+		munmap(start, aligned - start);
+	}
+	if( start + len > aligned + size ) {
+		munmap(aligned + size, (start + len) - (aligned + size));
+	}
+
+	return aligned;
+}
+
+// The sub-arena of the arena each thread used last
+struct local_cache {
+	uint64_t arena{0};
+	void *sub{nullptr};
+};
+thread_local local_cache cache;
+// Set once the thread has handed its sub-arenas back
+thread_local bool exiting = false;
+
+// Arenas not yet destroyed, which exiting threads hand their sub-arenas to
+struct arena_registry {
+	std::mutex mutex;
+	std::unordered_set<uint64_t> live;
+};
+
+arena_registry& registry() {
+	// Never destroyed, as threads may exit after static destruction
+	static arena_registry *r = new arena_registry();
+	return *r;
+}
+
+} // namespace
+
+struct buffer_arena::sub_arena {
+	char *next{nullptr};
+	size_t left{0};
+	// Free blocks of each size class, linked through their first bytes
+	std::array<void*, classes> free{};
+	// Blocks freed by other threads, taken over whole when `free` runs out
+	std::array<std::atomic<void*>, classes> remote{};
+};
+
+// The sub-arenas a thread took, handed back to their arenas when it exits
+struct buffer_arena::thread_subs {
+	struct entry {
+		uint64_t id;
+		buffer_arena *arena;
+		sub_arena *sub;
+	};
+	std::vector<entry> subs;
+
+	~thread_subs() {
+		// Blocks freed from here on take the remote path
+		cache = {};
+		exiting = true;
+		std::lock_guard<std::mutex> lock(registry().mutex);
+		for( const entry &e : subs ) {
+			if( registry().live.count(e.id) != 0 ) {
+				e.arena->orphan(e.sub);
+			}
+		}
+	}
+};
+
+buffer_arena::buffer_arena(size_t chunk_size, bool try_hugetlb) :
+	_chunk_size(std::max(huge_page_size, (chunk_size + huge_page_size - 1)/huge_page_size*huge_page_size)),
+	_try_hugetlb(try_hugetlb), _id(next_arena_id++) {
+
+	std::lock_guard<std::mutex> lock(registry().mutex);
+	registry().live.insert(_id);
+}
+
+buffer_arena::~buffer_arena() {
+	{
+		std::lock_guard<std::mutex> lock(registry().mutex);
+		registry().live.erase(_id);
+	}
+	for( const auto &r : _regions ) {
+		munmap(r.first, r.second.first);
+	}
+}
+
+buffer_arena::statistics buffer_arena::get_statistics() const {
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _stats;
+}
+
+void* buffer_arena::allocate(size_t size) {
+	if( size > _chunk_size/4 ) {
+		char *p = map_region((size + huge_page_size - 1)/huge_page_size*huge_page_size);
+		std::lock_guard<std::mutex> lock(_mutex);
+		++_stats.large_blocks;
+		return p;
+	}
+
+	sub_arena *s = local();
+	if( s != nullptr ) {
+		return carve(*s, size);
+	}
+
+	// The thread is exiting and handed its sub-arenas back; borrow one
+	s = adopt();
+	void *p;
+	try {
+		p = carve(*s, size);
+	}
+	catch( ... ) {
+		orphan(s);
+		throw;
+	}
+	orphan(s);
+
+	return p;
+}
+
+void* buffer_arena::carve(sub_arena &s, size_t size) {
+	size_t c = size_class(size);
+	if( (s.free[c] == nullptr) && (s.remote[c].load(std::memory_order_relaxed) != nullptr) ) {
+		s.free[c] = s.remote[c].exchange(nullptr, std::memory_order_acquire);
+	}
+	if( s.free[c] != nullptr ) {
+		void *p = s.free[c];
+		s.free[c] = *static_cast<void**>(p);
+		return p;
+	}
+
+	size_t block = size_t(1) << c;
+	if( s.left < block ) {
+		// The rest of the old chunk is abandoned; the first block of the new
+		// one holds its owner
+		char *chunk = map_region(_chunk_size, _chunk_size);
+		chunk_owner(chunk) = &s;
+		s.next = chunk + min_block_size;
+		s.left = _chunk_size - min_block_size;
+		std::lock_guard<std::mutex> lock(_mutex);
+		++_stats.chunks;
+	}
+
+	void *p = s.next;
+	s.next += block;
+	s.left -= block;
+
+	return p;
+}
+
+void buffer_arena::deallocate(void *p, size_t size) noexcept {
+	if( p == nullptr ) {
+		return;
+	}
+
+	if( size > _chunk_size/4 ) {
+		unmap_region(static_cast<char*>(p));
+		return;
+	}
+
+	sub_arena *owner = chunk_owner(p);
+	size_t c = size_class(size);
+	if( (cache.arena == _id) && (cache.sub == owner) ) {
+		*static_cast<void**>(p) = owner->free[c];
+		owner->free[c] = p;
+		return;
+	}
+
+	// Only the owner takes blocks off the list, all at once, so pushing is
+	// safe from any number of threads
+	void *head = owner->remote[c].load(std::memory_order_relaxed);
+	do {
+		*static_cast<void**>(p) = head;
+	} while( !owner->remote[c].compare_exchange_weak(head, p, std::memory_order_release,
+		std::memory_order_relaxed) );
+}
+
+buffer_arena& buffer_arena::global() {
+	// Never destroyed, so buffers may outlive static destruction
+	static buffer_arena *arena = new buffer_arena();
+	return *arena;
+}
+
+buffer_arena::sub_arena* buffer_arena::local() {
+	if( cache.arena == _id ) {
+		return static_cast<sub_arena*>(cache.sub);
+	}
+	if( exiting ) {
+		return nullptr;
+	}
+
+	// Each thread remembers its sub-arena of the arena it used last, and
+	// looks up the others
+	thread_local thread_subs subs;
+	sub_arena *s = nullptr;
+	for( const auto &e : subs.subs ) {
+		if( e.id == _id ) {
+			s = e.sub;
+		}
+	}
+	if( s == nullptr ) {
+		s = adopt();
+		subs.subs.push_back({_id, this, s});
+	}
+	cache = {_id, s};
+
+	return s;
+}
+
+buffer_arena::sub_arena* buffer_arena::adopt() {
+	std::lock_guard<std::mutex> lock(_mutex);
+	if( !_orphans.empty() ) {
+		sub_arena *s = _orphans.back();
+		_orphans.pop_back();
+		return s;
+	}
+
+	_subs.push_back(std::make_unique<sub_arena>());
+	return _subs.back().get();
+}
+
+void buffer_arena::orphan(sub_arena *s) {
+	std::lock_guard<std::mutex> lock(_mutex);
+	_orphans.push_back(s);
+}
+
+buffer_arena::sub_arena*& buffer_arena::chunk_owner(void *p) const {
+	uintptr_t chunk = reinterpret_cast<uintptr_t>(p)/_chunk_size*_chunk_size;
+	return *reinterpret_cast<sub_arena**>(chunk);
+}
+
+char* buffer_arena::map_region(size_t size, size_t align) {
+	const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+	page_kind kind = huge_pages;
+	char *m = nullptr;
+	if( _try_hugetlb ) {
+		// Explicit huge pages are aligned to their size already
+		m = map_aligned(size, align, align - huge_page_size, flags | MAP_HUGETLB);
+	}
+
+	if( m == nullptr ) {
+		// Align to a huge page (at least) so the kernel can back the region
+		// with them
+		m = map_aligned(size, align, align, flags);
+		if( m == nullptr ) {
+			throw std::bad_alloc();
+		}
+
+		kind = (transparent_huge_pages_enabled() && (madvise(m, size, MADV_HUGEPAGE) == 0))
+			? transparent_huge_pages : normal_pages;
+	}
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	_regions[m] = {size, kind};
+	mapped_bytes(kind) += size;
+
+	return m;
+}
+
+void buffer_arena::unmap_region(char *p) {
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto itr = _regions.find(p);
+	if( itr != _regions.end() ) {
+		munmap(itr->first, itr->second.first);
+		mapped_bytes(itr->second.second) -= itr->second.first;
+		--_stats.large_blocks;
+		_regions.erase(itr);
+	}
+}
+
+uint64_t& buffer_arena::mapped_bytes(page_kind kind) {
+	switch( kind ) {
+		case huge_pages: return _stats.huge_pages;
+		case transparent_huge_pages: return _stats.transparent_huge_pages;
+		default: return _stats.normal_pages;
+	}
+}
+
+} // namespace network_socket
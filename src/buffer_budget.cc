@@ -0,0 +1,187 @@
+#include "buffer_budget.h"
+#include <stdexcept>
+#include <algorithm>
+#include <vector>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+namespace network_socket {
+
+buffer_budget::buffer_budget(uint64_t budget, duration idle_after, int idle_buffer_size) :
+	_budget(budget), _idle_after(idle_after), _idle_buffer_size(idle_buffer_size) {
+
+	if( (idle_after < duration::zero()) || (idle_buffer_size <= 0) ) {
+		throw std::invalid_argument(
+			"buffer_budget::buffer_budget(): Idle time must not be negative and buffer size must be positive");
+	}
+}
+
+buffer_budget::~buffer_budget() {
+	for( auto &s : _sockets ) {
+		identity id;
+		if( s.second.shrunk && identify(s.first, id) && (id == s.second.id) ) {
+			restore(s.first, s.second);
+		}
+	}
+}
+
+void buffer_budget::add(net_socket &s) {
+	identity id;
+	if( !s.is_connected() || !identify(s.get_socket_descriptor(), id) ) {
+		throw std::invalid_argument("buffer_budget::add(): Socket must be connected");
+	}
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto itr = _sockets.try_emplace(s.get_socket_descriptor(), entry{id}).first;
+	if( !(itr->second.id == id) ) {
+		// The descriptor was closed and reused since it was added
+		itr->second = entry{id};
+	}
+	_stats.sockets = _sockets.size();
+}
+
+void buffer_budget::remove(net_socket &s) {
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto itr = _sockets.find(s.get_socket_descriptor());
+	if( itr == _sockets.end() ) {
+		return;
+	}
+
+	identity id;
+	if( itr->second.shrunk && identify(itr->first, id) && (id == itr->second.id) ) {
+		++(restore(itr->first, itr->second) ? _stats.restores : _stats.failed_restores);
+	}
+	_sockets.erase(itr);
+	_stats.sockets = _sockets.size();
+}
+
+buffer_budget_statistics buffer_budget::check() {
+	struct candidate {
+		duration idle;
+		int fd;
+		entry *e;
+		uint64_t limits;
+	};
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	std::vector<candidate> idle;
+	uint64_t limits = 0;
+	uint64_t memory = 0;
+	for( auto itr = _sockets.begin(); itr != _sockets.end(); ) {
+		const int fd = itr->first;
+		entry &e = itr->second;
+		net_socket::memory_info m;
+		struct tcp_info info{};
+		socklen_t len = sizeof(info);
+		// Closed sockets (or descriptors reused since) are dropped
+		identity id;
+		if( !identify(fd, id) || !(id == e.id) ) {
+			itr = _sockets.erase(itr);
+			continue;
+		}
+		try {
+			m = net_socket::get_memory_info(fd);
+		}
+		catch( std::runtime_error& ) {
+			itr = _sockets.erase(itr);
+			continue;
+		}
+		if( getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) == -1 ) {
+			itr = _sockets.erase(itr);
+			continue;
+		}
+
+		duration since(std::min(info.tcpi_last_data_recv, info.tcpi_last_data_sent));
+		bool active = (since < _idle_after) || (m.rmem_alloc > 0) || (m.wmem_queued > 0);
+		if( active && e.shrunk ) {
+			++(restore(fd, e) ? _stats.restores : _stats.failed_restores);
+			int sndbuf = 0, rcvbuf = 0;
+			get_buffers(fd, sndbuf, rcvbuf);
+			limits += sndbuf + rcvbuf;
+		}
+		else {
+			limits += m.sndbuf + m.rcvbuf;
+		}
+		if( !active && !e.shrunk ) {
+			idle.push_back({since, fd, &e, m.sndbuf + m.rcvbuf});
+		}
+		memory += m.get_total();
+		++itr;
+	}
+
+	// Shrink the longest idle first until the limits fit the budget
+	std::sort(idle.begin(), idle.end(), [](const candidate &a, const candidate &b) {return a.idle > b.idle;});
+	for( const candidate &c : idle ) {
+		if( limits <= _budget ) {
+			break;
+		}
+
+		int sndbuf = 0, rcvbuf = 0;
+		if( !get_buffers(c.fd, sndbuf, rcvbuf) || !set_buffers(c.fd, _idle_buffer_size, _idle_buffer_size) ) {
+			continue;
+		}
+		c.e->shrunk = true;
+		c.e->sndbuf = sndbuf;
+		c.e->rcvbuf = rcvbuf;
+		++_stats.shrinks;
+
+		int new_sndbuf = 0, new_rcvbuf = 0;
+		get_buffers(c.fd, new_sndbuf, new_rcvbuf);
+		limits -= c.limits - std::min<uint64_t>(c.limits, new_sndbuf + new_rcvbuf);
+	}
+
+	_stats.sockets = _sockets.size();
+	_stats.shrunk = std::count_if(_sockets.begin(), _sockets.end(), [](const auto &s) {return s.second.shrunk;});
+	_stats.buffer_limits = limits;
+	_stats.memory = memory;
+
+	return _stats;
+}
+
+buffer_budget_statistics buffer_budget::get_statistics() const {
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _stats;
+}
+
+bool buffer_budget::identify(int fd, identity &id) {
+	struct stat st;
+	if( (fstat(fd, &st) == -1) || !S_ISSOCK(st.st_mode) ) {
+		return false;
+	}
+
+	id.dev = st.st_dev;
+	id.ino = st.st_ino;
+	return true;
+}
+
+bool buffer_budget::restore(int fd, entry &e) {
+	// The kernel doubles the size it is given, and caps it at the system
+	// maximum unless forced
+	bool set = set_buffers(fd, e.sndbuf/2, e.rcvbuf/2);
+	e.shrunk = false;
+
+	int sndbuf = 0, rcvbuf = 0;
+	return set && get_buffers(fd, sndbuf, rcvbuf) && (sndbuf >= e.sndbuf/2*2) && (rcvbuf >= e.rcvbuf/2*2);
+}
+
+bool buffer_budget::get_buffers(int fd, int &sndbuf, int &rcvbuf) {
+	socklen_t len = sizeof(int);
+	return (getsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, &len) == 0)
+		&& (getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &len) == 0);
+}
+
+bool buffer_budget::set_buffers(int fd, int sndbuf, int rcvbuf) {
+	// The forced options exceed the system maximums, but need CAP_NET_ADMIN
+	bool ret = true;
+	if( setsockopt(fd, SOL_SOCKET, SO_SNDBUFFORCE, &sndbuf, sizeof(sndbuf)) == -1 ) {
+		ret = (setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf)) == 0);
+	}
+	if( setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) == -1 ) {
+		ret = (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) == 0) && ret;
+	}
+
+	return ret;
+}
+
+} // namespace network_socket
@@ -0,0 +1,210 @@
+#include "buffer_chain.h"
+#include "buffer_arena.h"
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+
+namespace network_socket {
+
+std::span<const char> buffer_chain::get_segment(size_t i) const {
+	if( i >= _segments.size() ) {
+		throw std::out_of_range("buffer_chain::get_segment(): Index out of range");
+	}
+
+	const segment &s = _segments[i];
+	return std::span<const char>(s.block.get() + s.offset, s.length);
+}
+
+void buffer_chain::append(const void *data, size_t size) {
+	auto d = static_cast<const char*>(data);
+	while( size > 0 ) {
+		std::span<char> room = prepare(std::min(size, default_block_size));
+		size_t n = std::min(size, room.size());
+		memcpy(room.data(), d, n);
+		commit(n);
+		d += n;
+		size -= n;
+	}
+}
+
+void buffer_chain::append(const buffer_chain &other) {
+	// Copy the segments first in case other is this chain
+	std::deque<segment> added = other._segments;
+	size_t size = other._size;
+	_segments.insert(_segments.end(), added.begin(), added.end());
+	_size += size;
+}
+
+void buffer_chain::prepend(const void *data, size_t size) {
+	if( size == 0 ) {
+		return;
+	}
+
+	segment s = allocate(size);
+	memcpy(s.block.get(), data, size);
+	s.length = size;
+	_segments.push_front(std::move(s));
+	_size += size;
+}
+
+void buffer_chain::prepend(const buffer_chain &other) {
+	std::deque<segment> added = other._segments;
+	size_t size = other._size;
+	_segments.insert(_segments.begin(), added.begin(), added.end());
+	_size += size;
+}
+
+buffer_chain buffer_chain::slice(size_t offset, size_t length) const {
+	if( (offset > _size) || (length > _size - offset) ) {
+		throw std::out_of_range("buffer_chain::slice(): Range exceeds chain");
+	}
+
+	buffer_chain ret;
+	for( const auto &s : _segments ) {
+		if( length == 0 ) {
+			break;
+		}
+		if( offset >= s.length ) {
+			offset -= s.length;
+			continue;
+		}
+
+		segment part = s;
+		part.offset += offset;
+		part.length = std::min(s.length - offset, length);
+		offset = 0;
+		length -= part.length;
+		ret._size += part.length;
+		ret._segments.push_back(std::move(part));
+	}
+
+	return ret;
+}
+
+buffer_chain buffer_chain::split(size_t size) {
+	buffer_chain ret = slice(0, size);
+	trim_front(size);
+	return ret;
+}
+
+void buffer_chain::trim_front(size_t size) {
+	if( size > _size ) {
+		throw std::out_of_range("buffer_chain::trim_front(): Size exceeds chain");
+	}
+
+	_size -= size;
+	while( size > 0 ) {
+		segment &s = _segments.front();
+		if( size < s.length ) {
+			s.offset += size;
+			s.length -= size;
+			break;
+		}
+		size -= s.length;
+		_segments.pop_front();
+	}
+}
+
+void buffer_chain::trim_back(size_t size) {
+	if( size > _size ) {
+		throw std::out_of_range("buffer_chain::trim_back(): Size exceeds chain");
+	}
+
+	_size -= size;
+	while( size > 0 ) {
+		segment &s = _segments.back();
+		if( size < s.length ) {
+			s.length -= size;
+			break;
+		}
+		size -= s.length;
+		_segments.pop_back();
+	}
+}
+
+void buffer_chain::clear() {
+	_segments.clear();
+	_size = 0;
+}
+
+void buffer_chain::copy_to(void *dest, size_t offset, size_t length) const {
+	if( (offset > _size) || (length > _size - offset) ) {
+		throw std::out_of_range("buffer_chain::copy_to(): Range exceeds chain");
+	}
+
+	auto d = static_cast<char*>(dest);
+	for( const auto &s : _segments ) {
+		if( length == 0 ) {
+			break;
+		}
+		if( offset >= s.length ) {
+			offset -= s.length;
+			continue;
+		}
+
+		size_t n = std::min(s.length - offset, length);
+		memcpy(d, s.block.get() + s.offset + offset, n);
+		d += n;
+		length -= n;
+		offset = 0;
+	}
+}
+
+std::vector<struct iovec> buffer_chain::get_iovecs() const {
+	std::vector<struct iovec> ret;
+	ret.reserve(_segments.size());
+	for( const auto &s : _segments ) {
+		ret.push_back({s.block.get() + s.offset, s.length});
+	}
+
+	return ret;
+}
+
+std::span<char> buffer_chain::prepare(size_t min_size) {
+	// Room after the last segment may only be written while no other chain
+	// shares its block
+	if( !_segments.empty() ) {
+		segment &s = _segments.back();
+		size_t end = s.offset + s.length;
+		if( (s.block.use_count() == 1) && (s.capacity - end >= std::max<size_t>(min_size, 1)) ) {
+			return std::span<char>(s.block.get() + end, s.capacity - end);
+		}
+	}
+
+	_segments.push_back(allocate(std::max(min_size, default_block_size)));
+	segment &s = _segments.back();
+	return std::span<char>(s.block.get(), s.capacity);
+}
+
+void buffer_chain::commit(size_t size) {
+	if( _segments.empty() ) {
+		if( size == 0 ) {
+			return;
+		}
+		throw std::logic_error("buffer_chain::commit(): No room prepared");
+	}
+
+	segment &s = _segments.back();
+	if( size > s.capacity - (s.offset + s.length) ) {
+		throw std::out_of_range("buffer_chain::commit(): Size exceeds prepared room");
+	}
+	s.length += size;
+	_size += size;
+
+	// Drop a block prepared but left unused
+	if( s.length == 0 ) {
+		_segments.pop_back();
+	}
+}
+
+buffer_chain::segment buffer_chain::allocate(size_t capacity) {
+	// The data and the reference count are allocated apart so that the data
+	// fills a power-of-two arena block
+	char *data = static_cast<char*>(buffer_arena::global().allocate(capacity));
+	std::shared_ptr<char[]> block(data,
+		[capacity](char *d) {buffer_arena::global().deallocate(d, capacity);}, arena_allocator<char>());
+
+	return {std::move(block), capacity, 0, 0};
+}
+
+} // namespace network_socket
@@ -0,0 +1,444 @@
+#include "bulk_transfer.h"
+#include <stdexcept>
+#include <thread>
+#include <exception>
+#include <algorithm>
+#include <map>
+#include <cmath>
+#include <cstring>
+#include <cerrno>
+#include <endian.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/stat.h>
+
+using std::string;
+
+namespace network_socket {
+
+namespace {
+
+const uint32_t bulk_magic = 0x4e534254;  // "NSBT"
+const size_t hello_size = 20;
+const size_t frame_size = 12;
+
+struct hello {
+	uint32_t index;
+	uint32_t count;
+	uint64_t total;
+};
+
+void put_u32(char *p, uint32_t v) {
+	v = htobe32(v);
+	memcpy(p, &v, sizeof(v));
+}
+
+void put_u64(char *p, uint64_t v) {
+	v = htobe64(v);
+	memcpy(p, &v, sizeof(v));
+}
+
+uint32_t get_u32(const char *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return be32toh(v);
+}
+
+uint64_t get_u64(const char *p) {
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return be64toh(v);
+}
+
+void send_frame(net_socket &s, uint64_t offset, uint32_t len) {
+	char frame[frame_size];
+	put_u64(frame, offset);
+	put_u32(frame+8, len);
+	s.send_all(frame, sizeof(frame));
+}
+
+hello recv_hello(net_socket &s) {
+	char buf[hello_size];
+	if( s.recv_all(buf, sizeof(buf)) != sizeof(buf) ) {
+		throw std::runtime_error("bulk_receiver::receive(): Connection closed before header");
+	}
+	if( get_u32(buf) != bulk_magic ) {
+		throw std::runtime_error("bulk_receiver::receive(): Invalid connection header");
+	}
+
+	hello h{get_u32(buf+4), get_u32(buf+8), get_u64(buf+12)};
+	if( (h.count == 0) || (h.index >= h.count) ) {
+		throw std::runtime_error("bulk_receiver::receive(): Invalid connection header");
+	}
+
+	return h;
+}
+
+// Accept the next connection, waiting at most `timeout` seconds (if non-zero)
+std::unique_ptr<net_socket> accept_within(net_socket &listener, double timeout) {
+	if( timeout > 0.0 ) {
+		struct pollfd p = {listener.get_socket_descriptor(), POLLIN, 0};
+		int ret = poll(&p, 1, static_cast<int>(std::ceil(timeout*1000)));
+		if( ret == -1 ) {
+			throw std::runtime_error("bulk_receiver::receive(): " + string(strerror(errno)));
+		}
+		if( ret == 0 ) {
+			throw timeout_exception();
+		}
+	}
+
+	return listener.accept();
+}
+
+// Run `func(i)` on `count` threads and rethrow the first exception, if any
+void run_parallel(size_t count, const std::function<void(size_t)> &func) {
+	std::vector<std::exception_ptr> errors(count);
+	std::vector<std::thread> threads;
+	threads.reserve(count);
+	for( size_t i = 0; i < count; ++i ) {
+		threads.emplace_back([&func, &errors, i]() {
+			try {
+				func(i);
+			}
+			catch( ... ) {
+				errors[i] = std::current_exception();
+			}
+		});
+	}
+
+	for( auto &t : threads ) {
+		t.join();
+	}
+	for( auto &e : errors ) {
+		if( e ) {
+			std::rethrow_exception(e);
+		}
+	}
+}
+
+// Byte ranges received so far, merged where they touch
+class range_set {
+public:
+	// Add [offset, offset + len), returning false if it overlaps a range
+	bool insert(uint64_t offset, uint64_t len) {
+		uint64_t end = offset + len;
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto next = _ranges.lower_bound(offset);
+		if( (next != _ranges.end()) && (next->first < end) ) {
+			return false;
+		}
+		if( next != _ranges.begin() ) {
+			auto prev = std::prev(next);
+			if( prev->second > offset ) {
+				return false;
+			}
+			if( prev->second == offset ) {
+				offset = prev->first;
+				_ranges.erase(prev);
+			}
+		}
+		if( (next != _ranges.end()) && (next->first == end) ) {
+			end = next->second;
+			_ranges.erase(next);
+		}
+		_ranges[offset] = end;
+		return true;
+	}
+
+	// Whether the ranges are exactly [0, total)
+	bool covers(uint64_t total) const {
+		std::lock_guard<std::mutex> lock(_mutex);
+		if( total == 0 ) {
+			return _ranges.empty();
+		}
+		return (_ranges.size() == 1) && (_ranges.begin()->first == 0) && (_ranges.begin()->second == total);
+	}
+
+private:
+	mutable std::mutex _mutex;
+	std::map<uint64_t, uint64_t> _ranges;  // Start to end
+};
+
+} // namespace
+
+bulk_sender::bulk_sender(unsigned int connections, size_t chunk_size) :
+	_conn_count(connections), _chunk_size(chunk_size) {
+
+	if( connections == 0 ) {
+		throw std::invalid_argument("bulk_sender::bulk_sender(): Connection count must be non-zero");
+	}
+	if( (chunk_size == 0) || (chunk_size > UINT32_MAX) ) {
+		throw std::invalid_argument("bulk_sender::bulk_sender(): Invalid chunk size");
+	}
+}
+
+void bulk_sender::set_source_addresses(const std::vector<address> &addrs) {
+	if( is_connected() ) {
+		throw std::runtime_error(
+			"bulk_sender::set_source_addresses(): Source addresses must be set before connecting");
+	}
+
+	_sources = addrs;
+}
+
+void bulk_sender::connect(const string &host, unsigned short port) {
+	if( is_connected() ) {
+		throw std::runtime_error("bulk_sender::connect(): Already connected");
+	}
+
+	try {
+		for( unsigned int i = 0; i < _conn_count; ++i ) {
+			auto s = std::make_unique<net_socket>();
+			if( !_sources.empty() ) {
+				s->set_source_address(_sources[i % _sources.size()]);
+			}
+			s->connect(host, port);
+			_sockets.push_back(std::move(s));
+		}
+	}
+	catch( ... ) {
+		close();
+		throw;
+	}
+}
+
+void bulk_sender::close() {
+	_sockets.clear();
+}
+
+uint64_t bulk_sender::send(const void *data, uint64_t size) {
+	auto d = static_cast<const char*>(data);
+	return transfer(size, [d](uint64_t offset, size_t len, arena_vector<char>&, net_socket &s) {
+		s.send_all(d + offset, len);
+	});
+}
+
+uint64_t bulk_sender::send_file(const string &path) {
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if( fd == -1 ) {
+		throw std::runtime_error("bulk_sender::send_file(): " + string(strerror(errno)));
+	}
+
+	struct stat st;
+	if( fstat(fd, &st) == -1 ) {
+		int err = errno;
+		::close(fd);
+		throw std::runtime_error("bulk_sender::send_file(): " + string(strerror(err)));
+	}
+
+	uint64_t ret;
+	try {
+		ret = transfer(st.st_size, [fd](uint64_t offset, size_t len, arena_vector<char> &buf, net_socket &s) {
+			buf.resize(len);
+			size_t got = 0;
+			while( got < len ) {
+				ssize_t r = pread(fd, buf.data() + got, len - got, offset + got);
+				if( r == -1 ) {
+					if( errno == EINTR ) {
+						continue;
+					}
+					throw std::runtime_error("bulk_sender::send_file(): " + string(strerror(errno)));
+				}
+				if( r == 0 ) {
+					throw std::runtime_error("bulk_sender::send_file(): File truncated during transfer");
+				}
+				got += r;
+			}
+			s.send_all(buf.data(), len);
+		});
+	}
+	catch( ... ) {
+		::close(fd);
+		throw;
+	}
+
+	::close(fd);
+	return ret;
+}
+
+uint64_t bulk_sender::transfer(uint64_t size,
+	const std::function<void(uint64_t, size_t, arena_vector<char>&, net_socket&)> &send_chunk) {
+
+	if( !is_connected() ) {
+		throw std::runtime_error("bulk_sender::send(): Unable to send on unconnected sender");
+	}
+
+	_transferred = 0;
+	std::atomic<uint64_t> next{0};
+	try {
+		run_parallel(_sockets.size(), [&](size_t i) {
+			net_socket &s = *_sockets[i];
+			char hdr[hello_size];
+			put_u32(hdr, bulk_magic);
+			put_u32(hdr+4, i);
+			put_u32(hdr+8, _sockets.size());
+			put_u64(hdr+12, size);
+			s.send_all(hdr, sizeof(hdr));
+
+			arena_vector<char> buf;
+			uint64_t offset;
+			while( (offset = next.fetch_add(_chunk_size)) < size ) {
+				size_t len = std::min<uint64_t>(_chunk_size, size - offset);
+				send_frame(s, offset, len);
+				send_chunk(offset, len, buf, s);
+
+				uint64_t done = (_transferred += len);
+				if( _progress ) {
+					std::lock_guard<std::mutex> lock(_progress_mutex);
+					_progress(done, size);
+				}
+			}
+			send_frame(s, 0, 0);
+		});
+	}
+	catch( ... ) {
+		close();
+		throw;
+	}
+
+	close();
+	return _transferred;
+}
+
+void bulk_receiver::listen(const string &host, unsigned short port) {
+	_listener.listen(host, port);
+}
+
+void bulk_receiver::set_timeout(double s) {
+	if( s < 0.0 ) {
+		throw std::invalid_argument("bulk_receiver::set_timeout(): Negative timeout value");
+	}
+
+	_timeout = s;
+}
+
+void bulk_receiver::set_max_connections(unsigned int count) {
+	if( count == 0 ) {
+		throw std::invalid_argument("bulk_receiver::set_max_connections(): Connection count must be non-zero");
+	}
+
+	_max_conns = count;
+}
+
+uint64_t bulk_receiver::receive(std::vector<char> &data) {
+	return transfer([&data](uint64_t total) {data.resize(total);},
+		[&data](uint64_t offset, size_t len, arena_vector<char>&, net_socket &s) {
+			if( s.recv_all(data.data() + offset, len) != static_cast<ssize_t>(len) ) {
+				throw std::runtime_error("bulk_receiver::receive(): Connection closed during chunk");
+			}
+		});
+}
+
+uint64_t bulk_receiver::receive_file(const string &path) {
+	int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if( fd == -1 ) {
+		throw std::runtime_error("bulk_receiver::receive_file(): " + string(strerror(errno)));
+	}
+
+	uint64_t ret;
+	try {
+		ret = transfer([fd](uint64_t total) {
+				if( ftruncate(fd, total) == -1 ) {
+					throw std::runtime_error("bulk_receiver::receive_file(): " + string(strerror(errno)));
+				}
+			},
+			[fd](uint64_t offset, size_t len, arena_vector<char> &buf, net_socket &s) {
+				buf.resize(len);
+				if( s.recv_all(buf.data(), len) != static_cast<ssize_t>(len) ) {
+					throw std::runtime_error("bulk_receiver::receive_file(): Connection closed during chunk");
+				}
+				size_t put = 0;
+				while( put < len ) {
+					ssize_t r = pwrite(fd, buf.data() + put, len - put, offset + put);
+					if( r == -1 ) {
+						if( errno == EINTR ) {
+							continue;
+						}
+						throw std::runtime_error("bulk_receiver::receive_file(): " + string(strerror(errno)));
+					}
+					put += r;
+				}
+			});
+	}
+	catch( ... ) {
+		::close(fd);
+		throw;
+	}
+
+	::close(fd);
+	return ret;
+}
+
+uint64_t bulk_receiver::transfer(const std::function<void(uint64_t)> &prepare,
+	const std::function<void(uint64_t, size_t, arena_vector<char>&, net_socket&)> &recv_chunk) {
+
+	if( !_listener.is_passively_opened() ) {
+		throw std::runtime_error("bulk_receiver::receive(): Receiver is not listening");
+	}
+
+	// The first connection tells us how many more to expect
+	std::vector<std::unique_ptr<net_socket>> conns;
+	conns.push_back(accept_within(_listener, _timeout));
+	conns[0]->set_timeout(_timeout);
+	hello first = recv_hello(*conns[0]);
+	if( first.count > _max_conns ) {
+		throw std::runtime_error("bulk_receiver::receive(): Too many connections");
+	}
+	if( first.total > _max_size ) {
+		throw std::runtime_error("bulk_receiver::receive(): Transfer too large");
+	}
+	std::vector<bool> seen(first.count);
+	seen[first.index] = true;
+	while( conns.size() < first.count ) {
+		conns.push_back(accept_within(_listener, _timeout));
+		conns.back()->set_timeout(_timeout);
+		hello h = recv_hello(*conns.back());
+		if( (h.count != first.count) || (h.total != first.total) || seen[h.index] ) {
+			throw std::runtime_error("bulk_receiver::receive(): Connection header does not match transfer");
+		}
+		seen[h.index] = true;
+	}
+
+	const uint64_t total = first.total;
+	prepare(total);
+	_transferred = 0;
+	range_set received;
+	run_parallel(conns.size(), [&](size_t i) {
+		net_socket &s = *conns[i];
+		arena_vector<char> buf;
+		char frame[frame_size];
+		while( true ) {
+			if( s.recv_all(frame, sizeof(frame)) != sizeof(frame) ) {
+				throw std::runtime_error("bulk_receiver::receive(): Connection closed before end of transfer");
+			}
+			uint64_t offset = get_u64(frame);
+			uint32_t len = get_u32(frame+8);
+			if( len == 0 ) {
+				break;
+			}
+			if( (offset > total) || (len > total - offset) ) {
+				throw std::runtime_error("bulk_receiver::receive(): Chunk outside of transfer");
+			}
+			// Claimed before receiving, so no two threads write the same bytes
+			if( !received.insert(offset, len) ) {
+				throw std::runtime_error("bulk_receiver::receive(): Overlapping chunk");
+			}
+			recv_chunk(offset, len, buf, s);
+
+			uint64_t done = (_transferred += len);
+			if( _progress ) {
+				std::lock_guard<std::mutex> lock(_progress_mutex);
+				_progress(done, total);
+			}
+		}
+	});
+
+	if( !received.covers(total) ) {
+		throw std::runtime_error("bulk_receiver::receive(): Transfer incomplete");
+	}
+
+	return total;
+}
+
+} // namespace network_socket
@@ -0,0 +1,256 @@
+#include "feed_handler.h"
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <poll.h>
+#include <endian.h>
+
+using std::string;
+
+namespace network_socket {
+
+feed_handler::feed_handler(size_t window, size_t max_message_size,
+	sequence_extractor extract, delivery_handler deliver) :
+	_window(window), _max_size(max_message_size),
+	_extract(std::move(extract)), _deliver(std::move(deliver)) {
+
+	if( (_window == 0) || (_max_size == 0) ) {
+		throw std::invalid_argument(
+			"feed_handler::feed_handler(): Window and maximum message size must be non-zero");
+	}
+	if( !_extract || !_deliver ) {
+		throw std::invalid_argument(
+			"feed_handler::feed_handler(): Sequence extractor and delivery handler are required");
+	}
+
+	_storage.resize(_window*_max_size);
+	_lengths.resize(_window);
+	_seqs.resize(_window);
+	_present.resize(_window);
+}
+
+feed_handler::sequence_extractor feed_handler::big_endian_u64(size_t offset) {
+	return [offset](const char *data, size_t size, uint64_t &seq) {
+		if( size < offset + sizeof(seq) ) {
+			return false;
+		}
+
+		uint64_t tmp;
+		memcpy(&tmp, data + offset, sizeof(tmp));
+		seq = be64toh(tmp);
+		return true;
+	};
+}
+
+void feed_handler::set_expected_sequence(uint64_t seq) {
+	if( !_synced ) {
+		sync(seq);
+		return;
+	}
+
+	if( seq < _expected ) {
+		throw std::invalid_argument(
+			string("feed_handler::set_expected_sequence(): Sequence number (")
+			+ std::to_string(seq) + string(") is before the expected sequence number (")
+			+ std::to_string(_expected) + string(")"));
+	}
+
+	advance_to(seq);
+	_highest_next = std::max(_highest_next, _expected);
+	drain();
+}
+
+void feed_handler::on_message(line l, const char *data, size_t size) {
+	uint64_t seq;
+	if( !_extract(data, size, seq) ) {
+		++_stats.malformed;
+		return;
+	}
+
+	if( !_synced ) {
+		sync(seq);
+	}
+
+	if( (seq < _expected) || held(seq) ) {
+		++_stats.duplicates;
+		return;
+	}
+
+	bool newest = (seq >= _highest_next);
+	if( newest ) {
+		_stats.gaps += seq - _highest_next;
+		_highest_next = seq + 1;
+	}
+
+	// Make room in the window, giving up on messages that are too old
+	if( seq - _expected >= _window ) {
+		advance_to(seq - _window + 1);
+		drain();
+	}
+
+	if( (seq != _expected) && (size > _max_size) ) {
+		++_stats.malformed;
+		if( newest ) {
+			++_stats.gaps; // Now missing as well
+		}
+		return;
+	}
+
+	count_arrival(l);
+	if( !newest ) {
+		++_stats.recovered;
+	}
+
+	if( seq == _expected ) {
+		deliver(seq, data, size);
+		++_expected;
+		drain();
+	}
+	else {
+		size_t i = slot(seq);
+		memcpy(&_storage[i*_max_size], data, size);
+		_lengths[i] = size;
+		_seqs[i] = seq;
+		_present[i] = 1;
+	}
+}
+
+void feed_handler::on_batch(line l, const datagram_batch &batch) {
+	for( size_t i = 0; i < batch.size(); ++i ) {
+		if( batch.truncated(i) ) {
+			++_stats.malformed;
+		}
+		else {
+			on_message(l, batch.data(i), batch.length(i));
+		}
+	}
+}
+
+size_t feed_handler::poll(multicast_socket &a, multicast_socket &b, datagram_batch &batch,
+	double timeout) {
+
+	if( timeout < 0.0 ) {
+		throw std::invalid_argument(
+			string("feed_handler::poll(): Negative timeout value (")
+				+ std::to_string(timeout) + string(") provided"));
+	}
+
+	struct pollfd fds[2] = {
+		{a.get_socket_descriptor(), POLLIN, 0},
+		{b.get_socket_descriptor(), POLLIN, 0}
+	};
+	int ms = (timeout == 0) ? -1 : static_cast<int>(std::ceil(timeout*1000));
+	int ret = ::poll(fds, 2, ms);
+	if( ret < 0 ) {
+		throw std::runtime_error(string("feed_handler::poll(): ") + string(strerror(errno)));
+	}
+
+	if( ret == 0 ) {
+		throw timeout_exception();
+	}
+
+	size_t processed = 0;
+	if( fds[0].revents & POLLIN ) {
+		processed += a.recv_batch(batch);
+		on_batch(line::A, batch);
+	}
+	if( fds[1].revents & POLLIN ) {
+		processed += b.recv_batch(batch);
+		on_batch(line::B, batch);
+	}
+
+	return processed;
+}
+
+uint64_t feed_handler::request_retransmission(net_socket &recovery) {
+	uint64_t requested = 0;
+	uint64_t seq = std::max(_expected, _requested_next);
+	while( seq < _highest_next ) {
+		if( held(seq) ) {
+			++seq;
+			continue;
+		}
+
+		uint64_t first = seq;
+		while( (seq < _highest_next) && !held(seq) ) {
+			++seq;
+		}
+
+		uint64_t req[2] = {htobe64(first), htobe64(seq - first)};
+		recovery.send_all(req, sizeof(req));
+		requested += seq - first;
+	}
+	_requested_next = std::max(_requested_next, _highest_next);
+
+	return requested;
+}
+
+void feed_handler::skip_gap() {
+	while( (_expected < _highest_next) && !held(_expected) ) {
+		++_stats.lost;
+		++_expected;
+	}
+
+	drain();
+}
+
+// Private members
+bool feed_handler::held(uint64_t seq) const {
+	size_t i = slot(seq);
+	return _present[i] && (_seqs[i] == seq);
+}
+
+void feed_handler::sync(uint64_t seq) {
+	_synced = true;
+	_expected = seq;
+	_highest_next = seq;
+	_requested_next = seq;
+}
+
+void feed_handler::deliver(uint64_t seq, const char *data, size_t size) {
+	++_stats.delivered;
+	_deliver(seq, data, size);
+}
+
+void feed_handler::drain() {
+	while( held(_expected) ) {
+		size_t i = slot(_expected);
+		_present[i] = 0;
+		deliver(_expected, &_storage[i*_max_size], _lengths[i]);
+		++_expected;
+	}
+}
+
+void feed_handler::advance_to(uint64_t seq) {
+	// Only sequence numbers within one window of _expected can be held
+	uint64_t end = std::min(seq, _expected + _window);
+	for( ; _expected < end; ++_expected ) {
+		if( held(_expected) ) {
+			size_t i = slot(_expected);
+			_present[i] = 0;
+			deliver(_expected, &_storage[i*_max_size], _lengths[i]);
+		}
+		else if( _expected < _highest_next ) {
+			++_stats.lost;
+		}
+	}
+
+	if( _expected < seq ) {
+		if( _highest_next > _expected ) {
+			_stats.lost += std::min(seq, _highest_next) - _expected;
+		}
+		_expected = seq;
+	}
+	_requested_next = std::max(_requested_next, _expected);
+}
+
+void feed_handler::count_arrival(line l) {
+	switch(l) {
+		case line::A: ++_stats.first_on_a; break;
+		case line::B: ++_stats.first_on_b; break;
+		case line::recovery: ++_stats.first_on_recovery; break;
+	}
+}
+
+} // namespace network_socket
@@ -0,0 +1,161 @@
+#include "listener_set.h"
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+#include <netdb.h>
+#include <poll.h>
+
+using std::string;
+
+namespace network_socket {
+
+size_t listener_set::add(const string &host, unsigned short port) {
+	struct addrinfo hints{};
+	struct addrinfo *result;
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+
+	int s = getaddrinfo(host.empty() ? nullptr : host.c_str(), std::to_string(port).c_str(),
+		&hints, &result);
+	if( s != 0 ) {
+		throw std::runtime_error(string("listener_set::add(): ") + string(gai_strerror(s)));
+	}
+
+	std::vector<address> addrs;
+	for( struct addrinfo *rp = result; rp != nullptr; rp = rp->ai_next ) {
+		struct sockaddr_storage ss{};
+		memcpy(&ss, rp->ai_addr, rp->ai_addrlen);
+		address a(ss);
+		if( std::find(addrs.begin(), addrs.end(), a) == addrs.end() ) {
+			addrs.push_back(a);
+		}
+	}
+	freeaddrinfo(result);
+
+	// Some families may be unavailable (e.g., IPv6 disabled); only fail if
+	// nothing could be bound
+	size_t added = 0;
+	string error;
+	for( const auto &a : addrs ) {
+		try {
+			listen(a);
+			++added;
+		}
+		catch( std::runtime_error &e ) {
+			error = e.what();
+		}
+	}
+
+	if( added == 0 ) {
+		throw std::runtime_error("listener_set::add(): Unable to listen on " + host + ":"
+			+ std::to_string(port) + " (" + error + ")");
+	}
+
+	return added;
+}
+
+void listener_set::add(const address &addr) {
+	listen(addr);
+}
+
+address listener_set::get_local_address(size_t i) const {
+	if( i >= _listeners.size() ) {
+		throw std::out_of_range("listener_set::get_local_address(): Index out of range");
+	}
+
+	return _listeners[i].get_local_address();
+}
+
+std::vector<address> listener_set::get_local_addresses() const {
+	std::vector<address> ret;
+	for( const auto &l : _listeners ) {
+		ret.push_back(l.get_local_address());
+	}
+
+	return ret;
+}
+
+void listener_set::set_backlog(int backlog) {
+	if( backlog < 0 ) {
+		throw std::invalid_argument("listener_set::set_backlog(): Negative backlog ("
+			+ std::to_string(backlog) + ") provided");
+	}
+
+	_backlog = backlog;
+}
+
+double listener_set::get_timeout() const {
+	double ret = 0.0;
+	if( _do_timeout ) {
+		ret =  _timeout.tv_sec + static_cast<double>(_timeout.tv_usec)/1e6;
+	}
+
+	return ret;
+}
+
+void listener_set::set_timeout(double s) {
+	if( s < 0.0 ) {
+		throw std::invalid_argument(
+			std::string("listener_set::set_timeout(): Negative timeout value (")
+				+ std::to_string(s) + std::string(") provided"));
+	}
+
+	if( s == 0 ) {
+		_do_timeout = false;
+		_timeout.tv_sec = 0;
+		_timeout.tv_usec = 0;
+	}
+	else {
+		_do_timeout = true;
+		_timeout.tv_sec = static_cast<long>(s);
+		_timeout.tv_usec = static_cast<long>((s-_timeout.tv_sec)*1e6);
+	}
+}
+
+std::unique_ptr<net_socket> listener_set::accept(size_t *index) {
+	if( _listeners.empty() ) {
+		throw std::runtime_error("listener_set::accept(): No listeners");
+	}
+
+	std::vector<struct pollfd> pfds(_listeners.size());
+	for( size_t i = 0; i < _listeners.size(); ++i ) {
+		pfds[i] = {_listeners[i].get_socket_descriptor(), POLLIN, 0};
+	}
+
+	int ms = _do_timeout ? (_timeout.tv_sec*1000 + (_timeout.tv_usec+999)/1000) : -1;
+	int ret = poll(pfds.data(), pfds.size(), ms);
+	if( ret < 0 ) {
+		throw std::runtime_error(string("listener_set::accept(): ") + string(strerror(errno)));
+	}
+
+	if( ret == 0 ) {
+		throw timeout_exception();
+	}
+
+	// Start after the listener served last so every ready listener gets a turn
+	size_t i = _next % pfds.size();
+	while( pfds[i].revents == 0 ) {
+		i = (i + 1) % pfds.size();
+	}
+	_next = i + 1;
+
+	if( index != nullptr ) {
+		*index = i;
+	}
+
+	return _listeners[i].accept();
+}
+
+void listener_set::listen(const address &addr) {
+	net_socket s(addr.is_ipv4() ? net_socket::network_protocol::IPv4 : net_socket::network_protocol::IPv6);
+	s.set_backlog(_backlog);
+	s.set_multipath(_multipath);
+	if( addr.is_ipv6() ) {
+		s.set_v6_only(_v6_only);
+	}
+	s.listen(addr);
+	_listeners.push_back(std::move(s));
+}
+
+} // namespace network_socket
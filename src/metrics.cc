@@ -0,0 +1,201 @@
+#include "metrics.h"
+#include <stdexcept>
+#include <sstream>
+#include <bit>
+#include <algorithm>
+#include <chrono>
+#include <sys/socket.h>
+
+using std::string;
+
+namespace network_socket {
+
+size_t metrics_counter::cell_index() {
+	static std::atomic<size_t> next{0};
+	thread_local size_t index = next.fetch_add(1, std::memory_order_relaxed) % metrics_cells;
+	return index;
+}
+
+uint64_t metrics_counter::get() const {
+	uint64_t ret = 0;
+	for( const auto &c : _cells ) {
+		ret += c.value.load(std::memory_order_relaxed);
+	}
+
+	return ret;
+}
+
+void metrics_histogram::observe(uint64_t value) {
+	// Smallest i with value <= 2^i
+	size_t i = (value <= 1) ? 0 : std::bit_width(value - 1);
+	cell &c = _cells[metrics_counter::cell_index()];
+	c.counts[std::min(i, buckets - 1)].fetch_add(1, std::memory_order_relaxed);
+	c.sum.fetch_add(value, std::memory_order_relaxed);
+}
+
+metrics_histogram::snapshot metrics_histogram::get() const {
+	snapshot ret;
+	for( const auto &c : _cells ) {
+		for( size_t i = 0; i < buckets; ++i ) {
+			ret.counts[i] += c.counts[i].load(std::memory_order_relaxed);
+		}
+		ret.sum += c.sum.load(std::memory_order_relaxed);
+	}
+
+	// The count is derived from the buckets so the two always agree
+	for( auto n : ret.counts ) {
+		ret.count += n;
+	}
+
+	return ret;
+}
+
+namespace {
+
+void format_counter(std::ostringstream &out, const char *name, const char *help, uint64_t value) {
+	out << "# HELP " << name << ' ' << help << "\n# TYPE " << name << " counter\n"
+		<< name << ' ' << value << '\n';
+}
+
+// Observed values are divided by `divisor` to convert them to the exposed unit
+void format_histogram(std::ostringstream &out, const char *name, const char *help,
+	const metrics_histogram &h, double divisor) {
+
+	metrics_histogram::snapshot s = h.get();
+	out << "# HELP " << name << ' ' << help << "\n# TYPE " << name << " histogram\n";
+	uint64_t cumulative = 0;
+	for( size_t i = 0; i + 1 < metrics_histogram::buckets; ++i ) {
+		cumulative += s.counts[i];
+		out << name << "_bucket{le=\"" << metrics_histogram::upper_bound(i)/divisor << "\"} " << cumulative << '\n';
+	}
+	out << name << "_bucket{le=\"+Inf\"} " << s.count << '\n'
+		<< name << "_sum " << s.sum/divisor << '\n'
+		<< name << "_count " << s.count << '\n';
+}
+
+} // namespace
+
+string library_metrics::prometheus_text() const {
+	// Enough digits for every bucket bound, without binary rounding noise
+	std::ostringstream out;
+	out.precision(15);
+	format_counter(out, "netsock_connections_opened_total", "Connections opened with connect.",
+		connections_opened.get());
+	format_counter(out, "netsock_connections_accepted_total", "Connections accepted from listening sockets.",
+		connections_accepted.get());
+	format_counter(out, "netsock_connections_closed_total", "Connected sockets closed.",
+		connections_closed.get());
+	format_counter(out, "netsock_sent_bytes_total", "Bytes sent.", bytes_sent.get());
+	format_counter(out, "netsock_received_bytes_total", "Bytes received.", bytes_received.get());
+	format_counter(out, "netsock_send_syscalls_total", "Send system calls.", send_calls.get());
+	format_counter(out, "netsock_recv_syscalls_total", "Receive system calls.", recv_calls.get());
+	format_counter(out, "netsock_timeouts_total", "Receives that timed out.", timeouts.get());
+	format_histogram(out, "netsock_recv_bytes", "Bytes returned by receive system calls.", recv_bytes, 1);
+	format_histogram(out, "netsock_accept_queue_wait_seconds",
+		"Time accepted connections waited in the accept queue.", accept_queue_wait, 1000);
+
+	uint64_t overflows, drops;
+	if( net_socket::get_host_listen_drops(overflows, drops) ) {
+		format_counter(out, "netsock_host_listen_overflows_total",
+			"Connections dropped by the host because an accept queue was full.", overflows);
+		format_counter(out, "netsock_host_listen_drops_total",
+			"Connections dropped by the host while listening.", drops);
+	}
+
+	return out.str();
+}
+
+library_metrics& get_library_metrics() {
+	static library_metrics metrics;
+	return metrics;
+}
+
+metrics_server::~metrics_server() {
+	stop();
+}
+
+void metrics_server::start(unsigned short port, const string &host) {
+	if( is_running() ) {
+		throw std::runtime_error("metrics_server::start(): Server already running");
+	}
+
+	_listener.listen(host, port);
+	_stop = false;
+	_thread = std::thread(&metrics_server::serve, this);
+}
+
+void metrics_server::stop() {
+	if( !is_running() ) {
+		return;
+	}
+
+	// Shutting the listener down wakes the blocked accept
+	_stop = true;
+	::shutdown(_listener.get_socket_descriptor(), SHUT_RDWR);
+	_thread.join();
+	_listener.close();
+}
+
+void metrics_server::serve() {
+	std::chrono::milliseconds backoff(0);
+	while( !_stop ) {
+		std::unique_ptr<net_socket> c;
+		try {
+			c = _listener.accept();
+			backoff = std::chrono::milliseconds(0);
+		}
+		catch( std::runtime_error& ) {
+			if( _stop || !_listener.is_passively_opened() ) {
+				break;
+			}
+			// Out of descriptors (EMFILE, ENFILE) or similar; retrying at once
+			// would only spin
+			backoff = std::clamp(backoff*2, std::chrono::milliseconds(10), std::chrono::milliseconds(100));
+			std::this_thread::sleep_for(backoff);
+			continue;
+		}
+
+		try {
+			c->set_timeout(1.0);
+
+			// Read the request head; only the request line matters
+			string request;
+			char buf[1024];
+			while( (request.find("\r\n\r\n") == string::npos) && (request.size() < 8192) ) {
+				ssize_t n = c->recv(buf, sizeof(buf));
+				if( n == 0 ) {
+					break;
+				}
+				request.append(buf, n);
+			}
+			if( !c->is_connected() ) {
+				continue;
+			}
+
+			string status = "200 OK";
+			string body;
+			if( request.compare(0, 4, "GET ") != 0 ) {
+				status = "405 Method Not Allowed";
+			}
+			else {
+				string path = request.substr(4, request.find(' ', 4) - 4);
+				if( (path != "/metrics") && (path != "/") ) {
+					status = "404 Not Found";
+				}
+				else {
+					body = get_library_metrics().prometheus_text();
+				}
+			}
+
+			string response = "HTTP/1.0 " + status
+				+ "\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+				+ std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+			c->send_all(response.data(), response.size(), MSG_NOSIGNAL);
+		}
+		catch( std::runtime_error& ) {
+			// A slow or failed client only loses its own response
+		}
+	}
+}
+
+} // namespace network_socket
@@ -0,0 +1,457 @@
+#include "multicast_socket.h"
+#include <stdexcept>
+#include <netdb.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <ifaddrs.h>
+#include <arpa/inet.h>
+#include <sys/select.h>
+#include <cstring>
+#include <algorithm>
+
+using std::string;
+
+namespace network_socket {
+
+datagram_batch::datagram_batch(size_t count, size_t datagram_size) :
+	_dgram_size(datagram_size) {
+
+	if( (count == 0) || (datagram_size == 0) ) {
+		throw std::invalid_argument(
+			"datagram_batch::datagram_batch(): Count and datagram size must be non-zero");
+	}
+
+	_buffer.resize(count*datagram_size);
+	_iovs.resize(count);
+	_sources.resize(count);
+	_msgs.resize(count);
+	reset();
+}
+
+const char* datagram_batch::data(size_t i) const {
+	check_index(i);
+	return _buffer.data() + i*_dgram_size;
+}
+
+size_t datagram_batch::length(size_t i) const {
+	check_index(i);
+	return std::min<size_t>(_msgs[i].msg_len, _dgram_size);
+}
+
+bool datagram_batch::truncated(size_t i) const {
+	check_index(i);
+	return (_msgs[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+}
+
+address datagram_batch::source(size_t i) const {
+	check_index(i);
+	return address(_sources[i]);
+}
+
+void datagram_batch::reset() {
+	_received = 0;
+	for( size_t i = 0; i < _msgs.size(); ++i ) {
+		_iovs[i].iov_base = _buffer.data() + i*_dgram_size;
+		_iovs[i].iov_len = _dgram_size;
+		memset(&_msgs[i], 0, sizeof(_msgs[i]));
+		_msgs[i].msg_hdr.msg_name = &_sources[i];
+		_msgs[i].msg_hdr.msg_namelen = sizeof(_sources[i]);
+		_msgs[i].msg_hdr.msg_iov = &_iovs[i];
+		_msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+}
+
+void datagram_batch::check_index(size_t i) const {
+	if( i >= _received ) {
+		throw std::out_of_range(
+			string("datagram_batch: Index (") + std::to_string(i)
+			+ string(") beyond received datagrams (") + std::to_string(_received) + string(")"));
+	}
+}
+
+multicast_socket::multicast_socket(const net_socket::network_protocol net) :
+	_net_proto(net) {
+
+	if( (_net_proto != net_socket::network_protocol::IPv4)
+		&& (_net_proto != net_socket::network_protocol::IPv6) ) {
+
+		throw std::invalid_argument(
+			"multicast_socket::multicast_socket(): Network protocol must be IPv4 or IPv6");
+	}
+}
+
+multicast_socket::~multicast_socket() noexcept {
+	close();
+}
+
+double multicast_socket::get_timeout() const {
+	double ret = 0.0;
+	if( _do_timeout ) {
+		ret =  _timeout.tv_sec + static_cast<double>(_timeout.tv_usec)/1e6;
+	}
+
+	return ret;
+}
+
+void multicast_socket::set_timeout(double s) {
+	if( s < 0.0 ) {
+		throw std::invalid_argument(
+			std::string("multicast_socket::set_timeout(): Negative timeout value (")
+				+ std::to_string(s) + std::string(") provided"));
+	}
+
+	if( s == 0 ) {
+		_do_timeout = false;
+		_timeout.tv_sec = 0;
+		_timeout.tv_usec = 0;
+	}
+	else {
+		_do_timeout = true;
+		_timeout.tv_sec = static_cast<long>(s);
+		_timeout.tv_usec = static_cast<long>((s-_timeout.tv_sec)*1e6);
+	}
+}
+
+int multicast_socket::get_ttl() const {
+	if( _sock_desc == -1 ) {
+		return 1;
+	}
+
+	int hops = 0;
+	socklen_t len = sizeof(hops);
+	int opt = (get_af() == AF_INET) ? IP_MULTICAST_TTL : IPV6_MULTICAST_HOPS;
+	if( getsockopt(_sock_desc, get_level(), opt, &hops, &len) == -1 ) {
+		throw std::runtime_error(string("multicast_socket::get_ttl(): ") + string(strerror(errno)));
+	}
+
+	return hops;
+}
+
+void multicast_socket::set_ttl(int hops) {
+	if( (hops < 0) || (hops > 255) ) {
+		throw std::invalid_argument(
+			string("multicast_socket::set_ttl(): TTL (") + std::to_string(hops)
+			+ string(") must be in the range [0, 255]"));
+	}
+
+	open();
+	int opt = (get_af() == AF_INET) ? IP_MULTICAST_TTL : IPV6_MULTICAST_HOPS;
+	if( setsockopt(_sock_desc, get_level(), opt, &hops, sizeof(hops)) == -1 ) {
+		throw std::runtime_error(string("multicast_socket::set_ttl(): ") + string(strerror(errno)));
+	}
+}
+
+bool multicast_socket::get_loopback() const {
+	if( _sock_desc == -1 ) {
+		return true;
+	}
+
+	int loop = 0;
+	socklen_t len = sizeof(loop);
+	int opt = (get_af() == AF_INET) ? IP_MULTICAST_LOOP : IPV6_MULTICAST_LOOP;
+	if( getsockopt(_sock_desc, get_level(), opt, &loop, &len) == -1 ) {
+		throw std::runtime_error(string("multicast_socket::get_loopback(): ") + string(strerror(errno)));
+	}
+
+	return loop != 0;
+}
+
+void multicast_socket::set_loopback(bool enable) {
+	open();
+	int loop = enable ? 1 : 0;
+	int opt = (get_af() == AF_INET) ? IP_MULTICAST_LOOP : IPV6_MULTICAST_LOOP;
+	if( setsockopt(_sock_desc, get_level(), opt, &loop, sizeof(loop)) == -1 ) {
+		throw std::runtime_error(string("multicast_socket::set_loopback(): ") + string(strerror(errno)));
+	}
+}
+
+void multicast_socket::set_interface(const std::string &interface) {
+	open();
+	unsigned int index = interface_index(interface, "multicast_socket::set_interface(): ");
+	int ret;
+	if( get_af() == AF_INET ) {
+		// Also use the address, when given, as the source address
+		struct ip_mreqn req{};
+		req.imr_ifindex = index;
+		inet_pton(AF_INET, interface.c_str(), &req.imr_address);
+		ret = setsockopt(_sock_desc, IPPROTO_IP, IP_MULTICAST_IF, &req, sizeof(req));
+	}
+	else {
+		int idx = index;
+		ret = setsockopt(_sock_desc, IPPROTO_IPV6, IPV6_MULTICAST_IF, &idx, sizeof(idx));
+	}
+
+	if( ret == -1 ) {
+		throw std::runtime_error(string("multicast_socket::set_interface(): ") + string(strerror(errno)));
+	}
+}
+
+void multicast_socket::bind(const std::string &group, unsigned short port) {
+	if( _bound ) {
+		throw std::runtime_error("multicast_socket::bind(): Socket is already bound");
+	}
+
+	struct sockaddr_storage sa;
+	if( group.empty() ) {
+		memset(&sa, 0, sizeof(sa));
+		sa.ss_family = get_af();
+		address a(sa);
+		a.set_port(port);
+		sa = a.get_sockaddr();
+	}
+	else {
+		sa = group_address(group, port, "multicast_socket::bind(): ");
+	}
+
+	open();
+	int on = 1;
+	if( setsockopt(_sock_desc, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) == -1 ) {
+		throw std::runtime_error(string("multicast_socket::bind(): ") + string(strerror(errno)));
+	}
+
+	// Only deliver datagrams for groups joined by this socket, not for
+	// groups joined by any socket on the host
+	int off = 0;
+	int opt = (get_af() == AF_INET) ? IP_MULTICAST_ALL : IPV6_MULTICAST_ALL;
+	if( setsockopt(_sock_desc, get_level(), opt, &off, sizeof(off)) == -1 ) {
+		throw std::runtime_error(string("multicast_socket::bind(): ") + string(strerror(errno)));
+	}
+
+	socklen_t len = (get_af() == AF_INET) ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6);
+	if( ::bind(_sock_desc, reinterpret_cast<struct sockaddr*>(&sa), len) == -1 ) {
+		throw std::runtime_error(string("multicast_socket::bind(): ") + string(strerror(errno)));
+	}
+
+	_bound = true;
+}
+
+void multicast_socket::bind(unsigned short port) {
+	bind("", port);
+}
+
+void multicast_socket::join(const std::string &group, const std::string &interface) {
+	membership(MCAST_JOIN_GROUP, group, "", interface, "multicast_socket::join(): ");
+}
+
+void multicast_socket::join(const std::string &group, const std::string &source,
+	const std::string &interface) {
+
+	membership(MCAST_JOIN_SOURCE_GROUP, group, source, interface, "multicast_socket::join(): ");
+}
+
+void multicast_socket::leave(const std::string &group, const std::string &interface) {
+	membership(MCAST_LEAVE_GROUP, group, "", interface, "multicast_socket::leave(): ");
+}
+
+void multicast_socket::leave(const std::string &group, const std::string &source,
+	const std::string &interface) {
+
+	membership(MCAST_LEAVE_SOURCE_GROUP, group, source, interface, "multicast_socket::leave(): ");
+}
+
+void multicast_socket::close() {
+	if( _sock_desc != -1 ) {
+		::close(_sock_desc);
+		_sock_desc = -1;
+		_bound = false;
+	}
+}
+
+ssize_t multicast_socket::send_to(const void *data, size_t size, const address &dest) {
+	if( (dest.is_ipv4() && (get_af() != AF_INET))
+		|| (dest.is_ipv6() && (get_af() != AF_INET6)) ) {
+
+		throw std::invalid_argument(
+			"multicast_socket::send_to(): Destination family does not match socket");
+	}
+
+	open();
+	struct sockaddr_storage sa = dest.get_sockaddr();
+	socklen_t len = dest.is_ipv4() ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6);
+	ssize_t ret = ::sendto(_sock_desc, data, size, 0, reinterpret_cast<struct sockaddr*>(&sa), len);
+	if( ret == -1 ) {
+		throw std::runtime_error(string("multicast_socket::send_to(): ") + string(strerror(errno)));
+	}
+
+	return ret;
+}
+
+ssize_t multicast_socket::send_to(const std::string &data, const address &dest) {
+	return send_to(data.data(), data.length()+1, dest);
+}
+
+ssize_t multicast_socket::send_to(const void *data, size_t size, const std::string &group,
+	unsigned short port) {
+
+	return send_to(data, size, address(group_address(group, port, "multicast_socket::send_to(): ")));
+}
+
+ssize_t multicast_socket::recv_from(void *data, size_t max_size, address *source) {
+	if( !_bound ) {
+		throw std::runtime_error("multicast_socket::recv_from(): Unable to recv on unbound socket");
+	}
+
+	wait_readable("multicast_socket::recv_from(): ");
+
+	struct sockaddr_storage sa;
+	socklen_t len = sizeof(sa);
+	ssize_t ret = ::recvfrom(_sock_desc, data, max_size, 0, reinterpret_cast<struct sockaddr*>(&sa), &len);
+	if( ret == -1 ) {
+		throw std::runtime_error(string("multicast_socket::recv_from(): ") + string(strerror(errno)));
+	}
+
+	if( source != nullptr ) {
+		*source = sa;
+	}
+
+	return ret;
+}
+
+size_t multicast_socket::recv_batch(datagram_batch &batch) {
+	if( !_bound ) {
+		throw std::runtime_error("multicast_socket::recv_batch(): Unable to recv on unbound socket");
+	}
+
+	batch.reset();
+	wait_readable("multicast_socket::recv_batch(): ");
+
+	int ret = ::recvmmsg(_sock_desc, batch._msgs.data(), batch._msgs.size(), MSG_WAITFORONE, nullptr);
+	if( ret == -1 ) {
+		throw std::runtime_error(string("multicast_socket::recv_batch(): ") + string(strerror(errno)));
+	}
+
+	batch._received = ret;
+	return batch._received;
+}
+
+// Private members
+void multicast_socket::open() {
+	if( _sock_desc == -1 ) {
+		_sock_desc = socket(get_af(), SOCK_DGRAM, 0);
+		if( _sock_desc == -1 ) {
+			throw std::runtime_error(string("multicast_socket::open(): ") + string(strerror(errno)));
+		}
+	}
+}
+
+int multicast_socket::get_af() const {
+	return (_net_proto == net_socket::network_protocol::IPv4) ? AF_INET : AF_INET6;
+}
+
+int multicast_socket::get_level() const {
+	return (_net_proto == net_socket::network_protocol::IPv4) ? IPPROTO_IP : IPPROTO_IPV6;
+}
+
+void multicast_socket::wait_readable(const char *func) const {
+	if( _do_timeout ){
+		fd_set fds;
+		FD_ZERO(&fds);
+		FD_SET(_sock_desc, &fds);
+		struct timeval tmp_tv = _timeout;
+		int sret = select(_sock_desc+1, &fds, nullptr, nullptr, &tmp_tv);
+		if( sret < 0 ) {
+			throw std::runtime_error(string(func)+string(strerror(errno)));
+		}
+
+		if( sret == 0 ) {
+			throw timeout_exception();
+		}
+	}
+}
+
+struct sockaddr_storage multicast_socket::group_address(const std::string &group,
+	unsigned short port, const char *func) const {
+
+	address a;
+	try {
+		a.set_address(group);
+	}
+	catch( std::runtime_error& ) {
+		throw std::invalid_argument(string(func) + string("Invalid group address (") + group + string(")"));
+	}
+
+	if( a.is_ipv4() != (get_af() == AF_INET) ) {
+		throw std::invalid_argument(
+			string(func) + string("Address family of (") + group + string(") does not match socket"));
+	}
+
+	a.set_port(port);
+	return a.get_sockaddr();
+}
+
+unsigned int multicast_socket::interface_index(const std::string &interface,
+	const char *func) const {
+
+	if( interface.empty() ) {
+		return 0;
+	}
+
+	unsigned int index = if_nametoindex(interface.c_str());
+	if( index != 0 ) {
+		return index;
+	}
+
+	// Not an interface name, so look for an interface with the address
+	address want;
+	try {
+		want.set_address(interface);
+	}
+	catch( std::runtime_error& ) {
+		throw std::invalid_argument(string(func) + string("Unknown interface (") + interface + string(")"));
+	}
+
+	struct ifaddrs *ifa_list;
+	if( getifaddrs(&ifa_list) == -1 ) {
+		throw std::runtime_error(string(func) + string(strerror(errno)));
+	}
+	for( struct ifaddrs *ifa = ifa_list; ifa != nullptr; ifa = ifa->ifa_next ) {
+		if( (ifa->ifa_addr == nullptr)
+			|| ((ifa->ifa_addr->sa_family != AF_INET) && (ifa->ifa_addr->sa_family != AF_INET6)) ) {
+			continue;
+		}
+
+		struct sockaddr_storage sa{};
+		memcpy(&sa, ifa->ifa_addr, (ifa->ifa_addr->sa_family == AF_INET)
+			? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6));
+		if( address(sa).get_address() == want.get_address() ) {
+			index = if_nametoindex(ifa->ifa_name);
+			break;
+		}
+	}
+	freeifaddrs(ifa_list);
+
+	if( index == 0 ) {
+		throw std::invalid_argument(string(func) + string("No interface with address (") + interface + string(")"));
+	}
+
+	return index;
+}
+
+void multicast_socket::membership(int option, const std::string &group,
+	const std::string &source, const std::string &interface, const char *func) {
+
+	struct sockaddr_storage g = group_address(group, 0, func);
+	unsigned int index = interface_index(interface, func);
+
+	open();
+	int ret;
+	if( source.empty() ) {
+		struct group_req req{};
+		req.gr_interface = index;
+		req.gr_group = g;
+		ret = setsockopt(_sock_desc, get_level(), option, &req, sizeof(req));
+	}
+	else {
+		struct group_source_req req{};
+		req.gsr_interface = index;
+		req.gsr_group = g;
+		req.gsr_source = group_address(source, 0, func);
+		ret = setsockopt(_sock_desc, get_level(), option, &req, sizeof(req));
+	}
+
+	if( ret == -1 ) {
+		throw std::runtime_error(string(func) + string(strerror(errno)));
+	}
+}
+
+} // namespace network_socket
@@ -1,18 +1,92 @@
 #include "net_socket.h"
+#include "source_address_pool.h"
+#include "metrics.h"
+#include "buffer_arena.h"
+#include "buffer_chain.h"
+#include "net_socket_probes.h"
 #include <iostream>
 #include <stdexcept>
 #include <netdb.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
 #include <chrono>
 #include <algorithm>
 #include <arpa/inet.h>
 #include <cstring>
+#include <sys/ioctl.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+#include <linux/tcp.h>
+#include <linux/mptcp.h>
+#include <linux/sock_diag.h>
+#include <sys/mman.h>
+#include <fstream>
+#include <sstream>
+#include <climits>
+#include <array>
+
+#ifndef IP_LOCAL_PORT_RANGE
+#define IP_LOCAL_PORT_RANGE 51
+#endif
 
 using std::string;
 using std::unique_ptr;
 
+NETSOCK_PROBE_SEMAPHORE(connect);
+NETSOCK_PROBE_SEMAPHORE(accept);
+NETSOCK_PROBE_SEMAPHORE(close);
+NETSOCK_PROBE_SEMAPHORE(send);
+NETSOCK_PROBE_SEMAPHORE(recv);
+NETSOCK_PROBE_SEMAPHORE(timeout);
+
 namespace network_socket {
 
+// Mapping and copy buffer of zero-copy receive, released when the socket closes
+struct net_socket::zerocopy_state {
+	char *map{nullptr};
+	size_t map_size{0};
+	bool unsupported{false};
+	arena_vector<char> copybuf;
+
+	~zerocopy_state() {
+		if( map != nullptr ) {
+			munmap(map, map_size);
+		}
+	}
+};
+
+// Bytes received by recv_view and not yet consumed, between start and end
+struct net_socket::recv_buffer {
+	arena_vector<char> data;
+	size_t start{0};
+	size_t end{0};
+};
+
+namespace {
+
+std::string_view as_chars(std::span<const std::byte> s) {
+	return std::string_view(reinterpret_cast<const char*>(s.data()), s.size());
+}
+
+// Hello of negotiate_byte_order: magic, version, byte order, reserved
+constexpr size_t hello_size = 8;
+constexpr char hello_magic[] = "NSBO";
+constexpr char hello_version = 1;
+
+// Whether the bytes are the start of a hello
+bool could_be_hello(std::string_view bytes) {
+	std::string_view magic(hello_magic, sizeof(hello_magic) - 1);
+	return bytes.substr(0, magic.size()) == magic.substr(0, bytes.size());
+}
+
+std::array<char, hello_size> byte_order_hello() {
+	return {hello_magic[0], hello_magic[1], hello_magic[2], hello_magic[3], hello_version,
+		(std::endian::native == std::endian::little) ? 'L' : 'B', 0, 0};
+}
+
+} // namespace
+
 address::address() {
 	memset(&addr, 0, sizeof(addr));
 	addr.ss_family = AF_INET;
@@ -337,7 +411,14 @@ void net_socket::listen(const std::string &host, const std::string &service) {
 
 	/* Iterate through the address list and try to perform passive open */
 	for ( rp = result; rp != nullptr; rp = rp->ai_next ) {
-		if ( ( s = socket( rp->ai_family, rp->ai_socktype, rp->ai_protocol ) ) == -1 ) {
+		if ( ( s = open_socket( rp->ai_family, rp->ai_socktype, rp->ai_protocol ) ) == -1 ) {
+			continue;
+		}
+
+		int v6_only = _v6_only;
+		if ( _v6_only_set && ( rp->ai_family == AF_INET6 )
+			&& ( setsockopt( s, IPPROTO_IPV6, IPV6_V6ONLY, &v6_only, sizeof( v6_only ) ) == -1 ) ) {
+			::close( s );
 			continue;
 		}
 
@@ -359,6 +440,10 @@ void net_socket::listen(const std::string &host, const std::string &service) {
 
 	_sock_desc = s;
 	_passive = true;
+	if( _rx_timestamps || _tx_timestamps ) {
+		apply_timestamps(_sock_desc);
+	}
+	get_host_listen_drops(_overflows_base, _drops_base);
 }
 
 void net_socket::listen(const std::string &host, const unsigned short port) {
@@ -373,6 +458,10 @@ void net_socket::listen(const unsigned short port){
 	listen("", std::to_string(port));
 }
 
+void net_socket::listen(const address &addr) {
+	listen(addr.get_address(), std::to_string(addr.get_port()));
+}
+
 void net_socket::connect(const std::string &host, const std::string &service) {
 	if( _passive ) {
 		throw std::runtime_error(
@@ -396,7 +485,18 @@ void net_socket::connect(const std::string &host, const std::string &service) {
 
 	// Iterate through the address list and try to connect
 	for ( rp = result; rp != nullptr; rp = rp->ai_next ) {
-		if ( ( s = socket( rp->ai_family, rp->ai_socktype, rp->ai_protocol ) ) == -1 ) {
+		if ( ( _bind_source && ( rp->ai_family != _source.get_sockaddr().ss_family ) )
+			|| ( _source_pool && !_source_pool->has_family( rp->ai_family ) ) ) {
+			errno = EAFNOSUPPORT;
+			continue;
+		}
+
+		if ( ( s = open_socket( rp->ai_family, rp->ai_socktype, rp->ai_protocol ) ) == -1 ) {
+			continue;
+		}
+
+		if ( ( _bind_source || _source_pool ) && ( bind_source( s, rp->ai_family ) == -1 ) ) {
+			::close( s );
 			continue;
 		}
 
@@ -413,6 +513,16 @@ void net_socket::connect(const std::string &host, const std::string &service) {
 
 	_sock_desc = s;
 	_connected = true;
+	_rbuf.reset();
+	_same_byte_order = false;
+	if( _rx_timestamps || _tx_timestamps ) {
+		apply_timestamps(_sock_desc);
+	}
+	get_library_metrics().connections_opened.add();
+	if( NETSOCK_PROBE_ENABLED(connect) ) {
+		address remote = get_remote_address();
+		NETSOCK_PROBE3(connect, _sock_desc, remote.get_address().c_str(), remote.get_port());
+	}
 }
 
 void net_socket::connect(const std::string &host, const unsigned short port) {
@@ -423,21 +533,386 @@ void net_socket::connect(const address &addr) {
 	connect(addr.get_address(), std::to_string(addr.get_port()));
 }
 
+void net_socket::adopt(int fd, bool accepted) {
+	if( _sock_desc != -1 ) {
+		throw std::runtime_error("net_socket::adopt(): Adopt called on an open socket");
+	}
+
+	int domain, type, protocol, listening;
+	socklen_t len = sizeof(int);
+	if( (getsockopt(fd, SOL_SOCKET, SO_DOMAIN, &domain, &len) == -1)
+		|| (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) == -1)
+		|| (getsockopt(fd, SOL_SOCKET, SO_PROTOCOL, &protocol, &len) == -1)
+		|| (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len) == -1) ) {
+		throw std::runtime_error(string("net_socket::adopt(): ") + string(strerror(errno)));
+	}
+
+	network_protocol net_proto;
+	switch( domain ) {
+		case AF_INET: net_proto = IPv4; break;
+		case AF_INET6: net_proto = IPv6; break;
+		default:
+			throw std::invalid_argument("net_socket::adopt(): Not an IPv4 or IPv6 socket");
+	}
+	if( type != SOCK_STREAM ) {
+		throw std::invalid_argument("net_socket::adopt(): Only TCP sockets supported at this time");
+	}
+
+	struct sockaddr_storage sa{};
+	len = sizeof(sa);
+	bool connected = !listening && (getpeername(fd, reinterpret_cast<struct sockaddr*>(&sa), &len) == 0);
+	if( !listening && !connected ) {
+		throw std::invalid_argument("net_socket::adopt(): Socket is neither listening nor connected");
+	}
+
+	_sock_desc = fd;
+	_net_proto = net_proto;
+	_trans_proto = TCP;
+	_multipath = (protocol == IPPROTO_MPTCP);
+	_passive = listening;
+	_connected = connected;
+	_rbuf.reset();
+	_accepted_connection = connected && accepted;
+	_same_byte_order = false;
+	if( _rx_timestamps || _tx_timestamps ) {
+		apply_timestamps(_sock_desc);
+	}
+	if( _passive ) {
+		get_host_listen_drops(_overflows_base, _drops_base);
+	}
+}
+
+std::vector<net_socket::listen_fd> net_socket::get_listen_fds(bool unset_environment) {
+	// As in sd_listen_fds(3)
+	const int first_fd = 3;
+	std::vector<listen_fd> ret;
+	const char *pid = getenv("LISTEN_PID");
+	const char *fds = getenv("LISTEN_FDS");
+	const char *names = getenv("LISTEN_FDNAMES");
+	char *end;
+	if( (pid != nullptr) && (fds != nullptr) && (strtol(pid, &end, 10) == getpid()) && (*end == '\0') ) {
+		long n = strtol(fds, &end, 10);
+		if( (*end == '\0') && (n > 0) && (n <= INT_MAX - first_fd) ) {
+			std::istringstream name_list(names ? names : "");
+			for( int fd = first_fd; fd < first_fd + n; ++fd ) {
+				listen_fd l{fd, ""};
+				std::getline(name_list, l.name, ':');
+				fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC);
+				ret.push_back(std::move(l));
+			}
+		}
+	}
+
+	if( unset_environment ) {
+		unsetenv("LISTEN_PID");
+		unsetenv("LISTEN_FDS");
+		unsetenv("LISTEN_FDNAMES");
+	}
+
+	return ret;
+}
+
+std::vector<unique_ptr<net_socket>> net_socket::adopt_listen_fds(bool unset_environment) {
+	std::vector<unique_ptr<net_socket>> ret;
+	for( const listen_fd &l : get_listen_fds(unset_environment) ) {
+		unique_ptr<net_socket> s(new net_socket());
+		try {
+			s->adopt(l.fd, true);
+		}
+		catch( std::exception& ) {
+			continue;
+		}
+		ret.push_back(std::move(s));
+	}
+
+	return ret;
+}
+
 unique_ptr<net_socket> net_socket::accept() {
 	int new_s = ::accept(_sock_desc, nullptr, nullptr);
 	if( new_s == -1 ){
 		throw std::runtime_error(string("net_socket::accept(): ") + string(strerror(errno)));
 	}
+	get_library_metrics().connections_accepted.add();
+	if( NETSOCK_PROBE_ENABLED(accept) ) {
+		struct sockaddr_storage sa{};
+		socklen_t len = sizeof(sa);
+		getpeername(new_s, reinterpret_cast<struct sockaddr*>(&sa), &len);
+		address remote(sa);
+		NETSOCK_PROBE4(accept, _sock_desc, new_s, remote.get_address().c_str(), remote.get_port());
+	}
 
 	unique_ptr<net_socket> ret(new net_socket(_net_proto, _trans_proto));
 	ret->_sock_desc = new_s;
 	ret->_connected = true;
+	ret->_accepted_connection = true;
+	ret->_adaptive_recv = _adaptive_recv;
+	ret->_recv_estimate = _recv_estimate;
+	ret->_rx_timestamps = _rx_timestamps;
+	ret->_tx_timestamps = _tx_timestamps;
+	ret->_zerocopy = _zerocopy;
+	ret->_zerocopy_size = _zerocopy_size;
+	ret->_multipath = _multipath;
+
+	if( _accept_latency ) {
+		// A new connection has received no data since the handshake completed
+		struct tcp_info info{};
+		socklen_t len = sizeof(info);
+		if( getsockopt(new_s, IPPROTO_TCP, TCP_INFO, &info, &len) == 0 ) {
+			std::chrono::milliseconds latency(info.tcpi_last_data_recv);
+			++_accepted;
+			_accept_latency_total += latency;
+			_accept_latency_max = std::max(_accept_latency_max, latency);
+			get_library_metrics().accept_queue_wait.observe(info.tcpi_last_data_recv);
+		}
+	}
+
+	return ret;
+}
+
+net_socket::listen_statistics net_socket::get_listen_statistics() const {
+	if( !_passive || (_trans_proto != transport_protocol::TCP) ) {
+		throw std::runtime_error(
+			"net_socket::get_listen_statistics(): Socket must be a passively opened TCP socket");
+	}
+
+	// For a listening socket the kernel reports the accept queue length as
+	// unacked and the backlog as sacked
+	struct tcp_info info{};
+	socklen_t len = sizeof(info);
+	if( getsockopt(_sock_desc, IPPROTO_TCP, TCP_INFO, &info, &len) == -1 ) {
+		throw std::runtime_error(string("net_socket::get_listen_statistics(): ") + string(strerror(errno)));
+	}
+
+	listen_statistics ret;
+	ret.queue_length = info.tcpi_unacked;
+	ret.queue_max = info.tcpi_sacked;
+	uint64_t overflows, drops;
+	if( get_host_listen_drops(overflows, drops) ) {
+		ret.listen_overflows = overflows - std::min(overflows, _overflows_base);
+		ret.listen_drops = drops - std::min(drops, _drops_base);
+	}
+	ret.accepted = _accepted;
+	ret.total_accept_latency = _accept_latency_total;
+	ret.max_accept_latency = _accept_latency_max;
+
+	int somaxconn = get_somaxconn();
+	ret.backlog_limited = (somaxconn > 0) && (ret.queue_max < static_cast<uint32_t>(somaxconn))
+		&& ((ret.queue_length >= ret.queue_max) || (ret.listen_overflows > 0));
+
+	return ret;
+}
+
+bool net_socket::get_host_listen_drops(uint64_t &overflows, uint64_t &drops) {
+	std::ifstream f("/proc/net/netstat");
+	string names, values;
+	while( std::getline(f, names) && std::getline(f, values) ) {
+		if( names.compare(0, 7, "TcpExt:") != 0 ) {
+			continue;
+		}
+
+		std::istringstream n(names), v(values);
+		string name;
+		uint64_t value;
+		int found = 0;
+		n >> name;
+		v >> name;
+		while( (n >> name) && (v >> value) ) {
+			if( name == "ListenOverflows" ) {
+				overflows = value;
+				++found;
+			}
+			else if( name == "ListenDrops" ) {
+				drops = value;
+				++found;
+			}
+		}
+		return found == 2;
+	}
+
+	return false;
+}
+
+bool net_socket::is_multipath() const {
+	if( _sock_desc == -1 ) {
+		return false;
+	}
+
+	int protocol;
+	socklen_t len = sizeof(protocol);
+	if( (getsockopt(_sock_desc, SOL_SOCKET, SO_PROTOCOL, &protocol, &len) == -1)
+		|| (protocol != IPPROTO_MPTCP) ) {
+		return false;
+	}
+
+	return !get_multipath_info().fallback;
+}
+
+net_socket::multipath_info net_socket::get_multipath_info() const {
+	int protocol = 0;
+	socklen_t len = sizeof(protocol);
+	if( (_sock_desc == -1) || (getsockopt(_sock_desc, SOL_SOCKET, SO_PROTOCOL, &protocol, &len) == -1)
+		|| (protocol != IPPROTO_MPTCP) ) {
+		throw std::runtime_error("net_socket::get_multipath_info(): Not an MPTCP socket");
+	}
+
+	// A connection that fell back to TCP answers as a TCP socket
+	multipath_info ret;
+	struct mptcp_info info{};
+	len = sizeof(info);
+	if( getsockopt(_sock_desc, SOL_MPTCP, MPTCP_INFO, &info, &len) == -1 ) {
+		ret.fallback = true;
+		return ret;
+	}
+
+	ret.subflows = info.mptcpi_subflows;
+	ret.subflows_max = info.mptcpi_subflows_max;
+	ret.add_addr_signal = info.mptcpi_add_addr_signal;
+	ret.add_addr_accepted = info.mptcpi_add_addr_accepted;
+	ret.local_addr_used = info.mptcpi_local_addr_used;
+	ret.local_addr_max = info.mptcpi_local_addr_max;
+	ret.token = info.mptcpi_token;
+	ret.fallback = (info.mptcpi_flags & MPTCP_INFO_FLAG_FALLBACK) != 0;
+
+	return ret;
+}
+
+std::vector<std::pair<address, address>> net_socket::get_subflow_addresses() const {
+	if( !_connected ) {
+		throw std::runtime_error("net_socket::get_subflow_addresses(): Socket must be connected");
+	}
+
+	// The kernel reports how many subflows there are; retry if they didn't fit
+	std::vector<std::pair<address, address>> ret;
+	size_t capacity = 8;
+	while( true ) {
+		std::vector<char> buf(sizeof(struct mptcp_subflow_data) + capacity*sizeof(struct mptcp_subflow_addrs));
+		struct mptcp_subflow_data hdr{};
+		hdr.size_subflow_data = sizeof(hdr);
+		hdr.size_user = sizeof(struct mptcp_subflow_addrs);
+		memcpy(buf.data(), &hdr, sizeof(hdr));
+		socklen_t len = buf.size();
+		if( getsockopt(_sock_desc, SOL_MPTCP, MPTCP_SUBFLOW_ADDRS, buf.data(), &len) == -1 ) {
+			// Plain TCP: the connection is the only subflow
+			ret.emplace_back(get_local_address(), get_remote_address());
+			return ret;
+		}
+
+		memcpy(&hdr, buf.data(), sizeof(hdr));
+		if( hdr.num_subflows > capacity ) {
+			capacity = hdr.num_subflows;
+			continue;
+		}
+
+		for( size_t i = 0; i < hdr.num_subflows; ++i ) {
+			struct mptcp_subflow_addrs a{};
+			memcpy(&a, buf.data() + hdr.size_subflow_data + i*hdr.size_user,
+				std::min<size_t>(sizeof(a), hdr.size_user));
+			struct sockaddr_storage local{}, remote{};
+			memcpy(&local, &a.ss_local, sizeof(local));
+			memcpy(&remote, &a.ss_remote, sizeof(remote));
+			ret.emplace_back(address(local), address(remote));
+		}
+
+		return ret;
+	}
+}
+
+int net_socket::get_somaxconn() {
+	std::ifstream f("/proc/sys/net/core/somaxconn");
+	int ret = 0;
+	if( !(f >> ret) ) {
+		ret = 0;
+	}
 
 	return ret;
 }
 
+net_socket::memory_info& net_socket::memory_info::operator+=(const memory_info &other) {
+	sockets += other.sockets;
+	rmem_alloc += other.rmem_alloc;
+	rcvbuf += other.rcvbuf;
+	wmem_alloc += other.wmem_alloc;
+	sndbuf += other.sndbuf;
+	fwd_alloc += other.fwd_alloc;
+	wmem_queued += other.wmem_queued;
+	optmem += other.optmem;
+	backlog += other.backlog;
+	drops += other.drops;
+
+	return *this;
+}
+
+net_socket::memory_info net_socket::get_memory_info() const {
+	memory_info ret;
+	if( (_sock_desc == -1) || !read_memory_info(_sock_desc, ret) ) {
+		throw std::runtime_error(string("net_socket::get_memory_info(): ")
+			+ string(strerror((_sock_desc == -1) ? EBADF : errno)));
+	}
+
+	return ret;
+}
+
+net_socket::memory_info net_socket::get_memory_info(int sd) {
+	memory_info ret;
+	if( !read_memory_info(sd, ret) ) {
+		throw std::runtime_error(string("net_socket::get_memory_info(): ") + string(strerror(errno)));
+	}
+
+	return ret;
+}
+
+net_socket::memory_info net_socket::get_process_memory_info() {
+	memory_info ret;
+	DIR *d = opendir("/proc/self/fd");
+	if( d == nullptr ) {
+		throw std::runtime_error(string("net_socket::get_process_memory_info(): ") + string(strerror(errno)));
+	}
+
+	int self = dirfd(d);
+	while( struct dirent *e = readdir(d) ) {
+		char *end;
+		long fd = strtol(e->d_name, &end, 10);
+		memory_info m;
+		// Descriptors that aren't sockets fail with ENOTSOCK
+		if( (*end == '\0') && (end != e->d_name) && (fd != self) && read_memory_info(fd, m) ) {
+			ret += m;
+		}
+	}
+	closedir(d);
+
+	return ret;
+}
+
+bool net_socket::read_memory_info(int sd, memory_info &info) {
+	uint32_t mem[SK_MEMINFO_VARS] = {};
+	socklen_t len = sizeof(mem);
+	if( getsockopt(sd, SOL_SOCKET, SO_MEMINFO, mem, &len) == -1 ) {
+		return false;
+	}
+
+	info.sockets = 1;
+	info.rmem_alloc = mem[SK_MEMINFO_RMEM_ALLOC];
+	info.rcvbuf = mem[SK_MEMINFO_RCVBUF];
+	info.wmem_alloc = mem[SK_MEMINFO_WMEM_ALLOC];
+	info.sndbuf = mem[SK_MEMINFO_SNDBUF];
+	info.fwd_alloc = mem[SK_MEMINFO_FWD_ALLOC];
+	info.wmem_queued = mem[SK_MEMINFO_WMEM_QUEUED];
+	info.optmem = mem[SK_MEMINFO_OPTMEM];
+	info.backlog = mem[SK_MEMINFO_BACKLOG];
+	info.drops = mem[SK_MEMINFO_DROPS];
+
+	return true;
+}
+
 void net_socket::close() {
 	if( _sock_desc != -1 ){
+		if( _connected ) {
+			get_library_metrics().connections_closed.add();
+		}
+		NETSOCK_PROBE1(close, _sock_desc);
+		_zc.reset();
+		_rbuf.reset();
 		::close(_sock_desc);
 		_sock_desc = -1;
 		_passive = false;
@@ -471,15 +946,19 @@ address net_socket::get_remote_address() const {
 	return address(sa);
 }
 
-ssize_t net_socket::send(const void *data, size_t max_size) const {
+ssize_t net_socket::send(const void *data, size_t max_size, int flags) const {
 	if( !_connected ) {
 		throw std::runtime_error("net_socket::send(): Unable to send on unconnected socket");
 	}
 
-	ssize_t ret = ::send(_sock_desc, data, max_size, 0);
+	library_metrics &m = get_library_metrics();
+	m.send_calls.add();
+	ssize_t ret = ::send(_sock_desc, data, max_size, flags);
+	NETSOCK_PROBE3(send, _sock_desc, max_size, (ret == -1) ? -errno : ret);
 	if( ret == -1 ) {
 		throw std::runtime_error(string("net_socket::send(): ")+string(strerror(errno)));
 	}
+	m.bytes_sent.add(ret);
 
 	return ret;
 }
@@ -521,11 +1000,11 @@ ssize_t net_socket::packet_error_send(const std::string &data, size_t max_size)
 	return packet_error_send(data.data(), max_size);
 }
 
-ssize_t net_socket::send_all(const void *data, size_t exact_size) const {
+ssize_t net_socket::send_all(const void *data, size_t exact_size, int flags) const {
 	auto d = static_cast<const char*>(data);
 	size_t sent = 0;
 	while( sent < exact_size ) {
-		sent += send(d + sent, exact_size - sent);
+		sent += send(d + sent, exact_size - sent, flags);
 	}
 
 	return sent;
@@ -539,7 +1018,51 @@ ssize_t net_socket::send_all(const std::string &data, size_t max_size) const {
 	return send_all(data.data(), max_size);
 }
 
+ssize_t net_socket::send(const buffer_chain &data, int flags) const {
+	if( !_connected ) {
+		throw std::runtime_error("net_socket::send(): Unable to send on unconnected socket");
+	}
+
+	std::vector<struct iovec> iov = data.get_iovecs();
+	struct msghdr msg{};
+	msg.msg_iov = iov.data();
+	msg.msg_iovlen = std::min<size_t>(iov.size(), IOV_MAX);
+
+	library_metrics &m = get_library_metrics();
+	m.send_calls.add();
+	ssize_t ret = ::sendmsg(_sock_desc, &msg, flags);
+	NETSOCK_PROBE3(send, _sock_desc, data.size(), (ret == -1) ? -errno : ret);
+	if( ret == -1 ) {
+		throw std::runtime_error(string("net_socket::send(): ")+string(strerror(errno)));
+	}
+	m.bytes_sent.add(ret);
+
+	return ret;
+}
+
+ssize_t net_socket::send_all(const buffer_chain &data, int flags) const {
+	// Send what the last call left over; the chain shares its blocks, so
+	// nothing is copied
+	buffer_chain rest = data;
+	size_t sent = 0;
+	while( !rest.empty() ) {
+		ssize_t ret = send(rest, flags);
+		rest.trim_front(ret);
+		sent += ret;
+	}
+
+	return sent;
+}
+
 ssize_t net_socket::recv(void *data, size_t max_size, int flags) {
+	if( (max_size > 0) && (get_buffered_size() > 0) ) {
+		return recv_buffered(data, max_size, flags);
+	}
+
+	return recv_socket(data, max_size, flags);
+}
+
+ssize_t net_socket::recv_socket(void *data, size_t max_size, int flags) {
 	if( !_connected ) {
 		throw std::runtime_error("net_socket::recv(): Unable to recv on unconnected socket");
 	}
@@ -548,25 +1071,63 @@ ssize_t net_socket::recv(void *data, size_t max_size, int flags) {
 		return 0;
 	}
 
-	if( _do_timeout ){
-		fd_set fds;
-		FD_ZERO(&fds);
-		FD_SET(_sock_desc, &fds);
-		struct timeval tmp_tv = _timeout;
-		int sret = select(_sock_desc+1, &fds, nullptr, nullptr, &tmp_tv);
-		if( sret < 0 ) {
-			throw std::runtime_error(string("net_socket::recv(): ")+string(strerror(errno)));
-		}
+	wait_readable("net_socket::recv(): ");
 
-		if( sret == 0 ) {
-			throw timeout_exception();
-		}
+	ssize_t ret = ::recv(_sock_desc, data, max_size, flags);
+	NETSOCK_PROBE3(recv, _sock_desc, max_size, (ret == -1) ? -errno : ret);
+	if( ret == -1 ) {
+		throw std::runtime_error(string("net_socket::recv(): ")+string(strerror(errno)));
 	}
+	count_recv(ret, flags);
 
-	ssize_t ret = ::recv(_sock_desc, data, max_size, flags);
+	if( ret == 0 ) {
+		// Bytes buffered before the end of the stream stay readable
+		std::unique_ptr<recv_buffer> rbuf = std::move(_rbuf);
+		close();
+		_rbuf = std::move(rbuf);
+	}
+
+	return ret;
+}
+
+ssize_t net_socket::recv(void *data, size_t max_size, socket_timestamp &ts, int flags) {
+	if( !_connected ) {
+		throw std::runtime_error("net_socket::recv(): Unable to recv on unconnected socket");
+	}
+
+	ts = socket_timestamp();
+	if( max_size == 0 ){
+		return 0;
+	}
+	if( get_buffered_size() > 0 ) {
+		return recv_buffered(data, max_size, flags);
+	}
+
+	wait_readable("net_socket::recv(): ");
+
+	struct iovec iov = {data, max_size};
+	char control[CMSG_SPACE(sizeof(struct scm_timestamping))];
+	struct msghdr msg{};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	ssize_t ret = ::recvmsg(_sock_desc, &msg, flags);
+	NETSOCK_PROBE3(recv, _sock_desc, max_size, (ret == -1) ? -errno : ret);
 	if( ret == -1 ) {
 		throw std::runtime_error(string("net_socket::recv(): ")+string(strerror(errno)));
 	}
+	count_recv(ret, flags);
+
+	for( struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c != nullptr; c = CMSG_NXTHDR(&msg, c) ) {
+		if( (c->cmsg_level == SOL_SOCKET) && (c->cmsg_type == SCM_TIMESTAMPING) ) {
+			struct scm_timestamping tss;
+			memcpy(&tss, CMSG_DATA(c), sizeof(tss));
+			ts.software = tss.ts[0];
+			ts.hardware = tss.ts[2];
+		}
+	}
 
 	if( ret == 0 ) {
 		close();
@@ -576,10 +1137,27 @@ ssize_t net_socket::recv(void *data, size_t max_size, int flags) {
 }
 
 ssize_t net_socket::recv(std::string &data, size_t max_size) {
-	if( max_size == 0 ) {
-		max_size = _recv_size;
+	bool adapt = (max_size == 0);
+	if( adapt ) {
+		max_size = auto_recv_size();
+	}
+
+	// Bytes already buffered (see recv_view) are a receive of their own
+	if( get_buffered_size() > 0 ) {
+		std::string_view view = as_chars(recv_view(0)).substr(0, max_size);
+		ssize_t ret = view.size();
+		string::size_type pos = view.find('\0');
+		if( pos != string::npos ) {
+			view = view.substr(0, pos);
+			ret = pos + 1;
+		}
+		data.assign(view);
+		consume(ret);
+		return ret;
 	}
 
+	// Peek so that the bytes after the NULL stay in the kernel, where polling
+	// the descriptor sees them
 	char tmp[max_size];
 	ssize_t ret = recv(tmp, max_size, MSG_PEEK);
 	data.assign(tmp, tmp + ret);
@@ -588,7 +1166,35 @@ ssize_t net_socket::recv(std::string &data, size_t max_size) {
 		data.resize(pos);
 		ret = pos + 1;
 	}
-	recv(tmp, ret);
+	if( ret > 0 ) {
+		recv(tmp, ret);
+	}
+	if( adapt ) {
+		update_recv_estimate(max_size, ret);
+	}
+
+	return ret;
+}
+
+ssize_t net_socket::recv(buffer_chain &data, size_t max_size) {
+	bool adapt = (max_size == 0);
+	if( adapt ) {
+		max_size = auto_recv_size();
+	}
+
+	std::span<char> room = data.prepare(max_size);
+	ssize_t ret;
+	try {
+		ret = recv(room.data(), max_size);
+	}
+	catch( ... ) {
+		data.commit(0);
+		throw;
+	}
+	data.commit(ret);
+	if( adapt ) {
+		update_recv_estimate(max_size, ret);
+	}
 
 	return ret;
 }
@@ -597,9 +1203,11 @@ ssize_t net_socket::recv_all(void *data, size_t exact_size) {
 	auto d = static_cast<char*>(data);
 	size_t rcvd = 0;
 	ssize_t rs;
+	// The kernel can't honor the timeout while waiting for all the data
+	int flags = _do_timeout ? 0 : MSG_WAITALL;
 	while( rcvd < exact_size ) {
 		try {
-			rs = recv(d + rcvd, exact_size - rcvd);
+			rs = recv(d + rcvd, exact_size - rcvd, flags);
 		}
 		catch( timeout_exception &to ) {
 			to.set_partial_data_size(rcvd);
@@ -617,20 +1225,56 @@ ssize_t net_socket::recv_all(void *data, size_t exact_size) {
 	return rcvd;
 }
 
+ssize_t net_socket::recv_all(buffer_chain &data, size_t exact_size) {
+	std::span<char> room = data.prepare(exact_size);
+	ssize_t ret;
+	try {
+		ret = recv_all(room.data(), exact_size);
+	}
+	catch( timeout_exception &to ) {
+		data.commit(to.get_partial_data_size());
+		throw;
+	}
+	catch( ... ) {
+		data.commit(0);
+		throw;
+	}
+	data.commit(ret);
+
+	return ret;
+}
+
 ssize_t net_socket::recv_all(std::string &data, size_t exact_size) {
-	if( exact_size == 0 ) {
-		exact_size = _recv_size;
+	bool adapt = (exact_size == 0);
+	if( adapt ) {
+		exact_size = auto_recv_size();
 	}
 
-	char tmp[exact_size];
+	// Bytes already buffered (see recv_view) come first
+	string prefix(as_chars(recv_view(0)).substr(0, exact_size));
+	string::size_type pos = prefix.find('\0');
+	if( (pos != string::npos) || (prefix.size() == exact_size) ) {
+		ssize_t ret = (pos != string::npos) ? pos + 1 : prefix.size();
+		data.assign(prefix, 0, pos);
+		consume(ret);
+		return ret;
+	}
+	consume(prefix.size());
+
+	// Peek so that the bytes after the NULL stay in the kernel, where polling
+	// the descriptor sees them
+	size_t rest = exact_size - prefix.size();
+	char tmp[rest];
 	ssize_t rcvd = 0;
-	while( (rcvd < static_cast<ssize_t>(exact_size)) && (std::find(tmp, tmp+rcvd, '\0') == (tmp+rcvd)) ) {
+	while( (rcvd < static_cast<ssize_t>(rest)) && (std::find(tmp, tmp+rcvd, '\0') == (tmp+rcvd)) ) {
 		try {
-			rcvd = recv(tmp, exact_size, MSG_PEEK);
+			rcvd = recv(tmp, rest, MSG_PEEK);
 		}
 		catch( timeout_exception &to ) {
-			to.set_partial_data_size(rcvd);
-			data.assign(tmp, tmp+rcvd);
+			unread(prefix.data(), prefix.size());
+			data = prefix;
+			data.append(tmp, rcvd);
+			to.set_partial_data_size(data.size());
 			throw;
 		}
 		if( rcvd == -1 ) {
@@ -640,17 +1284,405 @@ ssize_t net_socket::recv_all(std::string &data, size_t exact_size) {
 			break;
 		}
 	}
-	data.assign(tmp, tmp+rcvd);
-	string::size_type pos = data.find('\0');
+	data = prefix;
+	data.append(tmp, rcvd);
+	pos = data.find('\0');
 	if( pos != string::npos ) {
 		data.resize(pos);
-		rcvd = pos + 1;
+		rcvd = pos + 1 - prefix.size();
+	}
+	if( rcvd > 0 ) {
+		recv(tmp, rcvd);
+	}
+	rcvd += prefix.size();
+	if( adapt ) {
+		update_recv_estimate(exact_size, rcvd);
 	}
-	recv(tmp, rcvd);
 
 	return rcvd;
 }
 
+void net_socket::set_adaptive_recv_size(bool enable) {
+	_adaptive_recv = enable;
+	_recv_estimate = std::clamp(_recv_size, min_adaptive_recv_size, max_adaptive_recv_size);
+}
+
+recv_range<std::vector<char>> net_socket::chunks(size_t max_size) {
+	return recv_range<std::vector<char>>(*this, [max_size](net_socket &s, std::vector<char> &chunk) {
+		chunk.clear();
+		return s.recv(chunk, max_size) > 0;
+	});
+}
+
+recv_range<std::vector<char>> net_socket::records(size_t record_size) {
+	if( record_size == 0 ) {
+		throw std::invalid_argument("net_socket::records(): Record size must be non-zero");
+	}
+
+	return recv_range<std::vector<char>>(*this, [record_size](net_socket &s, std::vector<char> &record) {
+		return s.recv_all(record, record_size) == static_cast<ssize_t>(record_size);
+	});
+}
+
+recv_range<std::string> net_socket::strings(size_t max_size) {
+	return recv_range<std::string>(*this, [max_size](net_socket &s, std::string &str) {
+		return s.recv_all(str, max_size) > 0;
+	});
+}
+
+address net_socket::get_source_address() const {
+	if( !_bind_source ) {
+		throw std::runtime_error("net_socket::get_source_address(): No source address set");
+	}
+
+	return _source;
+}
+
+void net_socket::set_source_address(const address &addr) {
+	if( (addr.is_ipv4() && (_net_proto == network_protocol::IPv6))
+		|| (addr.is_ipv6() && (_net_proto == network_protocol::IPv4)) ) {
+
+		throw std::invalid_argument(
+			"net_socket::set_source_address(): Source address family does not match network protocol");
+	}
+
+	_source = addr;
+	_bind_source = true;
+	_source_pool.reset();
+}
+
+void net_socket::set_source_address_pool(std::shared_ptr<source_address_pool> pool) {
+	_source_pool = std::move(pool);
+	if( _source_pool ) {
+		_bind_source = false;
+	}
+}
+
+void net_socket::set_zerocopy_receive(bool enable, size_t region_size) {
+	long page = sysconf(_SC_PAGESIZE);
+	if( (region_size == 0) || (region_size % page != 0) || (region_size > UINT32_MAX) ) {
+		throw std::invalid_argument(
+			"net_socket::set_zerocopy_receive(): Region size must be a non-zero multiple of the page size");
+	}
+
+	_zerocopy = enable;
+	_zerocopy_size = region_size;
+	_zc.reset();
+}
+
+std::span<const char> net_socket::recv_zerocopy(size_t max_size) {
+	if( !_connected ) {
+		throw std::runtime_error("net_socket::recv_zerocopy(): Unable to recv on unconnected socket");
+	}
+
+	if( !_zc ) {
+		_zc = std::make_unique<zerocopy_state>();
+		_zc->copybuf.resize(std::min<size_t>(_zerocopy_size, 1 << 16));
+		_zc->unsupported = !_zerocopy;
+	}
+	zerocopy_state &zc = *_zc;
+	if( (max_size == 0) || (max_size > _zerocopy_size) ) {
+		max_size = _zerocopy_size;
+	}
+
+	// Bytes left by recv_view, or copied after the pages mapped by the
+	// previous call; they stay in place until the next receive
+	if( get_buffered_size() > 0 ) {
+		std::span<const std::byte> view = recv_view(0);
+		size_t n = std::min(view.size(), max_size);
+		consume(n);
+		return std::span<const char>(reinterpret_cast<const char*>(view.data()), n);
+	}
+
+	wait_readable("net_socket::recv_zerocopy(): ");
+
+	if( !zc.unsupported && (zc.map == nullptr) ) {
+		void *m = mmap(nullptr, _zerocopy_size, PROT_READ, MAP_SHARED, _sock_desc, 0);
+		if( m == MAP_FAILED ) {
+			zc.unsupported = true;
+		}
+		else {
+			zc.map = static_cast<char*>(m);
+			zc.map_size = _zerocopy_size;
+		}
+	}
+
+	long page = sysconf(_SC_PAGESIZE);
+	size_t map_len = max_size - max_size % page;
+	if( !zc.unsupported && (map_len > 0) ) {
+		struct tcp_zerocopy_receive req{};
+		req.address = reinterpret_cast<uintptr_t>(zc.map);
+		req.length = map_len;
+		req.copybuf_address = reinterpret_cast<uintptr_t>(zc.copybuf.data());
+		req.copybuf_len = std::min(zc.copybuf.size(), max_size);
+		socklen_t len = sizeof(req);
+		if( getsockopt(_sock_desc, IPPROTO_TCP, TCP_ZEROCOPY_RECEIVE, &req, &len) == -1 ) {
+			// Other errors (e.g., at the end of the stream) are left to recv below
+			if( (errno == EINVAL) || (errno == EOPNOTSUPP) || (errno == ENOPROTOOPT) ) {
+				zc.unsupported = true;
+			}
+		}
+		else {
+			if( req.err != 0 ) {
+				throw std::runtime_error(string("net_socket::recv_zerocopy(): ")+string(strerror(req.err)));
+			}
+			// Kernels without the copy buffer leave it untouched
+			size_t copied = (len >= offsetof(struct tcp_zerocopy_receive, flags) && (req.copybuf_len > 0))
+				? req.copybuf_len : 0;
+			_zc_stats.mapped += req.length;
+			_zc_stats.copied += copied;
+			count_recv(req.length + copied, 0);
+			NETSOCK_PROBE3(recv, _sock_desc, max_size, req.length + copied);
+			if( req.length > 0 ) {
+				// The copied bytes follow the mapped ones; buffered, they come
+				// first for every kind of receive
+				unread(zc.copybuf.data(), copied);
+				return std::span<const char>(zc.map, req.length);
+			}
+			if( copied > 0 ) {
+				return std::span<const char>(zc.copybuf.data(), copied);
+			}
+		}
+	}
+
+	// Nothing mapped: copy the data (this also detects the peer closing)
+	ssize_t ret = ::recv(_sock_desc, zc.copybuf.data(), std::min(max_size, zc.copybuf.size()), 0);
+	NETSOCK_PROBE3(recv, _sock_desc, max_size, (ret == -1) ? -errno : ret);
+	if( ret == -1 ) {
+		throw std::runtime_error(string("net_socket::recv_zerocopy(): ")+string(strerror(errno)));
+	}
+	count_recv(ret, 0);
+	if( ret == 0 ) {
+		close();
+		return {};
+	}
+	_zc_stats.copied += ret;
+
+	return std::span<const char>(zc.copybuf.data(), ret);
+}
+
+std::span<const std::byte> net_socket::recv_view(size_t min_bytes) {
+	if( !_rbuf ) {
+		_rbuf = std::make_unique<recv_buffer>();
+	}
+	recv_buffer &b = *_rbuf;
+	if( (min_bytes > 0) && !_connected && (b.start == b.end) ) {
+		throw std::runtime_error("net_socket::recv_view(): Unable to recv on unconnected socket");
+	}
+
+	while( (b.end - b.start < min_bytes) && _connected ) {
+		// Move the unconsumed bytes to the front to make room
+		if( b.start > 0 ) {
+			memmove(b.data.data(), b.data.data() + b.start, b.end - b.start);
+			b.end -= b.start;
+			b.start = 0;
+		}
+		size_t room = std::max(min_bytes, b.end + auto_recv_size());
+		if( b.data.size() < room ) {
+			b.data.resize(room);
+		}
+
+		ssize_t ret;
+		try {
+			ret = recv_socket(b.data.data() + b.end, b.data.size() - b.end, 0);
+		}
+		catch( timeout_exception &to ) {
+			to.set_partial_data_size(b.end);
+			throw;
+		}
+		update_recv_estimate(b.data.size() - b.end, ret);
+		b.end += ret;
+	}
+
+	return std::span<const std::byte>(reinterpret_cast<const std::byte*>(b.data.data()) + b.start, b.end - b.start);
+}
+
+void net_socket::consume(size_t size) {
+	if( size > get_buffered_size() ) {
+		throw std::out_of_range("net_socket::consume(): Size exceeds buffered data");
+	}
+	if( size == 0 ) {
+		return;
+	}
+
+	_rbuf->start += size;
+	if( _rbuf->start == _rbuf->end ) {
+		_rbuf->start = 0;
+		_rbuf->end = 0;
+	}
+}
+
+size_t net_socket::get_buffered_size() const {
+	return _rbuf ? (_rbuf->end - _rbuf->start) : 0;
+}
+
+size_t net_socket::recv_buffered(void *data, size_t max_size, int flags) {
+	size_t n = std::min(max_size, get_buffered_size());
+	memcpy(data, _rbuf->data.data() + _rbuf->start, n);
+	if( !(flags & MSG_PEEK) ) {
+		consume(n);
+	}
+
+	return n;
+}
+
+bool net_socket::negotiate_byte_order() {
+	_same_byte_order = false;
+	std::array<char, hello_size> hello = byte_order_hello();
+	if( !_accepted_connection ) {
+		send_all(hello.data(), hello.size());
+	}
+
+	// Stop reading as soon as the bytes can't be a hello
+	std::string_view peer;
+	try {
+		do {
+			peer = as_chars(recv_view(peer.size() + 1));
+		} while( (peer.size() < hello_size) && _connected && could_be_hello(peer) );
+	}
+	catch( timeout_exception& ) {
+		return false;
+	}
+	if( (peer.size() < hello_size) || !could_be_hello(peer) || (peer[4] != hello_version) ) {
+		return false;
+	}
+
+	bool same = (peer[5] == hello[5]);
+	consume(hello_size);
+	if( _accepted_connection ) {
+		send_all(hello.data(), hello.size());
+	}
+	_same_byte_order = same;
+
+	return same;
+}
+
+void net_socket::unread(const void *data, size_t size) {
+	if( size == 0 ) {
+		return;
+	}
+	if( !_rbuf ) {
+		_rbuf = std::make_unique<recv_buffer>();
+	}
+
+	// The bytes go back in front of any still buffered
+	recv_buffer &b = *_rbuf;
+	auto d = static_cast<const char*>(data);
+	if( b.start >= size ) {
+		b.start -= size;
+		memcpy(b.data.data() + b.start, d, size);
+	}
+	else {
+		b.data.insert(b.data.begin() + b.start, d, d + size);
+		b.end += size;
+	}
+}
+
+ssize_t net_socket::recv_elements(void *data, size_t max_size, size_t element_size) {
+	if( max_size < element_size ) {
+		throw std::invalid_argument("net_socket::recv(): Size smaller than an element");
+	}
+
+	auto d = static_cast<char*>(data);
+	ssize_t ss = recv(d, max_size);
+	// Receive until there is a whole element, with reads of the full size
+	while( (ss > 0) && (static_cast<size_t>(ss) < element_size) && _connected ) {
+		ssize_t n;
+		try {
+			n = recv(d + ss, max_size - ss);
+		}
+		catch( timeout_exception &to ) {
+			unread(d, ss);
+			to.set_partial_data_size(0);
+			throw;
+		}
+		if( n == 0 ) {
+			break;
+		}
+		ss += n;
+	}
+
+	if( ss <= 0 ) {
+		return ss;
+	}
+	size_t partial = ss % element_size;
+	unread(d + ss - partial, partial);
+
+	return ss - partial;
+}
+
+ssize_t net_socket::recv_all_elements(void *data, size_t exact_size, size_t element_size) {
+	if( exact_size < element_size ) {
+		throw std::invalid_argument("net_socket::recv_all(): Size smaller than an element");
+	}
+
+	auto d = static_cast<char*>(data);
+	ssize_t ss = recv_all(d, exact_size);
+	if( ss <= 0 ) {
+		return ss;
+	}
+	size_t partial = ss % element_size;
+	unread(d + ss - partial, partial);
+
+	return ss - partial;
+}
+
+void net_socket::set_timestamps(bool rx, bool tx) {
+	_rx_timestamps = rx;
+	_tx_timestamps = tx;
+	if( _sock_desc != -1 ) {
+		apply_timestamps(_sock_desc);
+	}
+}
+
+bool net_socket::get_tx_timestamp(socket_timestamp &ts) {
+	if( !_connected ) {
+		throw std::runtime_error(
+			"net_socket::get_tx_timestamp(): Unable to get timestamps of unconnected socket");
+	}
+
+	char control[CMSG_SPACE(sizeof(struct scm_timestamping))
+		+ CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))];
+	struct msghdr msg{};
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	if( ::recvmsg(_sock_desc, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1 ) {
+		if( (errno == EAGAIN) || (errno == EWOULDBLOCK) ) {
+			return false;
+		}
+		throw std::runtime_error(string("net_socket::get_tx_timestamp(): ")+string(strerror(errno)));
+	}
+
+	ts = socket_timestamp();
+	for( struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c != nullptr; c = CMSG_NXTHDR(&msg, c) ) {
+		if( (c->cmsg_level == SOL_SOCKET) && (c->cmsg_type == SCM_TIMESTAMPING) ) {
+			struct scm_timestamping tss;
+			memcpy(&tss, CMSG_DATA(c), sizeof(tss));
+			ts.software = tss.ts[0];
+			ts.hardware = tss.ts[2];
+		}
+		else if( ((c->cmsg_level == SOL_IP) && (c->cmsg_type == IP_RECVERR))
+			|| ((c->cmsg_level == SOL_IPV6) && (c->cmsg_type == IPV6_RECVERR)) ) {
+
+			struct sock_extended_err ee;
+			memcpy(&ee, CMSG_DATA(c), sizeof(ee));
+			if( ee.ee_origin != SO_EE_ORIGIN_TIMESTAMPING ) {
+				continue;
+			}
+			switch( ee.ee_info ) {
+				case SCM_TSTAMP_SCHED: ts.stage = socket_timestamp::scheduled; break;
+				case SCM_TSTAMP_SND: ts.stage = socket_timestamp::sent; break;
+				case SCM_TSTAMP_ACK: ts.stage = socket_timestamp::acknowledged; break;
+				default: break;
+			}
+			ts.id = ee.ee_data;
+		}
+	}
+
+	return true;
+}
+
 // Private members
 void net_socket::copy(const net_socket *other) {
 	if( other != nullptr ) {
@@ -665,6 +1697,19 @@ void net_socket::copy(const net_socket *other) {
 		_do_timeout = other->_do_timeout;
 		_timeout = other->_timeout;
 		_recv_size = other->_recv_size;
+		_adaptive_recv = other->_adaptive_recv;
+		_recv_estimate = other->_recv_estimate;
+		_v6_only_set = other->_v6_only_set;
+		_v6_only = other->_v6_only;
+		_multipath = other->_multipath;
+		_bind_source = other->_bind_source;
+		_source = other->_source;
+		_source_pool = other->_source_pool;
+		_rx_timestamps = other->_rx_timestamps;
+		_tx_timestamps = other->_tx_timestamps;
+		_zerocopy = other->_zerocopy;
+		_zerocopy_size = other->_zerocopy_size;
+		_accept_latency = other->_accept_latency;
 	}
 	else {
 		_net_proto = network_protocol::ANY;
@@ -673,8 +1718,31 @@ void net_socket::copy(const net_socket *other) {
 		_do_timeout = false;
 		_timeout = {};
 		_recv_size = 1400;
+		_adaptive_recv = false;
+		_recv_estimate = 1400;
+		_v6_only_set = false;
+		_v6_only = false;
+		_multipath = false;
+		_bind_source = false;
+		_source_pool.reset();
+		_rx_timestamps = false;
+		_tx_timestamps = false;
+		_zerocopy = false;
+		_zerocopy_size = 1 << 21;
+		_accept_latency = false;
 	}
 
+	_zc.reset();
+	_zc_stats = {};
+	_rbuf.reset();
+	_accepted_connection = false;
+	_same_byte_order = false;
+	_overflows_base = 0;
+	_drops_base = 0;
+	_accepted = 0;
+	_accept_latency_total = {};
+	_accept_latency_max = {};
+
 	_sock_desc = -1;
 	_passive = false;
 	_connected = false;
@@ -690,7 +1758,33 @@ void net_socket::move(net_socket *other) {
 	_do_timeout = other->_do_timeout;
 	_timeout = other->_timeout;
 	_recv_size = other->_recv_size;
+	_adaptive_recv = other->_adaptive_recv;
+	_recv_estimate = other->_recv_estimate;
+	_v6_only_set = other->_v6_only_set;
+	_v6_only = other->_v6_only;
+	_multipath = other->_multipath;
+	_bind_source = other->_bind_source;
+	_source = other->_source;
+	_source_pool = other->_source_pool;
+	_rx_timestamps = other->_rx_timestamps;
+	_tx_timestamps = other->_tx_timestamps;
+	_zerocopy = other->_zerocopy;
+	_zerocopy_size = other->_zerocopy_size;
+	_accept_latency = other->_accept_latency;
+	_overflows_base = other->_overflows_base;
+	_drops_base = other->_drops_base;
+	_accepted = other->_accepted;
+	_accept_latency_total = other->_accept_latency_total;
+	_accept_latency_max = other->_accept_latency_max;
+	_accepted_connection = other->_accepted_connection;
+	_same_byte_order = other->_same_byte_order;
+	zerocopy_statistics stats = other->_zc_stats;
+	std::unique_ptr<zerocopy_state> zc = std::move(other->_zc);
+	std::unique_ptr<recv_buffer> rbuf = std::move(other->_rbuf);
 	other->copy();
+	_zc = std::move(zc);
+	_rbuf = std::move(rbuf);
+	_zc_stats = stats;
 }
 
 int net_socket::get_af() const {
@@ -722,6 +1816,121 @@ int net_socket::get_socktype() const {
 	return ret;
 }
 
+int net_socket::open_socket(int family, int socktype, int protocol) const {
+	if( _multipath && (socktype == SOCK_STREAM) ) {
+		int s = socket(family, socktype, IPPROTO_MPTCP);
+		if( s != -1 ) {
+			return s;
+		}
+		// Without kernel support, use TCP
+	}
+
+	return socket(family, socktype, protocol);
+}
+
+void net_socket::wait_readable(const char *func) const {
+	if( _do_timeout ){
+		fd_set fds;
+		FD_ZERO(&fds);
+		FD_SET(_sock_desc, &fds);
+		struct timeval tmp_tv = _timeout;
+		int sret = select(_sock_desc+1, &fds, nullptr, nullptr, &tmp_tv);
+		if( sret < 0 ) {
+			throw std::runtime_error(string(func)+string(strerror(errno)));
+		}
+
+		if( sret == 0 ) {
+			get_library_metrics().timeouts.add();
+			NETSOCK_PROBE2(timeout, _sock_desc, _timeout.tv_sec*1000000 + _timeout.tv_usec);
+			throw timeout_exception();
+		}
+	}
+}
+
+void net_socket::count_recv(size_t received, int flags) {
+	library_metrics &m = get_library_metrics();
+	m.recv_calls.add();
+	m.recv_bytes.observe(received);
+	// Peeked data is counted when it is received
+	if( !(flags & MSG_PEEK) ) {
+		m.bytes_received.add(received);
+	}
+}
+
+size_t net_socket::auto_recv_size() const {
+	if( !_adaptive_recv ) {
+		return _recv_size;
+	}
+
+	int queued = 0;
+	if( (_sock_desc == -1) || (ioctl(_sock_desc, FIONREAD, &queued) == -1) ) {
+		queued = 0;
+	}
+
+	return std::clamp(std::max(_recv_estimate, static_cast<size_t>(queued)),
+		min_adaptive_recv_size, max_adaptive_recv_size);
+}
+
+void net_socket::update_recv_estimate(size_t requested, ssize_t received) {
+	if( !_adaptive_recv || (received <= 0) ) {
+		return;
+	}
+
+	// Grow quickly while reads fill the buffer, shrink slowly otherwise
+	if( static_cast<size_t>(received) >= requested ) {
+		_recv_estimate = 2*requested;
+	}
+	else {
+		_recv_estimate = (3*_recv_estimate + received)/4;
+	}
+	_recv_estimate = std::clamp(_recv_estimate, min_adaptive_recv_size, max_adaptive_recv_size);
+}
+
+int net_socket::bind_source(int sd, int af) const {
+	const address &src = _source_pool ? _source_pool->next(af) : _source;
+
+	// Leave the port to connect so it only has to be unique per destination
+	int one = 1;
+	if( src.get_port() == 0 ) {
+		setsockopt(sd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &one, sizeof(one));
+	}
+
+	if( _source_pool && _source_pool->local_port_range_is_set() ) {
+		uint32_t range = (static_cast<uint32_t>(_source_pool->get_local_port_high()) << 16)
+			| _source_pool->get_local_port_low();
+		if( (setsockopt(sd, IPPROTO_IP, IP_LOCAL_PORT_RANGE, &range, sizeof(range)) == -1)
+			&& (errno != ENOPROTOOPT) ) {
+			return -1;
+		}
+	}
+
+	struct sockaddr_storage sa = src.get_sockaddr();
+	socklen_t len = src.is_ipv4() ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6);
+
+	return bind(sd, reinterpret_cast<struct sockaddr*>(&sa), len);
+}
+
+void net_socket::apply_timestamps(int sd) const {
+	int flags = 0;
+	if( _rx_timestamps ) {
+		flags |= SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_RX_HARDWARE;
+	}
+	if( _tx_timestamps ) {
+		// Identify each timestamp by byte offset and don't echo the data
+		flags |= SOF_TIMESTAMPING_TX_SCHED | SOF_TIMESTAMPING_TX_SOFTWARE
+			| SOF_TIMESTAMPING_TX_HARDWARE | SOF_TIMESTAMPING_TX_ACK
+			| SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+	}
+	if( flags != 0 ) {
+		flags |= SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+	}
+
+	if( setsockopt(sd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == -1 ) {
+		throw std::runtime_error(
+			string("net_socket internal error: Unable to set timestamping (") + string(strerror(errno)) + ")");
+	}
+}
+
 std::ostream& operator<<(std::ostream& s, const address& a) {
 	s << a.str();
 	return s;
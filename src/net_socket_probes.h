@@ -0,0 +1,59 @@
+#ifndef __NET_SOCKET_PROBES_H
+#define __NET_SOCKET_PROBES_H
+
+// USDT (user-level statically defined tracing) probes of provider `netsock`,
+// for attaching bpftrace, perf, or SystemTap to a running process. A probe is
+// a single nop until a tracer enables it. Probes whose arguments cost
+// something to prepare (e.g., formatting an address) are guarded by the
+// probe's semaphore, which the tracer increments while attached:
+//
+//     if( NETSOCK_PROBE_ENABLED(connect) ) {
+//         ...prepare arguments...
+//         NETSOCK_PROBE3(connect, ...);
+//     }
+//
+// The notes of all probes refer to their semaphores, so each probe name used
+// must have its semaphore defined once with NETSOCK_PROBE_SEMAPHORE. The
+// probes compile to nothing without <sys/sdt.h> (systemtap-sdt-dev) or when
+// NETSOCK_NO_PROBES is defined; NETSOCK_REQUIRE_PROBES makes a missing
+// <sys/sdt.h> an error (`make probes`).
+
+#if defined(__has_include) && !defined(NETSOCK_NO_PROBES)
+#if __has_include(<sys/sdt.h>)
+#define NETSOCK_HAVE_PROBES 1
+#endif
+#endif
+
+#if defined(NETSOCK_REQUIRE_PROBES) && !defined(NETSOCK_HAVE_PROBES)
+#error "NETSOCK_REQUIRE_PROBES is defined, but <sys/sdt.h> is not available"
+#endif
+
+#ifdef NETSOCK_HAVE_PROBES
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+// The probe notes refer to the semaphores by their unmangled names, so they
+// are defined at global scope
+#define NETSOCK_PROBE_SEMAPHORE(name) \
+	volatile unsigned short netsock_##name##_semaphore __attribute__((unused, section(".probes")))
+#define NETSOCK_PROBE_ENABLED(name) __builtin_expect(netsock_##name##_semaphore != 0, 0)
+#define NETSOCK_PROBE1(name, a1) STAP_PROBE1(netsock, name, a1)
+#define NETSOCK_PROBE2(name, a1, a2) STAP_PROBE2(netsock, name, a1, a2)
+#define NETSOCK_PROBE3(name, a1, a2, a3) STAP_PROBE3(netsock, name, a1, a2, a3)
+#define NETSOCK_PROBE4(name, a1, a2, a3, a4) STAP_PROBE4(netsock, name, a1, a2, a3, a4)
+
+#else
+
+#define NETSOCK_PROBE_SEMAPHORE(name) static_assert(true)
+#define NETSOCK_PROBE_ENABLED(name) false
+// The arguments are not evaluated, but count as used
+#define NETSOCK_PROBE1(name, a1) do {(void)sizeof(a1);} while(0)
+#define NETSOCK_PROBE2(name, a1, a2) do {(void)sizeof(a1); (void)sizeof(a2);} while(0)
+#define NETSOCK_PROBE3(name, a1, a2, a3) do {(void)sizeof(a1); (void)sizeof(a2); (void)sizeof(a3);} while(0)
+#define NETSOCK_PROBE4(name, a1, a2, a3, a4) \
+	do {(void)sizeof(a1); (void)sizeof(a2); (void)sizeof(a3); (void)sizeof(a4);} while(0)
+
+#endif
+
+#endif
@@ -0,0 +1,396 @@
+#include "packet_capture.h"
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+#include <unistd.h>
+#include <poll.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+
+using std::string;
+
+namespace network_socket {
+
+packet_view::packet_view(const struct tpacket3_hdr *hdr) {
+	auto base = reinterpret_cast<const unsigned char*>(hdr);
+	auto sll = reinterpret_cast<const struct sockaddr_ll*>(
+		base + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+
+	_frame = base + hdr->tp_mac;
+	_snap_len = hdr->tp_snaplen;
+	_wire_len = hdr->tp_len;
+	_ts.tv_sec = hdr->tp_sec;
+	_ts.tv_nsec = hdr->tp_nsec;
+	_ifindex = sll->sll_ifindex;
+	_ethertype = ntohs(sll->sll_protocol);
+	_pkttype = sll->sll_pkttype;
+
+	const unsigned char *end = _frame + _snap_len;
+	const unsigned char *net = base + hdr->tp_net;
+	if( (net < _frame) || (net >= end) ) {
+		return;
+	}
+
+	_net = net;
+	if( _ethertype == ETH_P_IP ) {
+		decode_ipv4(end);
+	}
+	else if( _ethertype == ETH_P_IPV6 ) {
+		decode_ipv6(end);
+	}
+	else {
+		_net = nullptr;
+	}
+}
+
+bool packet_view::is_outgoing() const {return _pkttype == PACKET_OUTGOING;}
+
+address packet_view::get_source() const {return make_address(true);}
+
+address packet_view::get_destination() const {return make_address(false);}
+
+void packet_view::decode_ipv4(const unsigned char *end) {
+	if( end - _net < static_cast<ssize_t>(sizeof(struct iphdr)) ) {
+		_net = nullptr;
+		return;
+	}
+
+	auto ip = reinterpret_cast<const struct iphdr*>(_net);
+	size_t hdr_len = ip->ihl*4;
+	if( (ip->version != 4) || (hdr_len < sizeof(struct iphdr)) ) {
+		_net = nullptr;
+		return;
+	}
+
+	_ip_version = 4;
+	_ip_protocol = ip->protocol;
+
+	// Only the first fragment has a transport header
+	if( (ntohs(ip->frag_off) & IP_OFFMASK) != 0 ) {
+		return;
+	}
+
+	// Ignore link-layer padding after the IP datagram
+	const unsigned char *ip_end = _net + ntohs(ip->tot_len);
+	decode_transport(_net + hdr_len, std::min(end, ip_end));
+}
+
+void packet_view::decode_ipv6(const unsigned char *end) {
+	if( end - _net < static_cast<ssize_t>(sizeof(struct ip6_hdr)) ) {
+		_net = nullptr;
+		return;
+	}
+
+	auto ip6 = reinterpret_cast<const struct ip6_hdr*>(_net);
+	if( (ip6->ip6_vfc >> 4) != 6 ) {
+		_net = nullptr;
+		return;
+	}
+
+	_ip_version = 6;
+	const unsigned char *ip_end = _net + sizeof(struct ip6_hdr) + ntohs(ip6->ip6_plen);
+	if( ip_end < end ) {
+		end = ip_end;
+	}
+
+	// Skip the common extension headers to find the transport header
+	int next = ip6->ip6_nxt;
+	const unsigned char *p = _net + sizeof(struct ip6_hdr);
+	while( (next == IPPROTO_HOPOPTS) || (next == IPPROTO_ROUTING)
+		|| (next == IPPROTO_DSTOPTS) || (next == IPPROTO_FRAGMENT) ) {
+
+		if( end - p < 8 ) {
+			_ip_protocol = next;
+			return;
+		}
+
+		if( next == IPPROTO_FRAGMENT ) {
+			auto frag = reinterpret_cast<const struct ip6_frag*>(p);
+			if( (ntohs(frag->ip6f_offlg) & IP6F_OFF_MASK) != 0 ) {
+				_ip_protocol = frag->ip6f_nxt;
+				return;
+			}
+			next = frag->ip6f_nxt;
+			p += sizeof(struct ip6_frag);
+		}
+		else {
+			auto ext = reinterpret_cast<const struct ip6_ext*>(p);
+			next = ext->ip6e_nxt;
+			p += (ext->ip6e_len + 1)*8;
+		}
+	}
+
+	_ip_protocol = next;
+	decode_transport(p, end);
+}
+
+void packet_view::decode_transport(const unsigned char *transport, const unsigned char *end) {
+	if( transport > end ) {
+		return;
+	}
+
+	if( _ip_protocol == IPPROTO_TCP ) {
+		if( end - transport < static_cast<ssize_t>(sizeof(struct tcphdr)) ) {
+			return;
+		}
+		_tcp = reinterpret_cast<const struct tcphdr*>(transport);
+		size_t hdr_len = _tcp->doff*4;
+		if( (hdr_len < sizeof(struct tcphdr)) || (transport + hdr_len > end) ) {
+			_tcp = nullptr;
+			return;
+		}
+		_payload = transport + hdr_len;
+	}
+	else if( _ip_protocol == IPPROTO_UDP ) {
+		if( end - transport < static_cast<ssize_t>(sizeof(struct udphdr)) ) {
+			return;
+		}
+		_udp = reinterpret_cast<const struct udphdr*>(transport);
+		_payload = transport + sizeof(struct udphdr);
+	}
+	else {
+		_payload = transport;
+	}
+
+	_payload_len = end - _payload;
+}
+
+address packet_view::make_address(bool source) const {
+	if( _net == nullptr ) {
+		throw std::runtime_error("packet_view: Frame does not contain an IP header");
+	}
+
+	in_port_t port = 0;
+	if( _tcp != nullptr ) {
+		port = source ? _tcp->source : _tcp->dest;
+	}
+	else if( _udp != nullptr ) {
+		port = source ? _udp->source : _udp->dest;
+	}
+
+	if( is_ipv4() ) {
+		auto ip = reinterpret_cast<const struct iphdr*>(_net);
+		struct sockaddr_in sa{};
+		sa.sin_family = AF_INET;
+		sa.sin_port = port;
+		sa.sin_addr.s_addr = source ? ip->saddr : ip->daddr;
+		return address(sa);
+	}
+
+	auto ip6 = reinterpret_cast<const struct ip6_hdr*>(_net);
+	struct sockaddr_in6 sa{};
+	sa.sin6_family = AF_INET6;
+	sa.sin6_port = port;
+	sa.sin6_addr = source ? ip6->ip6_src : ip6->ip6_dst;
+	return address(sa);
+}
+
+packet_capture::~packet_capture() noexcept {
+	close();
+}
+
+void packet_capture::open(const std::string &interface, size_t block_size,
+	unsigned int block_count, unsigned int block_timeout_ms) {
+
+	if( _sock_desc != -1 ) {
+		throw std::runtime_error("packet_capture::open(): Capture is already open");
+	}
+
+	long page = sysconf(_SC_PAGESIZE);
+	if( (block_size == 0) || (block_size % page != 0) || (block_count == 0) ) {
+		throw std::invalid_argument(
+			string("packet_capture::open(): Block size (") + std::to_string(block_size)
+			+ string(") must be a non-zero multiple of the page size and block count non-zero"));
+	}
+
+	unsigned int ifindex = 0;
+	if( !interface.empty() ) {
+		ifindex = if_nametoindex(interface.c_str());
+		if( ifindex == 0 ) {
+			throw std::invalid_argument(
+				string("packet_capture::open(): Unknown interface (") + interface + string(")"));
+		}
+	}
+
+	int s = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+	if( s == -1 ) {
+		throw std::runtime_error(string("packet_capture::open(): ") + string(strerror(errno)));
+	}
+
+	int version = TPACKET_V3;
+	struct tpacket_req3 req{};
+	req.tp_block_size = block_size;
+	req.tp_block_nr = block_count;
+	req.tp_frame_size = TPACKET_ALIGNMENT << 7;
+	req.tp_frame_nr = (block_size / req.tp_frame_size) * block_count;
+	req.tp_retire_blk_tov = block_timeout_ms;
+
+	struct sockaddr_ll sll{};
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(ETH_P_ALL);
+	sll.sll_ifindex = ifindex;
+
+	void *ring = MAP_FAILED;
+	if( (setsockopt(s, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) == -1)
+		|| (setsockopt(s, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) == -1)
+		|| ((ring = mmap(nullptr, block_size*block_count, PROT_READ | PROT_WRITE,
+			MAP_SHARED, s, 0)) == MAP_FAILED)
+		|| (bind(s, reinterpret_cast<struct sockaddr*>(&sll), sizeof(sll)) == -1) ) {
+
+		int err = errno;
+		if( ring != MAP_FAILED ) {
+			munmap(ring, block_size*block_count);
+		}
+		::close(s);
+		throw std::runtime_error(string("packet_capture::open(): ") + string(strerror(err)));
+	}
+
+	_sock_desc = s;
+	_ring = static_cast<unsigned char*>(ring);
+	_block_size = block_size;
+	_block_count = block_count;
+	_current_block = 0;
+}
+
+void packet_capture::close() {
+	if( _sock_desc != -1 ) {
+		munmap(_ring, _block_size*_block_count);
+		::close(_sock_desc);
+		_sock_desc = -1;
+		_ring = nullptr;
+		_block_size = 0;
+		_block_count = 0;
+		_current_block = 0;
+	}
+}
+
+void packet_capture::set_fanout(uint16_t group_id, fanout_mode mode) {
+	if( _sock_desc == -1 ) {
+		throw std::runtime_error("packet_capture::set_fanout(): Capture is not open");
+	}
+
+	int type;
+	switch(mode) {
+		case fanout_mode::hash: type = PACKET_FANOUT_HASH; break;
+		case fanout_mode::load_balance: type = PACKET_FANOUT_LB; break;
+		case fanout_mode::cpu: type = PACKET_FANOUT_CPU; break;
+		case fanout_mode::rollover: type = PACKET_FANOUT_ROLLOVER; break;
+		case fanout_mode::random: type = PACKET_FANOUT_RND; break;
+		case fanout_mode::queue_mapping: type = PACKET_FANOUT_QM; break;
+		default:
+			throw std::invalid_argument("packet_capture::set_fanout(): Unsupported fanout mode");
+	}
+
+	int arg = group_id | (type << 16);
+	if( setsockopt(_sock_desc, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg)) == -1 ) {
+		throw std::runtime_error(string("packet_capture::set_fanout(): ") + string(strerror(errno)));
+	}
+}
+
+void packet_capture::set_ignore_outgoing(bool ignore) {
+	if( _sock_desc == -1 ) {
+		throw std::runtime_error("packet_capture::set_ignore_outgoing(): Capture is not open");
+	}
+
+	int arg = ignore ? 1 : 0;
+	if( setsockopt(_sock_desc, SOL_PACKET, PACKET_IGNORE_OUTGOING, &arg, sizeof(arg)) == -1 ) {
+		throw std::runtime_error(
+			string("packet_capture::set_ignore_outgoing(): ") + string(strerror(errno)));
+	}
+}
+
+double packet_capture::get_timeout() const {
+	double ret = 0.0;
+	if( _do_timeout ) {
+		ret =  _timeout.tv_sec + static_cast<double>(_timeout.tv_usec)/1e6;
+	}
+
+	return ret;
+}
+
+void packet_capture::set_timeout(double s) {
+	if( s < 0.0 ) {
+		throw std::invalid_argument(
+			std::string("packet_capture::set_timeout(): Negative timeout value (")
+				+ std::to_string(s) + std::string(") provided"));
+	}
+
+	if( s == 0 ) {
+		_do_timeout = false;
+		_timeout.tv_sec = 0;
+		_timeout.tv_usec = 0;
+	}
+	else {
+		_do_timeout = true;
+		_timeout.tv_sec = static_cast<long>(s);
+		_timeout.tv_usec = static_cast<long>((s-_timeout.tv_sec)*1e6);
+	}
+}
+
+size_t packet_capture::dispatch(const std::function<void(const packet_view&)> &handler) {
+	if( _sock_desc == -1 ) {
+		throw std::runtime_error("packet_capture::dispatch(): Capture is not open");
+	}
+
+	auto block = reinterpret_cast<struct tpacket_block_desc*>(_ring + _current_block*_block_size);
+	while( (__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0 ) {
+		struct pollfd pfd = {_sock_desc, POLLIN | POLLERR, 0};
+		int ms = _do_timeout ? (_timeout.tv_sec*1000 + (_timeout.tv_usec+999)/1000) : -1;
+		int ret = poll(&pfd, 1, ms);
+		if( ret < 0 ) {
+			throw std::runtime_error(string("packet_capture::dispatch(): ") + string(strerror(errno)));
+		}
+
+		if( ret == 0 ) {
+			throw timeout_exception();
+		}
+	}
+
+	size_t count = block->hdr.bh1.num_pkts;
+	auto hdr = reinterpret_cast<const struct tpacket3_hdr*>(
+		reinterpret_cast<unsigned char*>(block) + block->hdr.bh1.offset_to_first_pkt);
+	try {
+		for( size_t i = 0; i < count; ++i ) {
+			handler(packet_view(hdr));
+			hdr = reinterpret_cast<const struct tpacket3_hdr*>(
+				reinterpret_cast<const unsigned char*>(hdr) + hdr->tp_next_offset);
+		}
+	}
+	catch( ... ) {
+		// Always give the block back so the ring does not stall
+		__atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+		_current_block = (_current_block + 1) % _block_count;
+		throw;
+	}
+
+	__atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+	_current_block = (_current_block + 1) % _block_count;
+
+	return count;
+}
+
+capture_statistics packet_capture::get_statistics() {
+	if( _sock_desc == -1 ) {
+		throw std::runtime_error("packet_capture::get_statistics(): Capture is not open");
+	}
+
+	struct tpacket_stats_v3 st{};
+	socklen_t len = sizeof(st);
+	if( getsockopt(_sock_desc, SOL_PACKET, PACKET_STATISTICS, &st, &len) == -1 ) {
+		throw std::runtime_error(string("packet_capture::get_statistics(): ") + string(strerror(errno)));
+	}
+
+	capture_statistics ret;
+	ret.packets = st.tp_packets;
+	ret.drops = st.tp_drops;
+	ret.freeze_count = st.tp_freeze_q_cnt;
+
+	return ret;
+}
+
+} // namespace network_socket
@@ -0,0 +1,79 @@
+#include "source_address_pool.h"
+#include <stdexcept>
+#include <cstring>
+
+namespace network_socket {
+
+source_address_pool::source_address_pool(const std::vector<address> &addrs) {
+	for( const auto &a : addrs ) {
+		add(a);
+	}
+}
+
+void source_address_pool::add(const address &addr) {
+	if( addr.get_port() != 0 ) {
+		throw std::invalid_argument("source_address_pool::add(): Port must be 0");
+	}
+
+	_addrs.push_back(addr);
+}
+
+void source_address_pool::add_range(const address &first, size_t count) {
+	struct sockaddr_storage ss = first.get_sockaddr();
+	unsigned char *bytes;
+	size_t len;
+	if( first.is_ipv4() ) {
+		bytes = reinterpret_cast<unsigned char*>(&reinterpret_cast<struct sockaddr_in*>(&ss)->sin_addr);
+		len = sizeof(struct in_addr);
+	}
+	else {
+		bytes = reinterpret_cast<unsigned char*>(&reinterpret_cast<struct sockaddr_in6*>(&ss)->sin6_addr);
+		len = sizeof(struct in6_addr);
+	}
+
+	for( size_t i = 0; i < count; ++i ) {
+		add(address(ss));
+		// Increment the address in network byte order
+		for( size_t b = len; (b > 0) && (++bytes[b-1] == 0); --b ) {}
+	}
+}
+
+const address& source_address_pool::get(size_t i) const {
+	if( i >= _addrs.size() ) {
+		throw std::out_of_range("source_address_pool::get(): Index out of range");
+	}
+
+	return _addrs[i];
+}
+
+void source_address_pool::set_local_port_range(uint16_t low, uint16_t high) {
+	if( low > high ) {
+		throw std::invalid_argument("source_address_pool::set_local_port_range(): Low port above high port");
+	}
+
+	_port_range = (static_cast<uint32_t>(high) << 16) | low;
+}
+
+const address& source_address_pool::next(int af) {
+	// With a single family in the pool the first candidate always matches
+	for( size_t tries = 0; tries < _addrs.size(); ++tries ) {
+		const address &a = _addrs[_next++ % _addrs.size()];
+		if( a.get_sockaddr().ss_family == af ) {
+			return a;
+		}
+	}
+
+	throw std::runtime_error("source_address_pool::next(): No address of the requested family");
+}
+
+bool source_address_pool::has_family(int af) const {
+	for( const auto &a : _addrs ) {
+		if( a.get_sockaddr().ss_family == af ) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+} // namespace network_socket
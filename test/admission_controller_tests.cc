@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <chrono>
+#include "admission_controller.h"
+
+using std::invalid_argument;
+using std::unique_ptr;
+using std::string;
+using network_socket::net_socket;
+using network_socket::admission_controller;
+using network_socket::socket_timestamp;
+using network_socket::timeout_exception;
+using std::chrono::milliseconds;
+
+TEST( AdmissionController, ConstructorTests ) {
+	admission_controller ac;
+	EXPECT_EQ(ac.get_target(), milliseconds(5));
+	EXPECT_EQ(ac.get_interval(), milliseconds(100));
+	EXPECT_FALSE(ac.is_overloaded());
+	EXPECT_EQ(ac.get_statistics().admitted, 0);
+	EXPECT_EQ(ac.get_statistics().shed, 0);
+
+	EXPECT_THROW(admission_controller(milliseconds(0)), invalid_argument);
+	EXPECT_THROW(admission_controller(milliseconds(10), milliseconds(5)), invalid_argument);
+
+	// Work without a receive timestamp is admitted
+	socket_timestamp ts{};
+	EXPECT_TRUE(ac.admit(ts));
+	EXPECT_TRUE(ac.admit(admission_controller::clock::now()));
+}
+
+TEST( AdmissionController, SheddingTests ) {
+	admission_controller ac(milliseconds(5), milliseconds(100));
+	auto t0 = admission_controller::clock::now();
+
+	// A short spike is tolerated; only very stale work is shed
+	EXPECT_TRUE(ac.admit(milliseconds(1), t0));
+	EXPECT_TRUE(ac.admit(milliseconds(50), t0 + milliseconds(10)));
+	EXPECT_FALSE(ac.admit(milliseconds(150), t0 + milliseconds(20)));
+	EXPECT_FALSE(ac.is_overloaded());
+
+	// A standing queue for a whole interval
+	for( int i = 0; i < 10; ++i ) {
+		EXPECT_TRUE(ac.admit(milliseconds(20), t0 + milliseconds(100 + 10*i)));
+	}
+	EXPECT_FALSE(ac.is_overloaded());
+
+	// ... sheds everything over the target in the next interval
+	EXPECT_FALSE(ac.admit(milliseconds(20), t0 + milliseconds(200)));
+	EXPECT_TRUE(ac.is_overloaded());
+	EXPECT_FALSE(ac.admit(milliseconds(6), t0 + milliseconds(210)));
+	EXPECT_TRUE(ac.admit(milliseconds(3), t0 + milliseconds(220)));
+
+	// The queue drained below target, so the overload is over
+	EXPECT_TRUE(ac.admit(milliseconds(20), t0 + milliseconds(300)));
+	EXPECT_FALSE(ac.is_overloaded());
+
+	// An interval without work is not an overload
+	EXPECT_TRUE(ac.admit(milliseconds(20), t0 + milliseconds(1000)));
+	EXPECT_FALSE(ac.is_overloaded());
+
+	auto st = ac.get_statistics();
+	EXPECT_EQ(st.admitted, 15);
+	EXPECT_EQ(st.shed, 3);
+	EXPECT_EQ(st.overloaded_intervals, 1);
+}
+
+TEST( AdmissionController, AcceptTests ) {
+	unsigned short port = 5000 + std::chrono::system_clock::now().time_since_epoch().count()%45000;
+	net_socket server;
+	server.listen("127.0.0.1", port);
+	admission_controller ac(milliseconds(5), milliseconds(20));
+	ac.set_rejection_handler([](net_socket &s) {s.send("busy");});
+
+	// The first connection waits in the accept queue for too long
+	net_socket stale, fresh;
+	stale.connect("127.0.0.1", port);
+	std::this_thread::sleep_for(milliseconds(100));
+	fresh.connect("127.0.0.1", port);
+	unique_ptr<net_socket> worker = ac.accept(server);
+	EXPECT_EQ(worker->get_remote_address(), fresh.get_local_address());
+	EXPECT_LT(admission_controller::connection_sojourn(*worker), milliseconds(20));
+
+	auto st = ac.get_statistics();
+	EXPECT_EQ(st.shed, 1);
+	EXPECT_EQ(st.admitted, 1);
+
+	// The shed connection got the fast rejection
+	string msg;
+	stale.set_timeout(1.0);
+	EXPECT_EQ(stale.recv(msg), 5);
+	EXPECT_EQ(msg, "busy");
+	// Followed by a normal close rather than a reset
+	char c;
+	EXPECT_EQ(stale.recv(&c, 1), 0);
+}
@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include "buffer_arena.h"
+#include "net_socket.h"
+
+using std::unique_ptr;
+using network_socket::net_socket;
+using network_socket::buffer_arena;
+using network_socket::arena_allocator;
+using network_socket::arena_vector;
+
+TEST( BufferArena, AllocateTests ) {
+	buffer_arena arena(1, false);
+	EXPECT_EQ(arena.get_chunk_size(), buffer_arena::huge_page_size);
+	auto st = arena.get_statistics();
+	EXPECT_EQ(st.chunks, 0);
+	EXPECT_EQ(st.huge_pages + st.transparent_huge_pages + st.normal_pages, 0);
+
+	// Blocks are cache-line aligned and freed blocks are reused by size class
+	void *p = arena.allocate(100);
+	void *q = arena.allocate(1);
+	EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % buffer_arena::min_block_size, 0);
+	EXPECT_EQ(reinterpret_cast<uintptr_t>(q) % buffer_arena::min_block_size, 0);
+	EXPECT_NE(p, q);
+	memset(p, 0xa5, 100);
+	arena.deallocate(p, 100);
+	EXPECT_EQ(arena.allocate(128), p);
+
+	st = arena.get_statistics();
+	EXPECT_EQ(st.chunks, 1);
+	EXPECT_EQ(st.huge_pages, 0);
+	EXPECT_EQ(st.transparent_huge_pages + st.normal_pages, buffer_arena::huge_page_size);
+
+	// Large blocks get their own regions
+	void *big = arena.allocate(buffer_arena::huge_page_size);
+	st = arena.get_statistics();
+	EXPECT_EQ(st.large_blocks, 1);
+	EXPECT_EQ(st.transparent_huge_pages + st.normal_pages, 2*buffer_arena::huge_page_size);
+	memset(big, 0, buffer_arena::huge_page_size);
+	arena.deallocate(big, buffer_arena::huge_page_size);
+	st = arena.get_statistics();
+	EXPECT_EQ(st.large_blocks, 0);
+	EXPECT_EQ(st.transparent_huge_pages + st.normal_pages, buffer_arena::huge_page_size);
+
+	// Each thread has its own sub-arena
+	void *other = nullptr;
+	std::thread t([&arena, &other]() {other = arena.allocate(64);});
+	t.join();
+	EXPECT_EQ(arena.get_statistics().chunks, 2);
+	EXPECT_NE(other, nullptr);
+}
+
+TEST( BufferArena, RemoteFreeTests ) {
+	buffer_arena arena(16 << 20, false);
+	std::vector<void*> blocks;
+
+	// Blocks freed by another thread go back to the allocating one
+	for( int round = 0; round < 200; ++round ) {
+		for( int i = 0; i < 100; ++i ) {
+			void *p = arena.allocate(16 << 10);
+			memset(p, round, 16 << 10);
+			blocks.push_back(p);
+		}
+		std::thread t([&arena, &blocks]() {
+			for( void *p : blocks ) {
+				arena.deallocate(p, 16 << 10);
+			}
+		});
+		t.join();
+		blocks.clear();
+	}
+	EXPECT_EQ(arena.get_statistics().chunks, 1);
+
+	// and are reused in any order
+	void *p = arena.allocate(16 << 10);
+	std::thread t([&arena, p]() {arena.deallocate(p, 16 << 10);});
+	t.join();
+	void *q = arena.allocate(16 << 10);
+	arena.deallocate(q, 16 << 10);
+	EXPECT_EQ(arena.get_statistics().chunks, 1);
+}
+
+TEST( BufferArena, ThreadExitTests ) {
+	buffer_arena arena(1, false);
+
+	// A new thread adopts the sub-arena of one that exited
+	void *kept = nullptr;
+	std::thread t([&arena, &kept]() {kept = arena.allocate(64);});
+	t.join();
+	void *next = nullptr;
+	t = std::thread([&arena, &next]() {next = arena.allocate(64);});
+	t.join();
+	EXPECT_EQ(arena.get_statistics().chunks, 1);
+	EXPECT_EQ(static_cast<char*>(next), static_cast<char*>(kept) + 64);
+	arena.deallocate(kept, 64);
+	arena.deallocate(next, 64);
+
+	// so short-lived threads don't take a chunk each
+	for( int round = 0; round < 50; ++round ) {
+		std::vector<std::thread> threads;
+		for( int i = 0; i < 4; ++i ) {
+			threads.emplace_back([&arena]() {
+				void *p = arena.allocate(1000);
+				memset(p, 0, 1000);
+				arena.deallocate(p, 1000);
+			});
+		}
+		for( auto &th : threads ) {
+			th.join();
+		}
+	}
+	EXPECT_LE(arena.get_statistics().chunks, 4);
+}
+
+TEST( BufferArena, AllocatorTests ) {
+	buffer_arena arena;
+	arena_vector<uint32_t> v{arena_allocator<uint32_t>(arena)};
+	for( uint32_t i = 0; i < 100000; ++i ) {
+		v.push_back(i);
+	}
+	EXPECT_EQ(v[99999], 99999);
+	EXPECT_EQ(v.get_allocator(), arena_allocator<char>(arena));
+	EXPECT_FALSE(v.get_allocator() == arena_allocator<uint32_t>());
+	EXPECT_EQ(&arena_vector<char>().get_allocator().get_arena(), &buffer_arena::global());
+
+	// net_socket sends and receives arena vectors
+	net_socket server, client;
+	server.listen("127.0.0.1", 0);
+	client.connect(server.get_local_address());
+	unique_ptr<net_socket> worker = server.accept();
+	arena_vector<char> out(1000, 'a');
+	EXPECT_EQ(client.send_all(out), 1000);
+	arena_vector<char> in{arena_allocator<char>(arena)};
+	EXPECT_EQ(worker->recv_all(in, 1000), 1000);
+	EXPECT_EQ(in, arena_vector<char>(1000, 'a'));
+}
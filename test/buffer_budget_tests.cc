@@ -0,0 +1,177 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <fstream>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/capability.h>
+#include "buffer_budget.h"
+#include "net_socket.h"
+
+using std::unique_ptr;
+using std::string;
+using network_socket::net_socket;
+using network_socket::buffer_budget;
+using network_socket::buffer_budget_statistics;
+
+namespace {
+
+int get_rcvbuf(const net_socket &s) {
+	int size = 0;
+	socklen_t len = sizeof(size);
+	getsockopt(s.get_socket_descriptor(), SOL_SOCKET, SO_RCVBUF, &size, &len);
+	return size;
+}
+
+// Drop CAP_NET_ADMIN from the calling thread only
+void drop_net_admin() {
+	struct __user_cap_header_struct hdr{_LINUX_CAPABILITY_VERSION_3, 0};
+	struct __user_cap_data_struct data[2]{};
+	syscall(SYS_capget, &hdr, data);
+	data[CAP_NET_ADMIN/32].effective &= ~(1u << (CAP_NET_ADMIN % 32));
+	syscall(SYS_capset, &hdr, data);
+}
+
+} // namespace
+
+TEST( BufferBudget, MemoryInfoTests ) {
+	net_socket server, client;
+	EXPECT_THROW(client.get_memory_info(), std::runtime_error);
+	server.listen("127.0.0.1", 0);
+	client.connect(server.get_local_address());
+	unique_ptr<net_socket> worker = server.accept();
+
+	string data(10000, 'm');
+	client.send_all(data.data(), data.size());
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	net_socket::memory_info m = worker->get_memory_info();
+	EXPECT_EQ(m.sockets, 1);
+	EXPECT_GT(m.rmem_alloc, 0);
+	EXPECT_EQ(m.rcvbuf, get_rcvbuf(*worker));
+	EXPECT_GT(m.sndbuf, 0);
+	EXPECT_GE(m.get_total(), m.rmem_alloc);
+
+	EXPECT_EQ(net_socket::get_memory_info(worker->get_socket_descriptor()).rcvbuf, m.rcvbuf);
+	EXPECT_THROW(net_socket::get_memory_info(-1), std::runtime_error);
+
+	net_socket::memory_info all = net_socket::get_process_memory_info();
+	EXPECT_GE(all.sockets, 3);
+	EXPECT_GE(all.rmem_alloc, m.rmem_alloc);
+	EXPECT_GE(all.rcvbuf, m.rcvbuf + get_rcvbuf(client));
+}
+
+TEST( BufferBudget, ShrinkRestoreTests ) {
+	net_socket server, client, unconnected;
+	server.listen("127.0.0.1", 0);
+	client.connect(server.get_local_address());
+	unique_ptr<net_socket> worker = server.accept();
+
+	buffer_budget budget(0, std::chrono::milliseconds(50));
+	EXPECT_THROW(budget.add(unconnected), std::invalid_argument);
+	budget.add(client);
+	budget.add(*worker);
+	client.send_all("x", 1);
+	char c;
+	worker->recv(&c, 1);
+
+	// Active connections keep their buffers
+	buffer_budget_statistics st = budget.check();
+	EXPECT_EQ(st.sockets, 2);
+	EXPECT_EQ(st.shrunk, 0);
+	EXPECT_GT(st.buffer_limits, 0);
+	int rcvbuf = get_rcvbuf(*worker);
+
+	// Idle ones are shrunk to meet the budget
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	st = budget.check();
+	EXPECT_EQ(st.shrunk, 2);
+	EXPECT_EQ(st.shrinks, 2);
+	EXPECT_LT(get_rcvbuf(*worker), rcvbuf);
+
+	// and restored once active again
+	client.send_all("y", 1);
+	worker->recv(&c, 1);
+	st = budget.check();
+	EXPECT_EQ(st.shrunk, 0);
+	EXPECT_EQ(st.restores, 2);
+	EXPECT_EQ(get_rcvbuf(*worker), rcvbuf);
+
+	// A generous budget leaves idle connections alone
+	buffer_budget loose(1ull << 40, std::chrono::milliseconds(0));
+	loose.add(*worker);
+	EXPECT_EQ(loose.check().shrunk, 0);
+
+	// Closed sockets are dropped
+	worker->close();
+	EXPECT_EQ(budget.check().sockets, 1);
+	budget.remove(client);
+	EXPECT_EQ(budget.get_statistics().sockets, 0);
+}
+
+TEST( BufferBudget, ClosedSocketTests ) {
+	net_socket server, client, client2;
+	server.listen("127.0.0.1", 0);
+	client.connect(server.get_local_address());
+	client2.connect(server.get_local_address());
+	buffer_budget budget(0, std::chrono::milliseconds(0));
+
+	// Sockets destroyed without being removed are dropped
+	{
+		unique_ptr<net_socket> worker = server.accept();
+		budget.add(*worker);
+		EXPECT_EQ(budget.check().sockets, 1);
+	}
+	EXPECT_EQ(budget.check().sockets, 0);
+
+	// as are descriptors reused by another socket since
+	unique_ptr<net_socket> worker = server.accept();
+	int fd = worker->get_socket_descriptor();
+	budget.add(*worker);
+	worker->close();
+	net_socket other;
+	other.connect(server.get_local_address());
+	ASSERT_EQ(other.get_socket_descriptor(), fd);
+	int rcvbuf = get_rcvbuf(other);
+	uint64_t shrinks = budget.get_statistics().shrinks;
+	buffer_budget_statistics st = budget.check();
+	EXPECT_EQ(st.sockets, 0);
+	EXPECT_EQ(st.shrinks, shrinks);
+	EXPECT_EQ(get_rcvbuf(other), rcvbuf);
+}
+
+TEST( BufferBudget, CappedRestoreTests ) {
+	net_socket server, client;
+	server.listen("127.0.0.1", 0);
+	client.connect(server.get_local_address());
+	unique_ptr<net_socket> worker = server.accept();
+
+	// A buffer beyond the system maximum, as forced by a privileged process
+	int rmem_max = 0;
+	std::ifstream("/proc/sys/net/core/rmem_max") >> rmem_max;
+	int size = 2*rmem_max;
+	if( setsockopt(worker->get_socket_descriptor(), SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) == -1 ) {
+		GTEST_SKIP() << "Forcing buffer sizes requires CAP_NET_ADMIN";
+	}
+
+	buffer_budget budget(0, std::chrono::milliseconds(50));
+	budget.add(*worker);
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	EXPECT_EQ(budget.check().shrinks, 1);
+
+	// is only restored to the maximum without the capability
+	client.send_all("x", 1);
+	char c;
+	worker->recv(&c, 1);
+	buffer_budget_statistics st;
+	std::thread t([&budget, &st]() {
+		drop_net_admin();
+		st = budget.check();
+	});
+	t.join();
+	EXPECT_EQ(st.shrunk, 0);
+	EXPECT_EQ(st.restores, 0);
+	EXPECT_EQ(st.failed_restores, 1);
+	EXPECT_EQ(get_rcvbuf(*worker), 2*rmem_max);
+}
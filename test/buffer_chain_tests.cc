@@ -0,0 +1,146 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "buffer_chain.h"
+#include "buffer_arena.h"
+#include "net_socket.h"
+
+using std::string;
+using std::unique_ptr;
+using network_socket::net_socket;
+using network_socket::buffer_chain;
+using network_socket::buffer_arena;
+using network_socket::timeout_exception;
+
+namespace {
+
+string to_string(const buffer_chain &chain) {
+	string ret(chain.size(), '\0');
+	chain.copy_to(ret.data(), 0, chain.size());
+	return ret;
+}
+
+} // namespace
+
+TEST( BufferChain, EditTests ) {
+	buffer_chain chain("world", 5);
+	EXPECT_EQ(chain.size(), 5);
+	EXPECT_EQ(chain.get_segment_count(), 1);
+	chain.prepend("hello ", 6);
+	chain.append("!", 1);
+	EXPECT_EQ(to_string(chain), "hello world!");
+	// The appended byte fills the room after "world"
+	EXPECT_EQ(chain.get_segment_count(), 2);
+
+	// Slices share the blocks
+	buffer_chain word = chain.slice(6, 5);
+	EXPECT_EQ(to_string(word), "world");
+	EXPECT_EQ(word.get_segment(0).data(), chain.get_segment(1).data());
+	EXPECT_THROW(chain.slice(6, 7), std::out_of_range);
+
+	// Shared blocks are not written by appends
+	word.append("s", 1);
+	EXPECT_EQ(to_string(word), "worlds");
+	EXPECT_EQ(word.get_segment_count(), 2);
+	EXPECT_EQ(to_string(chain), "hello world!");
+
+	buffer_chain head = chain.split(6);
+	EXPECT_EQ(to_string(head), "hello ");
+	EXPECT_EQ(to_string(chain), "world!");
+	chain.prepend(head);
+	chain.append(chain);
+	EXPECT_EQ(to_string(chain), "hello world!hello world!");
+	chain.trim_front(7);
+	chain.trim_back(8);
+	EXPECT_EQ(to_string(chain), "orld!hell");
+	EXPECT_EQ(chain.get_iovecs().size(), chain.get_segment_count());
+
+	char part[3];
+	chain.copy_to(part, 4, 3);
+	EXPECT_EQ(string(part, 3), "!he");
+	EXPECT_THROW(chain.copy_to(part, 8, 3), std::out_of_range);
+	EXPECT_THROW(chain.trim_front(10), std::out_of_range);
+	chain.clear();
+	EXPECT_TRUE(chain.empty());
+	EXPECT_EQ(chain.get_segment_count(), 0);
+}
+
+TEST( BufferChain, PrepareTests ) {
+	buffer_chain chain;
+	std::span<char> room = chain.prepare(10);
+	EXPECT_GE(room.size(), buffer_chain::default_block_size);
+	memcpy(room.data(), "abc", 3);
+	chain.commit(3);
+	EXPECT_EQ(to_string(chain), "abc");
+	EXPECT_THROW(chain.commit(room.size()), std::out_of_range);
+
+	// Unused room is dropped
+	room = chain.prepare(2*buffer_chain::default_block_size);
+	EXPECT_GE(room.size(), 2*buffer_chain::default_block_size);
+	EXPECT_EQ(chain.get_segment_count(), 2);
+	chain.commit(0);
+	EXPECT_EQ(chain.get_segment_count(), 1);
+
+	string big(3*buffer_chain::default_block_size, 'x');
+	chain.append(big.data(), big.size());
+	EXPECT_EQ(chain.size(), big.size() + 3);
+	EXPECT_EQ(to_string(chain), "abc" + big);
+}
+
+TEST( BufferChain, HandoffTests ) {
+	// Chains filled on one thread and released on another, as a receiving
+	// thread hands them to a worker
+	uint64_t chunks = buffer_arena::global().get_statistics().chunks;
+	const string data(buffer_chain::default_block_size, 'h');
+	for( int round = 0; round < 200; ++round ) {
+		std::vector<buffer_chain> chains(100);
+		for( auto &c : chains ) {
+			c.append(data.data(), data.size());
+		}
+		std::thread worker([moved = std::move(chains)]() mutable {
+			for( auto &c : moved ) {
+				EXPECT_EQ(c.size(), buffer_chain::default_block_size);
+			}
+			moved.clear();
+		});
+		worker.join();
+	}
+
+	// The blocks were reused rather than mapped anew
+	EXPECT_LE(buffer_arena::global().get_statistics().chunks, chunks + 1);
+}
+
+TEST( BufferChain, SocketTests ) {
+	net_socket server, client;
+	server.listen("127.0.0.1", 0);
+	client.connect(server.get_local_address());
+	unique_ptr<net_socket> worker = server.accept();
+
+	// Forward a received payload behind a new header without copying it
+	string payload(40000, 'p');
+	EXPECT_EQ(client.send_all(payload.data(), payload.size()), payload.size());
+	buffer_chain in;
+	EXPECT_EQ(worker->recv_all(in, payload.size()), payload.size());
+	EXPECT_EQ(to_string(in), payload);
+	buffer_chain out = in;
+	out.prepend("HDR:", 4);
+	out.append(in);
+	EXPECT_EQ(worker->send_all(out), out.size());
+
+	string expected = "HDR:" + payload + payload;
+	string got(expected.size(), '\0');
+	EXPECT_EQ(client.recv_all(got.data(), got.size()), got.size());
+	EXPECT_EQ(got, expected);
+
+	// Partial data is kept on timeout
+	worker->set_timeout(0.1);
+	client.send_all("abc", 3);
+	buffer_chain partial;
+	EXPECT_THROW(worker->recv_all(partial, 10), timeout_exception);
+	EXPECT_EQ(to_string(partial), "abc");
+
+	client.send_all("de", 2);
+	EXPECT_EQ(worker->recv(partial), 2);
+	EXPECT_EQ(to_string(partial), "abcde");
+}
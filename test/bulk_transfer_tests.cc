@@ -0,0 +1,219 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <unistd.h>
+#include <endian.h>
+#include <cstring>
+#include "bulk_transfer.h"
+
+using std::runtime_error;
+using std::invalid_argument;
+using std::thread;
+using std::string;
+using std::vector;
+using network_socket::bulk_sender;
+using network_socket::bulk_receiver;
+using network_socket::address;
+using network_socket::net_socket;
+
+static unsigned short get_random_bulk_port() {
+	return 5000 + std::chrono::system_clock::now().time_since_epoch().count()%45000;
+}
+
+static vector<char> make_data(size_t size) {
+	vector<char> data(size);
+	for( size_t i = 0; i < size; ++i ) {
+		data[i] = static_cast<char>((i * 2654435761u) >> 13);
+	}
+	return data;
+}
+
+// Hand-written sender messages, for peers that misbehave
+static string make_hello(uint32_t index, uint32_t count, uint64_t total) {
+	uint32_t h[3] = {htobe32(0x4e534254), htobe32(index), htobe32(count)};
+	uint64_t t = htobe64(total);
+	string ret(reinterpret_cast<char*>(h), sizeof(h));
+	return ret.append(reinterpret_cast<char*>(&t), sizeof(t));
+}
+
+static string make_chunk(uint64_t offset, const string &data) {
+	uint64_t o = htobe64(offset);
+	uint32_t l = htobe32(data.size());
+	string ret(reinterpret_cast<char*>(&o), sizeof(o));
+	return ret.append(reinterpret_cast<char*>(&l), sizeof(l)).append(data);
+}
+
+TEST( BulkTransfer, ConstructorTests ) {
+	EXPECT_THROW(bulk_sender(0), invalid_argument);
+	EXPECT_THROW(bulk_sender(1, 0), invalid_argument);
+
+	bulk_sender tx(3, 1000);
+	EXPECT_EQ(tx.get_connection_count(), 3);
+	EXPECT_EQ(tx.get_chunk_size(), 1000);
+	EXPECT_FALSE(tx.is_connected());
+	EXPECT_THROW(tx.send("x", 1), runtime_error);
+
+	bulk_receiver rx;
+	EXPECT_FALSE(rx.is_passively_opened());
+	vector<char> data;
+	EXPECT_THROW(rx.receive(data), runtime_error);
+	EXPECT_THROW(rx.set_timeout(-1), invalid_argument);
+	EXPECT_EQ(rx.get_max_connections(), 64);
+	EXPECT_THROW(rx.set_max_connections(0), invalid_argument);
+	rx.set_max_connections(8);
+	EXPECT_EQ(rx.get_max_connections(), 8);
+	EXPECT_EQ(rx.get_max_size(), 1ull << 32);
+	rx.set_max_size(1000);
+	EXPECT_EQ(rx.get_max_size(), 1000);
+}
+
+TEST( BulkTransfer, MalformedTransferTests ) {
+	bulk_receiver rx;
+	rx.set_timeout(5.0);
+	rx.set_max_connections(8);
+	rx.listen("127.0.0.1", 0);
+	vector<char> data;
+
+	// Announcing more connections than allowed
+	{
+		net_socket tx;
+		tx.connect(rx.get_local_address());
+		tx.send_all(make_hello(0, 100000, 10));
+		EXPECT_THROW(rx.receive(data), runtime_error);
+	}
+
+	// Announcing more data than allowed, before anything is allocated
+	rx.set_max_size(1 << 20);
+	{
+		net_socket tx;
+		tx.connect(rx.get_local_address());
+		tx.send_all(make_hello(0, 1, 1ull << 62));
+		EXPECT_THROW(rx.receive(data), runtime_error);
+		EXPECT_TRUE(data.empty());
+	}
+
+	// Opening fewer connections than announced
+	rx.set_timeout(0.2);
+	{
+		net_socket tx;
+		tx.connect(rx.get_local_address());
+		tx.send_all(make_hello(0, 2, 10) + make_chunk(0, "abcdefghij") + make_chunk(0, ""));
+		EXPECT_THROW(rx.receive(data), network_socket::timeout_exception);
+	}
+	rx.set_timeout(5.0);
+
+	// Sending part of the data twice
+	{
+		net_socket tx;
+		tx.connect(rx.get_local_address());
+		tx.send_all(make_hello(0, 1, 10) + make_chunk(0, "abcdef") + make_chunk(4, "efghij"));
+		EXPECT_THROW(rx.receive(data), runtime_error);
+	}
+
+	// Leaving a gap
+	{
+		net_socket tx;
+		tx.connect(rx.get_local_address());
+		tx.send_all(make_hello(0, 1, 10) + make_chunk(0, "abcd") + make_chunk(6, "ghij") + make_chunk(0, ""));
+		EXPECT_THROW(rx.receive(data), runtime_error);
+	}
+
+	// Chunks in any order
+	{
+		net_socket tx;
+		tx.connect(rx.get_local_address());
+		tx.send_all(make_hello(0, 1, 10) + make_chunk(6, "ghij") + make_chunk(0, "abc")
+			+ make_chunk(3, "def") + make_chunk(0, ""));
+		EXPECT_EQ(rx.receive(data), 10);
+		EXPECT_EQ(string(data.begin(), data.end()), "abcdefghij");
+	}
+}
+
+TEST( BulkTransfer, BufferTransferTests ) {
+	unsigned short port = get_random_bulk_port();
+	bulk_receiver rx;
+	rx.set_timeout(5.0);
+	rx.listen("127.0.0.1", port);
+
+	// Size not a multiple of the chunk size
+	const vector<char> sent = make_data(1000003);
+	vector<char> received;
+	uint64_t last_progress = 0;
+	int progress_calls = 0;
+	rx.set_progress_handler([&](uint64_t done, uint64_t total) {
+		EXPECT_GT(done, last_progress);
+		EXPECT_EQ(total, sent.size());
+		last_progress = done;
+		++progress_calls;
+	});
+	thread rt([&rx, &received]() {
+		EXPECT_EQ(rx.receive(received), 1000003);
+	});
+
+	bulk_sender tx(4, 4096);
+	address a, b;
+	a.set_address("127.0.0.2");
+	b.set_address("127.0.0.3");
+	tx.set_source_addresses({a, b});
+	tx.connect("127.0.0.1", port);
+	EXPECT_TRUE(tx.is_connected());
+	EXPECT_THROW(tx.set_source_addresses({}), runtime_error);
+	EXPECT_EQ(tx.send(sent), sent.size());
+	EXPECT_FALSE(tx.is_connected());
+	EXPECT_EQ(tx.get_bytes_transferred(), sent.size());
+
+	rt.join();
+	EXPECT_EQ(received, sent);
+	EXPECT_EQ(rx.get_bytes_transferred(), sent.size());
+	EXPECT_EQ(last_progress, sent.size());
+	EXPECT_EQ(progress_calls, (sent.size()+4095)/4096);
+
+	// The receiver can take another transfer, including an empty one
+	thread rt2([&rx, &received]() {
+		EXPECT_EQ(rx.receive(received), 0);
+	});
+	tx.connect("127.0.0.1", port);
+	EXPECT_EQ(tx.send(nullptr, 0), 0);
+	rt2.join();
+	EXPECT_TRUE(received.empty());
+}
+
+TEST( BulkTransfer, FileTransferTests ) {
+	char src_path[] = "/tmp/bulk_src_XXXXXX";
+	char dst_path[] = "/tmp/bulk_dst_XXXXXX";
+	int fd = mkstemp(src_path);
+	ASSERT_NE(fd, -1);
+	::close(fd);
+	fd = mkstemp(dst_path);
+	ASSERT_NE(fd, -1);
+	::close(fd);
+
+	const vector<char> sent = make_data(300000);
+	{
+		std::ofstream out(src_path, std::ios::binary);
+		out.write(sent.data(), sent.size());
+	}
+
+	unsigned short port = get_random_bulk_port();
+	bulk_receiver rx;
+	rx.set_timeout(5.0);
+	rx.listen(port);
+	thread rt([&rx, &dst_path]() {
+		EXPECT_EQ(rx.receive_file(dst_path), 300000);
+	});
+
+	bulk_sender tx(3, 65536);
+	tx.connect("localhost", port);
+	EXPECT_EQ(tx.send_file(src_path), sent.size());
+	rt.join();
+
+	std::ifstream in(dst_path, std::ios::binary);
+	vector<char> received((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	EXPECT_EQ(received, sent);
+
+	EXPECT_THROW(tx.send_file("/nonexistent/file"), runtime_error);
+	unlink(src_path);
+	unlink(dst_path);
+}
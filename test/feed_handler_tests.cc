@@ -0,0 +1,238 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <random>
+#include <chrono>
+#include <endian.h>
+#include "feed_handler.h"
+
+using std::invalid_argument;
+using std::unique_ptr;
+using std::thread;
+using std::string;
+using std::vector;
+using network_socket::net_socket;
+using network_socket::multicast_socket;
+using network_socket::datagram_batch;
+using network_socket::feed_handler;
+using network_socket::timeout_exception;
+
+typedef feed_handler::line line;
+
+// Messages are an 8-byte big-endian sequence number and a one byte payload
+struct message {
+	uint64_t seq;
+	char payload;
+};
+
+static message make_message(uint64_t seq) {
+	return message{htobe64(seq), static_cast<char>('a' + seq%26)};
+}
+
+class FeedHandler : public ::testing::Test {
+protected:
+	vector<uint64_t> delivered;
+	feed_handler fh{8, sizeof(message), feed_handler::big_endian_u64(),
+		[this](uint64_t seq, const char *data, size_t size) {
+			ASSERT_EQ(size, sizeof(message));
+			EXPECT_EQ(data[8], static_cast<char>('a' + seq%26));
+			delivered.push_back(seq);
+		}};
+
+	void send(line l, uint64_t seq) {
+		message m = make_message(seq);
+		fh.on_message(l, reinterpret_cast<const char*>(&m), sizeof(m));
+	}
+
+	vector<uint64_t> range(uint64_t first, uint64_t last) {
+		vector<uint64_t> ret;
+		for( uint64_t s = first; s <= last; ++s ) {
+			ret.push_back(s);
+		}
+		return ret;
+	}
+};
+
+TEST_F( FeedHandler, ConstructorTests ) {
+	EXPECT_EQ(fh.get_window(), 8);
+	EXPECT_EQ(fh.get_max_message_size(), sizeof(message));
+	EXPECT_FALSE(fh.has_gap());
+
+	auto extract = feed_handler::big_endian_u64();
+	auto deliver = [](uint64_t, const char*, size_t) {};
+	EXPECT_THROW(feed_handler f(0, 10, extract, deliver), invalid_argument);
+	EXPECT_THROW(feed_handler f(10, 0, extract, deliver), invalid_argument);
+	EXPECT_THROW(feed_handler f(10, 10, nullptr, deliver), invalid_argument);
+	EXPECT_THROW(feed_handler f(10, 10, extract, nullptr), invalid_argument);
+}
+
+TEST_F( FeedHandler, ArbitrationTests ) {
+	// Synchronize to the first message and drop duplicates from the other line
+	for( uint64_t s = 100; s < 105; ++s ) {
+		send(line::A, s);
+		send(line::B, s);
+	}
+	// B is ahead for a while
+	for( uint64_t s = 105; s < 110; ++s ) {
+		send(line::B, s);
+		send(line::A, s);
+	}
+
+	EXPECT_EQ(delivered, range(100, 109));
+	EXPECT_EQ(fh.get_expected_sequence(), 110);
+	EXPECT_EQ(fh.get_highest_sequence(), 109);
+	EXPECT_FALSE(fh.has_gap());
+	const auto &st = fh.get_statistics();
+	EXPECT_EQ(st.delivered, 10);
+	EXPECT_EQ(st.duplicates, 10);
+	EXPECT_EQ(st.first_on_a, 5);
+	EXPECT_EQ(st.first_on_b, 5);
+	EXPECT_EQ(st.gaps, 0);
+
+	// Malformed messages are counted and ignored
+	char shrt[4] = {};
+	fh.on_message(line::A, shrt, sizeof(shrt));
+	EXPECT_EQ(st.malformed, 1);
+}
+
+TEST_F( FeedHandler, GapFilledByOtherLineTests ) {
+	send(line::A, 1);
+	send(line::A, 2);
+	// A loses 3 and 4
+	send(line::A, 5);
+	send(line::A, 6);
+	EXPECT_TRUE(fh.has_gap());
+	EXPECT_EQ(delivered, range(1, 2));
+	EXPECT_EQ(fh.get_statistics().gaps, 2);
+
+	send(line::B, 3);
+	EXPECT_EQ(delivered, range(1, 3));
+	send(line::B, 4);
+	EXPECT_EQ(delivered, range(1, 6));
+	EXPECT_FALSE(fh.has_gap());
+
+	// Late copies are duplicates
+	send(line::B, 5);
+	send(line::B, 6);
+	const auto &st = fh.get_statistics();
+	EXPECT_EQ(st.duplicates, 2);
+	EXPECT_EQ(st.recovered, 2);
+	EXPECT_EQ(st.first_on_b, 2);
+	EXPECT_EQ(st.lost, 0);
+}
+
+TEST_F( FeedHandler, SkipAndWindowOverflowTests ) {
+	send(line::A, 10);
+	send(line::A, 12);
+	send(line::A, 13);
+	fh.skip_gap();
+	EXPECT_EQ(delivered, (vector<uint64_t>{10, 12, 13}));
+	EXPECT_EQ(fh.get_statistics().lost, 1);
+
+	// 14 never arrives; 15 through 21 fill the window, and 22 forces 14 out
+	for( uint64_t s = 15; s <= 21; ++s ) {
+		send(line::A, s);
+	}
+	EXPECT_EQ(delivered.size(), 3);
+	send(line::B, 22);
+	EXPECT_EQ(delivered.back(), 22);
+	EXPECT_EQ(delivered.size(), 3+8);
+	EXPECT_EQ(fh.get_statistics().lost, 2);
+	EXPECT_EQ(fh.get_statistics().gaps, 2);
+
+	// A message far ahead of the window
+	send(line::A, 100);
+	EXPECT_EQ(delivered.back(), 22);
+	EXPECT_EQ(fh.get_expected_sequence(), 93);
+	EXPECT_EQ(fh.get_statistics().lost, 2+(93-23));
+	EXPECT_EQ(fh.get_statistics().gaps, 2+(100-23));
+
+	// Move forward explicitly, delivering what's held
+	fh.set_expected_sequence(101);
+	EXPECT_EQ(delivered.back(), 100);
+	EXPECT_EQ(fh.get_statistics().lost, 2+(100-23));
+	EXPECT_FALSE(fh.has_gap());
+	EXPECT_THROW(fh.set_expected_sequence(50), invalid_argument);
+}
+
+TEST_F( FeedHandler, RetransmissionRequestTests ) {
+	unsigned short port = 5000 + std::chrono::system_clock::now().time_since_epoch().count()%45000;
+	net_socket server;
+	server.listen("localhost", port);
+	vector<uint64_t> requests;
+	thread st([&server, &requests]() {
+		unique_ptr<net_socket> worker = server.accept();
+		worker->set_timeout(1.0);
+		uint64_t req[2];
+		try {
+			while( worker->recv_all(req, sizeof(req)) == sizeof(req) ) {
+				requests.push_back(be64toh(req[0]));
+				requests.push_back(be64toh(req[1]));
+			}
+		}
+		catch( timeout_exception& ) {}
+	});
+
+	net_socket recovery;
+	recovery.connect("localhost", port);
+
+	fh.set_expected_sequence(1);
+	send(line::A, 1);
+	send(line::A, 4);
+	send(line::A, 5);
+	send(line::A, 7);
+	EXPECT_EQ(fh.request_retransmission(recovery), 3);
+	// Already requested gaps aren't requested again
+	EXPECT_EQ(fh.request_retransmission(recovery), 0);
+	send(line::A, 9);
+	EXPECT_EQ(fh.request_retransmission(recovery), 1);
+
+	// Retransmissions fill the gaps
+	send(line::recovery, 2);
+	send(line::recovery, 3);
+	send(line::recovery, 6);
+	send(line::recovery, 8);
+	EXPECT_EQ(delivered, range(1, 9));
+	EXPECT_EQ(fh.get_statistics().first_on_recovery, 4);
+	recovery.close();
+
+	st.join();
+	EXPECT_EQ(requests, (vector<uint64_t>{2, 2, 6, 1, 8, 1}));
+}
+
+TEST_F( FeedHandler, MulticastPollTests ) {
+	const string group_a("239.255.77.1"), group_b("239.255.77.2");
+	unsigned short port = 5000 + std::chrono::system_clock::now().time_since_epoch().count()%45000;
+	multicast_socket line_a, line_b, tx;
+	line_a.bind(group_a, port);
+	line_a.join(group_a, "127.0.0.1");
+	line_b.bind(group_b, port);
+	line_b.join(group_b, "127.0.0.1");
+	tx.set_interface("127.0.0.1");
+
+	// Each line drops a different third of the messages
+	for( uint64_t s = 0; s < 24; ++s ) {
+		message m = make_message(s);
+		if( s%3 != 2 ) {
+			tx.send_to(&m, sizeof(m), group_a, port);
+		}
+		if( s%3 != 0 ) {
+			tx.send_to(&m, sizeof(m), group_b, port);
+		}
+	}
+
+	// Window large enough to hold all of line A while waiting for line B
+	feed_handler mfh(32, sizeof(message), feed_handler::big_endian_u64(),
+		[this](uint64_t seq, const char*, size_t) {delivered.push_back(seq);});
+	datagram_batch batch(16, 64);
+	try {
+		while( true ) {
+			mfh.poll(line_a, line_b, batch, 0.2);
+		}
+	}
+	catch( timeout_exception& ) {}
+
+	EXPECT_EQ(delivered, range(0, 23));
+	EXPECT_FALSE(mfh.has_gap());
+	EXPECT_EQ(mfh.get_statistics().lost, 0);
+	EXPECT_EQ(mfh.get_statistics().duplicates, 16+16-24);
+}
@@ -0,0 +1,122 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include "listener_set.h"
+
+using std::runtime_error;
+using std::invalid_argument;
+using std::unique_ptr;
+using std::string;
+using std::vector;
+using network_socket::net_socket;
+using network_socket::listener_set;
+using network_socket::timeout_exception;
+using network_socket::address;
+
+static unsigned short get_random_listener_port() {
+	return 5000 + std::chrono::system_clock::now().time_since_epoch().count()%45000;
+}
+
+TEST( ListenerSet, ConstructorTests ) {
+	listener_set ls;
+	EXPECT_TRUE(ls.empty());
+	EXPECT_EQ(ls.size(), 0);
+	EXPECT_EQ(ls.get_backlog(), 5);
+	EXPECT_TRUE(ls.get_v6_only());
+	EXPECT_FALSE(ls.timeout_is_set());
+
+	EXPECT_THROW(ls.accept(), runtime_error);
+	EXPECT_THROW(ls.set_backlog(-1), invalid_argument);
+	EXPECT_THROW(ls.set_timeout(-1), invalid_argument);
+	EXPECT_THROW(ls.get_local_address(0), std::out_of_range);
+	ls.set_timeout(1.5);
+	EXPECT_EQ(ls.get_timeout(), 1.5);
+	ls.clear_timeout();
+	EXPECT_EQ(ls.get_timeout(), 0.0);
+}
+
+TEST( ListenerSet, DualStackTests ) {
+	unsigned short port = get_random_listener_port();
+	listener_set ls;
+	ls.set_timeout(1.0);
+	// IPv4 and IPv6 wildcards on the same port
+	EXPECT_EQ(ls.add(port), 2);
+	vector<address> local = ls.get_local_addresses();
+	ASSERT_EQ(local.size(), 2);
+	EXPECT_NE(local[0].is_ipv4(), local[1].is_ipv4());
+	EXPECT_EQ(local[0].get_port(), port);
+	EXPECT_EQ(local[1].get_port(), port);
+
+	net_socket c4, c6;
+	c4.connect("127.0.0.1", port);
+	c6.connect("::1", port);
+	bool seen4 = false, seen6 = false;
+	for( int i = 0; i < 2; ++i ) {
+		size_t index;
+		unique_ptr<net_socket> worker = ls.accept(&index);
+		ASSERT_TRUE(worker->is_connected());
+		address remote = worker->get_remote_address();
+		EXPECT_EQ(remote.is_ipv4(), ls.get_local_address(index).is_ipv4());
+		(remote.is_ipv4() ? seen4 : seen6) = true;
+	}
+	EXPECT_TRUE(seen4);
+	EXPECT_TRUE(seen6);
+	EXPECT_THROW(ls.accept(), timeout_exception);
+
+	ls.close();
+	EXPECT_TRUE(ls.empty());
+}
+
+TEST( ListenerSet, MultipleAddressTests ) {
+	unsigned short port = get_random_listener_port();
+	listener_set ls;
+	ls.set_timeout(1.0);
+	address a0, a1;
+	a0.set_address("127.0.0.1");
+	a0.set_port(port);
+	a1.set_address("127.0.0.2");
+	a1.set_port(port+1);
+	ls.add(a0);
+	ls.add(a1);
+	EXPECT_EQ(ls.add("::1", port), 1);
+	ASSERT_EQ(ls.size(), 3);
+	EXPECT_EQ(ls.get_local_address(1), a1);
+	// The address is already in use
+	EXPECT_THROW(ls.add(a0), runtime_error);
+
+	// Connections pending on several listeners are served in turn
+	net_socket c0, c1, c2;
+	c0.connect("127.0.0.1", port);
+	c1.connect("127.0.0.2", port+1);
+	c2.connect("::1", port);
+	usleep(20000);
+	vector<size_t> order;
+	for( int i = 0; i < 3; ++i ) {
+		size_t index;
+		ls.accept(&index);
+		order.push_back(index);
+	}
+	EXPECT_EQ(order, (vector<size_t>{0, 1, 2}));
+}
+
+TEST( ListenerSet, V6OnlyTests ) {
+	unsigned short port = get_random_listener_port();
+
+	// An IPv6 wildcard that also takes IPv4 connections
+	listener_set ls;
+	ls.set_timeout(1.0);
+	ls.set_v6_only(false);
+	address any6;
+	any6.set_address("::");
+	any6.set_port(port);
+	ls.add(any6);
+	net_socket c4;
+	c4.connect("127.0.0.1", port);
+	unique_ptr<net_socket> worker = ls.accept();
+	EXPECT_EQ(worker->get_remote_address().get_address().rfind("::ffff:127.0.0.1", 0), 0);
+
+	// The IPv4 wildcard is then taken
+	address any4;
+	any4.set_address("0.0.0.0");
+	any4.set_port(port);
+	EXPECT_THROW(ls.add(any4), runtime_error);
+}
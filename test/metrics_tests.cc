@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include <string>
+#include "metrics.h"
+
+using std::string;
+using std::unique_ptr;
+using network_socket::net_socket;
+using network_socket::metrics_counter;
+using network_socket::metrics_histogram;
+using network_socket::metrics_server;
+using network_socket::get_library_metrics;
+
+static string fetch(const network_socket::address &server, const string &path) {
+	net_socket c;
+	c.connect(server);
+	c.set_timeout(2.0);
+	string request = "GET " + path + " HTTP/1.0\r\n\r\n";
+	c.send_all(request.data(), request.size());
+
+	string response;
+	char buf[4096];
+	ssize_t n;
+	while( c.is_connected() && ((n = c.recv(buf, sizeof(buf))) > 0) ) {
+		response.append(buf, n);
+	}
+
+	return response;
+}
+
+TEST( Metrics, CounterHistogramTests ) {
+	metrics_counter c;
+	std::vector<std::thread> threads;
+	for( int t = 0; t < 8; ++t ) {
+		threads.emplace_back([&c]() {
+			for( int i = 0; i < 1000; ++i ) {
+				c.add();
+			}
+		});
+	}
+	for( auto &t : threads ) {
+		t.join();
+	}
+	EXPECT_EQ(c.get(), 8000);
+
+	metrics_histogram h;
+	for( uint64_t v : {0, 1, 2, 3, 4, 5} ) {
+		h.observe(v);
+	}
+	h.observe(uint64_t(1) << 40);
+	auto s = h.get();
+	EXPECT_EQ(s.count, 7);
+	EXPECT_EQ(s.sum, 15 + (uint64_t(1) << 40));
+	EXPECT_EQ(s.counts[0], 2);
+	EXPECT_EQ(s.counts[1], 1);
+	EXPECT_EQ(s.counts[2], 2);
+	EXPECT_EQ(s.counts[3], 1);
+	EXPECT_EQ(s.counts[metrics_histogram::buckets - 1], 1);
+	EXPECT_EQ(metrics_histogram::upper_bound(3), 8);
+	EXPECT_EQ(metrics_histogram::upper_bound(metrics_histogram::buckets - 1), 0);
+}
+
+TEST( Metrics, LibraryMetricsTests ) {
+	auto &m = get_library_metrics();
+	uint64_t opened = m.connections_opened.get();
+	uint64_t accepted = m.connections_accepted.get();
+	uint64_t closed = m.connections_closed.get();
+	uint64_t sent = m.bytes_sent.get();
+	uint64_t received = m.bytes_received.get();
+	uint64_t timeouts = m.timeouts.get();
+
+	net_socket server, client;
+	server.listen("127.0.0.1", 0);
+	client.connect(server.get_local_address());
+	unique_ptr<net_socket> worker = server.accept();
+	client.send_all("0123456789", 10);
+	char buf[10];
+	worker->recv_all(buf, 10);
+	worker->set_timeout(0.01);
+	EXPECT_THROW(worker->recv(buf, 10), network_socket::timeout_exception);
+	client.close();
+
+	EXPECT_GE(m.connections_opened.get() - opened, 1);
+	EXPECT_GE(m.connections_accepted.get() - accepted, 1);
+	EXPECT_GE(m.connections_closed.get() - closed, 1);
+	EXPECT_GE(m.bytes_sent.get() - sent, 10);
+	EXPECT_GE(m.bytes_received.get() - received, 10);
+	EXPECT_GE(m.timeouts.get() - timeouts, 1);
+
+	string text = m.prometheus_text();
+	EXPECT_NE(text.find("# TYPE netsock_sent_bytes_total counter\n"), string::npos);
+	EXPECT_NE(text.find("netsock_recv_bytes_bucket{le=\"16\"} "), string::npos);
+	EXPECT_NE(text.find("netsock_accept_queue_wait_seconds_bucket{le=\"0.001\"} "), string::npos);
+	EXPECT_NE(text.find("netsock_recv_bytes_bucket{le=\"+Inf\"} "), string::npos);
+}
+
+TEST( Metrics, ServerTests ) {
+	metrics_server ms;
+	EXPECT_FALSE(ms.is_running());
+	ms.start(0);
+	EXPECT_TRUE(ms.is_running());
+	EXPECT_THROW(ms.start(0), std::runtime_error);
+
+	string response = fetch(ms.get_local_address(), "/metrics");
+	EXPECT_EQ(response.compare(0, 15, "HTTP/1.0 200 OK"), 0);
+	EXPECT_NE(response.find("netsock_connections_accepted_total "), string::npos);
+	EXPECT_EQ(fetch(ms.get_local_address(), "/other").compare(0, 22, "HTTP/1.0 404 Not Found"), 0);
+
+	ms.stop();
+	EXPECT_FALSE(ms.is_running());
+}
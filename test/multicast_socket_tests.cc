@@ -0,0 +1,203 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <chrono>
+#include "multicast_socket.h"
+
+using std::runtime_error;
+using std::invalid_argument;
+using std::string;
+using network_socket::net_socket;
+using network_socket::multicast_socket;
+using network_socket::datagram_batch;
+using network_socket::timeout_exception;
+using network_socket::address;
+
+static const string group4("239.255.76.1");
+static const string loopback4("127.0.0.1");
+
+static unsigned short get_random_multicast_port() {
+	auto seed = std::chrono::system_clock::now().time_since_epoch().count();
+	std::default_random_engine generator(seed);
+	std::uniform_int_distribution<unsigned short> dist(5000,50000);
+	return dist(generator);
+}
+
+static void setup_loopback_sender(multicast_socket &s) {
+	s.set_interface(loopback4);
+	s.set_loopback(true);
+	s.set_ttl(1);
+}
+
+TEST( MulticastSocket, ConstructorTests ) {
+	multicast_socket s;
+	EXPECT_EQ(s.get_socket_descriptor(), -1);
+	EXPECT_EQ(s.get_network_protocol(), net_socket::network_protocol::IPv4);
+	EXPECT_FALSE(s.is_bound());
+	EXPECT_FALSE(s.timeout_is_set());
+	EXPECT_EQ(s.get_ttl(), 1);
+	EXPECT_TRUE(s.get_loopback());
+
+	multicast_socket s6(net_socket::network_protocol::IPv6);
+	EXPECT_EQ(s6.get_network_protocol(), net_socket::network_protocol::IPv6);
+
+	EXPECT_THROW(multicast_socket sa(net_socket::network_protocol::ANY), invalid_argument);
+}
+
+TEST( MulticastSocket, GetterAndSetterTests ) {
+	multicast_socket s;
+
+	s.set_ttl(5);
+	EXPECT_NE(s.get_socket_descriptor(), -1);
+	EXPECT_EQ(s.get_ttl(), 5);
+	EXPECT_THROW(s.set_ttl(-1), invalid_argument);
+	EXPECT_THROW(s.set_ttl(256), invalid_argument);
+
+	s.set_loopback(false);
+	EXPECT_FALSE(s.get_loopback());
+	s.set_loopback(true);
+	EXPECT_TRUE(s.get_loopback());
+
+	s.set_interface(loopback4);
+	s.set_interface("lo");
+	s.set_interface("");
+	EXPECT_THROW(s.set_interface("no_such_if0"), invalid_argument);
+	EXPECT_THROW(s.set_interface("192.0.2.77"), invalid_argument);
+
+	s.set_timeout(0.5);
+	EXPECT_TRUE(s.timeout_is_set());
+	EXPECT_EQ(s.get_timeout(), 0.5);
+	s.clear_timeout();
+	EXPECT_FALSE(s.timeout_is_set());
+	EXPECT_THROW(s.set_timeout(-1.0), invalid_argument);
+
+	s.close();
+	EXPECT_EQ(s.get_socket_descriptor(), -1);
+}
+
+TEST( MulticastSocket, InvalidOperationTests ) {
+	multicast_socket s;
+	char buf[16];
+	datagram_batch batch(2, 16);
+
+	EXPECT_THROW(s.recv_from(buf, sizeof(buf)), runtime_error);
+	EXPECT_THROW(s.recv_batch(batch), runtime_error);
+	EXPECT_THROW(s.join("10.1.1.1"), runtime_error);              // Not a group
+	EXPECT_THROW(s.join("ff02::1"), invalid_argument);            // Wrong family
+	EXPECT_THROW(s.join("not an address"), invalid_argument);
+	EXPECT_THROW(s.send_to(buf, 1, "ff02::1", 9000), invalid_argument);
+	EXPECT_THROW(datagram_batch b(0, 16), invalid_argument);
+	EXPECT_THROW(batch.data(0), std::out_of_range);
+
+	unsigned short port = get_random_multicast_port();
+	s.bind(group4, port);
+	EXPECT_TRUE(s.is_bound());
+	EXPECT_THROW(s.bind(group4, port), runtime_error);
+}
+
+TEST( MulticastSocket, SendRecvTests ) {
+	unsigned short port = get_random_multicast_port();
+	multicast_socket rx, tx;
+	rx.bind(group4, port);
+	rx.join(group4, loopback4);
+	rx.set_timeout(1.0);
+	setup_loopback_sender(tx);
+
+	address dest;
+	dest.set_address(group4);
+	dest.set_port(port);
+	string msg("multicast payload");
+	ASSERT_EQ(tx.send_to(msg, dest), msg.length()+1);
+
+	char buf[64];
+	address src;
+	ssize_t rs = rx.recv_from(buf, sizeof(buf), &src);
+	EXPECT_EQ(rs, msg.length()+1);
+	EXPECT_EQ(string(buf), msg);
+	EXPECT_EQ(src.get_address(), loopback4);
+
+	// A second receiver on the same group and port also gets the datagram
+	multicast_socket rx2;
+	rx2.bind(group4, port);
+	rx2.join(group4, "lo");
+	rx2.set_timeout(1.0);
+	ASSERT_EQ(tx.send_to(buf, 4, group4, port), 4);
+	EXPECT_EQ(rx.recv_from(buf, sizeof(buf)), 4);
+	EXPECT_EQ(rx2.recv_from(buf, sizeof(buf)), 4);
+
+	// No more datagrams after leaving the group
+	rx.leave(group4, loopback4);
+	rx.set_timeout(0.1);
+	ASSERT_EQ(tx.send_to(buf, 4, group4, port), 4);
+	EXPECT_THROW(rx.recv_from(buf, sizeof(buf)), timeout_exception);
+	EXPECT_EQ(rx2.recv_from(buf, sizeof(buf)), 4);
+}
+
+TEST( MulticastSocket, SourceSpecificTests ) {
+	unsigned short port = get_random_multicast_port();
+	multicast_socket rx, tx;
+	rx.bind(group4, port);
+	rx.set_timeout(0.1);
+	setup_loopback_sender(tx);
+
+	// Source filter excludes the loopback sender
+	rx.join(group4, "192.0.2.1", loopback4);
+	ASSERT_EQ(tx.send_to("x", 1, group4, port), 1);
+	char c;
+	EXPECT_THROW(rx.recv_from(&c, 1), timeout_exception);
+	rx.leave(group4, "192.0.2.1", loopback4);
+
+	// Source filter matches the loopback sender
+	rx.join(group4, loopback4, loopback4);
+	ASSERT_EQ(tx.send_to("y", 1, group4, port), 1);
+	EXPECT_EQ(rx.recv_from(&c, 1), 1);
+	EXPECT_EQ(c, 'y');
+}
+
+TEST( MulticastSocket, BatchRecvTests ) {
+	unsigned short port = get_random_multicast_port();
+	multicast_socket rx, tx;
+	rx.bind(group4, port);
+	rx.join(group4, loopback4);
+	rx.set_timeout(1.0);
+	setup_loopback_sender(tx);
+
+	const unsigned int count = 8;
+	const size_t dgram_size = 32;
+	for( unsigned int i = 0; i < count; ++i ) {
+		char payload[dgram_size+8];
+		memset(payload, 'a'+i, sizeof(payload));
+		// Last datagram is too big for the batch buffers
+		size_t len = (i == count-1) ? sizeof(payload) : i+1;
+		ASSERT_EQ(tx.send_to(payload, len, group4, port), len);
+	}
+
+	datagram_batch batch(count, dgram_size);
+	EXPECT_EQ(batch.capacity(), count);
+	const char *first_buffer = nullptr;
+	unsigned int seen = 0;
+	while( seen < count ) {
+		size_t n = rx.recv_batch(batch);
+		ASSERT_GT(n, 0);
+		ASSERT_EQ(n, batch.size());
+		if( first_buffer == nullptr ) {
+			first_buffer = batch.data(0);
+		}
+		EXPECT_EQ(batch.data(0), first_buffer); // Buffers are reused
+		for( size_t i = 0; i < n; ++i, ++seen ) {
+			EXPECT_EQ(batch.data(i)[0], static_cast<char>('a'+seen));
+			EXPECT_EQ(batch.source(i).get_address(), loopback4);
+			if( seen == count-1 ) {
+				EXPECT_TRUE(batch.truncated(i));
+				EXPECT_EQ(batch.length(i), dgram_size);
+			}
+			else {
+				EXPECT_FALSE(batch.truncated(i));
+				EXPECT_EQ(batch.length(i), seen+1);
+			}
+		}
+	}
+
+	rx.set_timeout(0.1);
+	EXPECT_THROW(rx.recv_batch(batch), timeout_exception);
+	EXPECT_TRUE(batch.empty());
+}
@@ -4,6 +4,7 @@
 #include <atomic>
 #include <sstream>
 #include <sys/socket.h>
+#include <poll.h>
 #include <arpa/inet.h>
 #include "net_socket.h"
 
@@ -16,6 +17,7 @@ using std::vector;
 using network_socket::net_socket;
 using network_socket::timeout_exception;
 using network_socket::address;
+using network_socket::socket_timestamp;
 
 std::atomic<bool> server_ready_mutex(false);
 std::atomic<bool> server_accepted_mutex(false);
@@ -45,6 +47,8 @@ TEST( NetSocket, ConstructorTests ) {
 	EXPECT_FALSE(s.timeout_is_set());
 	EXPECT_EQ(s.get_timeout(), 0.0);
 	EXPECT_EQ(s.get_default_recv_size(), 1400);
+	EXPECT_FALSE(s.rx_timestamps_enabled());
+	EXPECT_FALSE(s.tx_timestamps_enabled());
 
 	// IPv4, TCP
 	net_socket s0(net_socket::network_protocol::IPv4, net_socket::transport_protocol::TCP);
@@ -133,6 +137,15 @@ TEST( NetSocket, GetterAndSetterTests ) {
 	size_t rs = s.get_default_recv_size();
 	s.set_default_recv_size(rs+100);
 	EXPECT_EQ(s.get_default_recv_size(), rs+100);
+
+	// IPv6 only
+	EXPECT_FALSE(s.v6_only_is_set());
+	EXPECT_FALSE(s.get_v6_only());
+	s.set_v6_only(true);
+	EXPECT_TRUE(s.v6_only_is_set());
+	EXPECT_TRUE(s.get_v6_only());
+	s.clear_v6_only();
+	EXPECT_FALSE(s.v6_only_is_set());
 }
 
 TEST( NetSocket, ListenTests ) {
@@ -347,6 +360,52 @@ TEST( NetSocket, SendRecvTests ) {
 	EXPECT_EQ(size, 0);
 }
 
+TEST( NetSocket, AdaptiveRecvSizeTests ) {
+	unsigned short port = get_random_port();
+	net_socket server, client;
+	server.set_adaptive_recv_size(true);
+	server.set_default_recv_size(4000);
+	server.listen("localhost", port);
+	client.connect("localhost", port);
+	unique_ptr<net_socket> worker = server.accept();
+	EXPECT_TRUE(worker->adaptive_recv_size_enabled());
+	EXPECT_EQ(worker->get_default_recv_size(), 1400);
+	worker->set_adaptive_recv_size(true);
+	EXPECT_EQ(worker->get_recv_size_estimate(), worker->get_default_recv_size());
+	EXPECT_FALSE(client.adaptive_recv_size_enabled());
+
+	// A bulk flow needs far fewer receives than with the fixed default size
+	const size_t total = 1 << 20;
+	thread sender([&client, total]() {
+		vector<char> data(total, 'b');
+		client.send_all(data.data(), data.size());
+	});
+	vector<char> rx;
+	size_t rcvd = 0;
+	int calls = 0;
+	while( rcvd < total ) {
+		rx.clear();
+		rcvd += worker->recv(rx);
+		++calls;
+	}
+	sender.join();
+	EXPECT_EQ(rcvd, total);
+	EXPECT_LT(calls, total/worker->get_default_recv_size()/4);
+	EXPECT_GT(worker->get_recv_size_estimate(), 8*worker->get_default_recv_size());
+
+	// Small messages shrink the estimate again
+	string msg;
+	for( int i = 0; i < 40; ++i ) {
+		client.send("ping");
+		EXPECT_EQ(worker->recv(msg), 5);
+		EXPECT_EQ(msg, "ping");
+	}
+	EXPECT_EQ(worker->get_recv_size_estimate(), net_socket::min_adaptive_recv_size);
+
+	worker->set_adaptive_recv_size(false);
+	EXPECT_EQ(worker->get_recv_size_estimate(), worker->get_default_recv_size());
+}
+
 TEST(NetSocket, UnequalSendRecvTests ) {
 	unsigned short port = get_random_port();
 	thread st = spawn_and_check_server(check_and_echo_server, port);
@@ -461,6 +520,38 @@ TEST(NetSocket, SendAllRecvAllTests ) {
 	st.join();
 }
 
+TEST(NetSocket, SendFlagsWaitAllTests ) {
+	unsigned short port = get_random_port();
+	net_socket server, client;
+	server.listen("localhost", port);
+	client.connect("localhost", port);
+	unique_ptr<net_socket> worker = server.accept();
+
+	// A header held back with MSG_MORE arrives with its body
+	char hdr[8] = "header:", body[6] = "body!";
+	ASSERT_EQ(client.send_all(hdr, sizeof(hdr), MSG_MORE), sizeof(hdr));
+	ASSERT_EQ(client.send_all(body, sizeof(body)), sizeof(body));
+	char rx[sizeof(hdr)+sizeof(body)];
+	EXPECT_EQ(worker->recv_all(rx, sizeof(rx)), sizeof(rx));
+	EXPECT_STREQ(rx, "header:");
+	EXPECT_STREQ(rx+sizeof(hdr), "body!");
+
+	// Without a timeout recv_all waits for data sent in pieces
+	thread tx([&client]() {
+		for( int i = 0; i < 4; ++i ) {
+			usleep(20000);
+			client.send("abcd", 4);
+		}
+		client.close();
+	});
+	char all[16];
+	EXPECT_EQ(worker->recv_all(all, sizeof(all)), sizeof(all));
+	EXPECT_EQ(string(all, sizeof(all)), "abcdabcdabcdabcd");
+	// The peer closing ends the wait early
+	EXPECT_EQ(worker->recv_all(all, sizeof(all)), 0);
+	tx.join();
+}
+
 TEST(NetSocket, IntVectorTests ) {
 	unsigned short port = get_random_port();
 	std::thread st = spawn_and_check_server(check_and_echo_server, port);
@@ -485,6 +576,109 @@ TEST(NetSocket, IntVectorTests ) {
 	st.join();
 }
 
+TEST(NetSocket, PartialElementTests ) {
+	unsigned short port = get_random_port();
+	net_socket server, client;
+	server.listen("localhost", port);
+	client.connect("localhost", port);
+	unique_ptr<net_socket> worker = server.accept();
+	worker->set_timeout(0.2);
+
+	// Byte order doesn't matter for these values
+	vector<uint32_t> out(1000);
+	for( size_t i = 0; i < out.size(); ++i ) {
+		out[i] = (i % 256) * 0x01010101u;
+	}
+	const char *bytes = reinterpret_cast<const char*>(out.data());
+
+	// The partial element is kept for the next receive
+	client.send_all(bytes, 7);
+	vector<uint32_t> in;
+	EXPECT_EQ(worker->recv(in, 400), 4);
+	EXPECT_EQ(in, vector<uint32_t>(out.begin(), out.begin() + 1));
+	EXPECT_EQ(worker->get_buffered_size(), 3);
+
+	// Less than an element waits for the rest of it
+	EXPECT_THROW(worker->recv(in, 400), timeout_exception);
+	EXPECT_EQ(worker->get_buffered_size(), 3);
+	// and a size that can't hold one is rejected rather than looking closed
+	EXPECT_THROW(worker->recv(in, 3), std::invalid_argument);
+	EXPECT_THROW(worker->recv_all(in, 2), std::invalid_argument);
+	EXPECT_EQ(worker->get_buffered_size(), 3);
+	EXPECT_TRUE(worker->is_connected());
+	client.send_all(bytes + 7, 4*out.size() - 7);
+	vector<uint32_t> all(out.begin(), out.begin() + 1);
+	while( all.size() < out.size() ) {
+		in.clear();
+		ASSERT_GT(worker->recv(in, 1001), 0);
+		all.insert(all.end(), in.begin(), in.end());
+	}
+	EXPECT_EQ(all, out);
+	EXPECT_EQ(worker->get_buffered_size(), 0);
+
+	// recv_all keeps a partial element at the end of the stream
+	client.send_all(bytes, 10);
+	client.close();
+	in.clear();
+	EXPECT_EQ(worker->recv_all(in, 12), 8);
+	EXPECT_EQ(in, vector<uint32_t>(out.begin(), out.begin() + 2));
+	EXPECT_EQ(worker->get_buffered_size(), 2);
+	EXPECT_EQ(worker->recv(in, 400), 0);
+	EXPECT_EQ(worker->get_buffered_size(), 2);
+}
+
+TEST(NetSocket, ByteOrderNegotiationTests ) {
+	net_socket server, client;
+	server.listen("127.0.0.1", 0);
+
+	// Both ends negotiate: vectors are sent in the native byte order
+	client.connect(server.get_local_address());
+	unique_ptr<net_socket> worker = server.accept();
+	bool client_same = false;
+	thread t([&client, &client_same]() {client_same = client.negotiate_byte_order();});
+	EXPECT_TRUE(worker->negotiate_byte_order());
+	t.join();
+	EXPECT_TRUE(client_same);
+	EXPECT_TRUE(worker->peer_byte_order_matches());
+	vector<uint32_t> out = {0x01020304u};
+	client.send_all(out);
+	uint32_t raw = 0;
+	EXPECT_EQ(worker->recv_all(&raw, sizeof(raw)), sizeof(raw));
+	EXPECT_EQ(raw, 0x01020304u);
+	vector<uint32_t> in;
+	worker->send_all(out);
+	EXPECT_EQ(client.recv_all(in, 4), 4);
+	EXPECT_EQ(in, out);
+
+	// Wire-order types stay big-endian, so they don't mix with plain ones
+	// once negotiated
+	vector<network_socket::be_u32> wire;
+	client.send_all(out);
+	EXPECT_EQ(worker->recv_all(wire, 4), 4);
+	EXPECT_EQ(wire[0].get(), network_socket::network_order(0x01020304u));
+	worker->send_all(wire);
+	EXPECT_EQ(client.recv_all(in, 4), 4);
+	EXPECT_EQ(in, out);
+
+	// A peer that doesn't negotiate keeps network byte order and its data
+	net_socket old_client;
+	old_client.connect(server.get_local_address());
+	worker = server.accept();
+	worker->set_timeout(0.2);
+	old_client.send_all("NSxy", 4);
+	EXPECT_FALSE(worker->negotiate_byte_order());
+	EXPECT_FALSE(worker->peer_byte_order_matches());
+	char data[4];
+	EXPECT_EQ(worker->recv_all(data, 4), 4);
+	EXPECT_EQ(string(data, 4), "NSxy");
+
+	// as does one that sends nothing first
+	EXPECT_FALSE(worker->negotiate_byte_order());
+	old_client.send_all(out);
+	EXPECT_EQ(worker->recv_all(&raw, sizeof(raw)), sizeof(raw));
+	EXPECT_EQ(raw, htonl(0x01020304u));
+}
+
 TEST(NetSocket, PacketErrorSendTests ) {
 	unsigned short port = get_random_port();
 	std::thread st = spawn_and_check_server(check_and_echo_server, port);
@@ -528,6 +722,405 @@ TEST(NetSocket, LocalRemoteAddressTests ) {
 	st.join();
 }
 
+TEST(NetSocket, TimestampTests ) {
+	unsigned short port = get_random_port();
+	net_socket server, client;
+	server.set_timestamps(true, false);
+	EXPECT_TRUE(server.rx_timestamps_enabled());
+	EXPECT_FALSE(server.tx_timestamps_enabled());
+	server.listen("localhost", port);
+	client.set_timestamps(false, true);
+	client.connect("localhost", port);
+	unique_ptr<net_socket> worker = server.accept();
+	EXPECT_TRUE(worker->rx_timestamps_enabled());
+	worker->set_timeout(1.0);
+	usleep(50000); // Kernel enables timestamping asynchronously
+
+	char tx[100], rx[100];
+	memset(tx, 'T', sizeof(tx));
+	struct timespec before, after;
+	clock_gettime(CLOCK_REALTIME, &before);
+	ASSERT_EQ(client.send(tx, sizeof(tx)), sizeof(tx));
+
+	// Receive timestamp taken by the kernel between the send and the recv
+	socket_timestamp ts;
+	EXPECT_EQ(worker->recv(rx, sizeof(rx), ts), sizeof(rx));
+	clock_gettime(CLOCK_REALTIME, &after);
+	ASSERT_TRUE(ts.has_software());
+	EXPECT_FALSE(ts.has_hardware());
+	EXPECT_EQ(ts.stage, socket_timestamp::none);
+	double t = ts.software.tv_sec + ts.software.tv_nsec/1e9;
+	EXPECT_GE(t, before.tv_sec + before.tv_nsec/1e9);
+	EXPECT_LE(t, after.tv_sec + after.tv_nsec/1e9);
+
+	// Transmit timestamps for each stage, identified by the last byte sent
+	bool stages[4] = {false, false, false, false};
+	for( int i = 0; (i < 100) && !(stages[socket_timestamp::sent] && stages[socket_timestamp::acknowledged]); ++i ) {
+		while( client.get_tx_timestamp(ts) ) {
+			EXPECT_TRUE(ts.has_software());
+			EXPECT_EQ(ts.id, sizeof(tx)-1);
+			stages[ts.stage] = true;
+		}
+		usleep(10000);
+	}
+	EXPECT_FALSE(stages[socket_timestamp::none]);
+	EXPECT_TRUE(stages[socket_timestamp::scheduled]);
+	EXPECT_TRUE(stages[socket_timestamp::sent]);
+	EXPECT_TRUE(stages[socket_timestamp::acknowledged]);
+	EXPECT_FALSE(worker->get_tx_timestamp(ts));
+
+	// No receive timestamp once disabled
+	worker->set_timestamps(false, false);
+	ASSERT_EQ(client.send(tx, sizeof(tx)), sizeof(tx));
+	EXPECT_EQ(worker->recv(rx, sizeof(rx), ts), sizeof(rx));
+	EXPECT_FALSE(ts.has_software());
+
+	net_socket closed;
+	EXPECT_THROW(closed.recv(rx, 1, ts), runtime_error);
+	EXPECT_THROW(closed.get_tx_timestamp(ts), runtime_error);
+}
+
+TEST(NetSocket, ZerocopyReceiveTests ) {
+	unsigned short port = get_random_port();
+	net_socket server, client;
+	EXPECT_THROW(server.set_zerocopy_receive(true, 1000), invalid_argument);
+	server.set_zerocopy_receive(true, 1 << 20);
+	EXPECT_TRUE(server.zerocopy_receive_enabled());
+	server.listen("localhost", port);
+	client.connect("localhost", port);
+	unique_ptr<net_socket> worker = server.accept();
+	EXPECT_TRUE(worker->zerocopy_receive_enabled());
+	EXPECT_EQ(worker->get_zerocopy_region_size(), 1 << 20);
+	worker->set_timeout(1.0);
+
+	// Mapped and copied data arrive in order
+	const size_t total = 8 << 20;
+	thread tx([&client, total]() {
+		vector<char> data(total);
+		for( size_t i = 0; i < total; ++i ) {
+			data[i] = static_cast<char>(i*7 >> 3);
+		}
+		client.send_all(data.data(), data.size());
+		client.send_all("tail", 4);
+	});
+	size_t rcvd = 0;
+	bool in_order = true;
+	while( rcvd < total + 4 ) {
+		std::span<const char> d = worker->recv_zerocopy();
+		ASSERT_FALSE(d.empty()) << rcvd;
+		for( char c : d ) {
+			char expected = (rcvd < total) ? static_cast<char>(rcvd*7 >> 3) : "tail"[rcvd - total];
+			in_order = in_order && (c == expected);
+			++rcvd;
+		}
+	}
+	tx.join();
+	EXPECT_TRUE(in_order);
+	EXPECT_EQ(rcvd, total + 4);
+	const auto &stats = worker->get_zerocopy_statistics();
+	EXPECT_EQ(stats.mapped + stats.copied, total + 4);
+
+	// Other receives continue where zero-copy receive stopped
+	tx = thread([&client, total]() {
+		vector<char> data(total);
+		for( size_t i = 0; i < total; ++i ) {
+			data[i] = static_cast<char>(i*7 >> 3);
+		}
+		client.send_all(data.data(), data.size());
+	});
+	rcvd = 0;
+	in_order = true;
+	vector<char> rest;
+	while( rcvd < total ) {
+		std::span<const char> d = worker->recv_zerocopy();
+		ASSERT_FALSE(d.empty()) << rcvd;
+		for( char c : d ) {
+			in_order = in_order && (c == static_cast<char>(rcvd*7 >> 3));
+			++rcvd;
+		}
+		if( rcvd >= total ) {
+			break;
+		}
+		rest.clear();
+		ASSERT_GT(worker->recv(rest, 5000), 0) << rcvd;
+		for( char c : rest ) {
+			in_order = in_order && (c == static_cast<char>(rcvd*7 >> 3));
+			++rcvd;
+		}
+	}
+	tx.join();
+	EXPECT_TRUE(in_order);
+	EXPECT_EQ(rcvd, total);
+
+	// Size limits and the end of the stream
+	client.send_all("0123456789", 10);
+	EXPECT_EQ(string(worker->recv_zerocopy(4).data(), 4), "0123");
+	EXPECT_EQ(string(worker->recv_zerocopy().data(), 6), "456789");
+	EXPECT_THROW(worker->recv_zerocopy(), timeout_exception);
+	client.close();
+	EXPECT_TRUE(worker->recv_zerocopy().empty());
+	EXPECT_FALSE(worker->is_connected());
+	EXPECT_THROW(worker->recv_zerocopy(), runtime_error);
+}
+
+TEST(NetSocket, RecvViewTests ) {
+	unsigned short port = get_random_port();
+	net_socket server, client;
+	server.listen("localhost", port);
+	client.connect("localhost", port);
+	unique_ptr<net_socket> worker = server.accept();
+	worker->set_timeout(0.2);
+	EXPECT_TRUE(worker->recv_view(0).empty());
+	EXPECT_THROW(worker->consume(1), std::out_of_range);
+
+	// Parse length-prefixed messages in place
+	client.send_all("\x05hello\x03" "abc\x02", 11);
+	std::span<const std::byte> view = worker->recv_view(1);
+	size_t len = static_cast<size_t>(view[0]);
+	view = worker->recv_view(1 + len);
+	EXPECT_EQ(string(reinterpret_cast<const char*>(view.data()) + 1, len), "hello");
+	worker->consume(1 + len);
+	EXPECT_EQ(worker->get_buffered_size(), 5);
+
+	// Other receive functions drain the buffer first
+	char c;
+	EXPECT_EQ(worker->recv(&c, 1), 1);
+	EXPECT_EQ(c, 3);
+	EXPECT_EQ(worker->recv(&c, 1, MSG_PEEK), 1);
+	EXPECT_EQ(c, 'a');
+	string s;
+	EXPECT_EQ(worker->recv(s, 3), 3);
+	EXPECT_EQ(s, "abc");
+
+	// The buffered bytes survive a timeout
+	EXPECT_THROW(worker->recv_view(3), timeout_exception);
+	EXPECT_EQ(worker->get_buffered_size(), 1);
+	client.send_all("xy", 2);
+	view = worker->recv_view(3);
+	EXPECT_EQ(view.size(), 3);
+	EXPECT_EQ(string(reinterpret_cast<const char*>(view.data()), 3), "\x02xy");
+	worker->consume(3);
+
+	// Strings don't read ahead, so the rest stays visible to polling
+	client.send_all(string("one\0two\0three", 13));
+	EXPECT_EQ(worker->recv_all(s), 4);
+	EXPECT_EQ(s, "one");
+	EXPECT_EQ(worker->get_buffered_size(), 0);
+	EXPECT_EQ(worker->recv(s), 4);
+	EXPECT_EQ(s, "two");
+	EXPECT_EQ(worker->get_buffered_size(), 0);
+	struct pollfd pfd = {worker->get_socket_descriptor(), POLLIN, 0};
+	EXPECT_EQ(poll(&pfd, 1, 0), 1);
+
+	// but take buffered bytes first
+	view = worker->recv_view(3);
+	EXPECT_EQ(worker->recv_all(s), 6);
+	EXPECT_EQ(s, "three");
+	client.send_all(string("four\0five", 9));
+	worker->recv_view(2);
+	EXPECT_EQ(worker->recv(s), 5);
+	EXPECT_EQ(s, "four");
+	EXPECT_EQ(worker->recv_all(s), 5);
+	EXPECT_EQ(s, "five");
+
+	// A short view at the end of the stream
+	client.send_all("end", 3);
+	client.close();
+	view = worker->recv_view(10);
+	EXPECT_EQ(view.size(), 3);
+	EXPECT_FALSE(worker->is_connected());
+	worker->consume(3);
+	EXPECT_THROW(worker->recv_view(), runtime_error);
+
+	// Closing discards buffered bytes
+	net_socket other;
+	other.connect(server.get_local_address());
+	worker = server.accept();
+	other.send_all("abc", 3);
+	EXPECT_EQ(worker->recv_view(3).size(), 3);
+	worker->close();
+	EXPECT_EQ(worker->get_buffered_size(), 0);
+	EXPECT_THROW(worker->recv(&c, 1), runtime_error);
+}
+
+TEST(NetSocket, AdoptTests ) {
+	// A listening descriptor opened elsewhere keeps its accept queue
+	int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+	ASSERT_NE(fd, -1);
+	struct sockaddr_in sa{};
+	sa.sin_family = AF_INET;
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	ASSERT_EQ(bind(fd, reinterpret_cast<struct sockaddr*>(&sa), sizeof(sa)), 0);
+	ASSERT_EQ(::listen(fd, 5), 0);
+	net_socket client;
+	net_socket server(net_socket::IPv6);
+	server.adopt(fd);
+	EXPECT_TRUE(server.is_passively_opened());
+	EXPECT_EQ(server.get_network_protocol(), net_socket::IPv4);
+	EXPECT_EQ(server.get_transport_protocol(), net_socket::TCP);
+	EXPECT_THROW(server.adopt(fd), runtime_error);
+	client.connect(server.get_local_address());
+	unique_ptr<net_socket> worker = server.accept();
+
+	// So does a connected one
+	net_socket adopted;
+	adopted.adopt(dup(client.get_socket_descriptor()));
+	EXPECT_TRUE(adopted.is_connected());
+	EXPECT_EQ(adopted.send_all("adopt", 5), 5);
+	char data[5];
+	EXPECT_EQ(worker->recv_all(data, 5), 5);
+	EXPECT_EQ(string(data, 5), "adopt");
+
+	// An accepted one negotiates as the accepting end, sending nothing to a
+	// peer that doesn't negotiate
+	net_socket accepted;
+	accepted.adopt(dup(worker->get_socket_descriptor()), true);
+	accepted.set_timeout(0.1);
+	EXPECT_FALSE(accepted.negotiate_byte_order());
+	client.set_timeout(0.1);
+	EXPECT_THROW(client.recv(data, 5), timeout_exception);
+
+	net_socket other;
+	EXPECT_THROW(other.adopt(-1), runtime_error);
+	int unconnected = ::socket(AF_INET, SOCK_STREAM, 0);
+	EXPECT_THROW(other.adopt(unconnected), invalid_argument);
+	::close(unconnected);
+	unconnected = ::socket(AF_INET, SOCK_DGRAM, 0);
+	EXPECT_THROW(other.adopt(unconnected), invalid_argument);
+	::close(unconnected);
+	EXPECT_FALSE(other.is_connected());
+
+	// Socket activation passes descriptors from 3 on
+	setenv("LISTEN_PID", "1", 1);
+	setenv("LISTEN_FDS", "1", 1);
+	EXPECT_TRUE(net_socket::get_listen_fds().empty());
+	EXPECT_EQ(getenv("LISTEN_FDS"), nullptr);
+
+	int saved = dup(3);
+	ASSERT_EQ(dup2(server.get_socket_descriptor(), 3), 3);
+	setenv("LISTEN_PID", std::to_string(getpid()).c_str(), 1);
+	setenv("LISTEN_FDS", "1", 1);
+	setenv("LISTEN_FDNAMES", "web", 1);
+	auto fds = net_socket::get_listen_fds(false);
+	ASSERT_EQ(fds.size(), 1);
+	EXPECT_EQ(fds[0].fd, 3);
+	EXPECT_EQ(fds[0].name, "web");
+	{
+		auto sockets = net_socket::adopt_listen_fds();
+		ASSERT_EQ(sockets.size(), 1);
+		EXPECT_TRUE(sockets[0]->is_passively_opened());
+		EXPECT_EQ(sockets[0]->get_local_address().get_port(), server.get_local_address().get_port());
+		EXPECT_EQ(getenv("LISTEN_PID"), nullptr);
+	}
+	if( saved != -1 ) {
+		dup2(saved, 3);
+		::close(saved);
+	}
+}
+
+TEST(NetSocket, SourceAddressTests ) {
+	unsigned short port = get_random_port();
+	net_socket server, client;
+	server.listen("127.0.0.1", port);
+
+	EXPECT_FALSE(client.source_address_is_set());
+	EXPECT_THROW(client.get_source_address(), runtime_error);
+	address src;
+	src.set_address("127.0.0.2");
+	client.set_source_address(src);
+	EXPECT_TRUE(client.source_address_is_set());
+	EXPECT_EQ(client.get_source_address(), src);
+	client.connect("127.0.0.1", port);
+	unique_ptr<net_socket> worker = server.accept();
+	EXPECT_EQ(client.get_local_address().get_address(), "127.0.0.2");
+	EXPECT_EQ(worker->get_remote_address(), client.get_local_address());
+
+	// Only remote addresses of the source's family are tried
+	net_socket mismatch;
+	mismatch.set_source_address(src);
+	EXPECT_THROW(mismatch.connect("::1", port), runtime_error);
+	net_socket v6(net_socket::network_protocol::IPv6);
+	EXPECT_THROW(v6.set_source_address(src), invalid_argument);
+	mismatch.clear_source_address();
+	EXPECT_FALSE(mismatch.source_address_is_set());
+}
+
+TEST(NetSocket, ListenStatisticsTests ) {
+	unsigned short port = get_random_port();
+	net_socket server;
+	EXPECT_THROW(server.get_listen_statistics(), runtime_error);
+	EXPECT_GT(net_socket::get_somaxconn(), 0);
+	server.set_backlog(2);
+	server.set_accept_latency_monitoring(true);
+	EXPECT_TRUE(server.accept_latency_monitoring_enabled());
+	server.listen("127.0.0.1", port);
+
+	auto st = server.get_listen_statistics();
+	EXPECT_EQ(st.queue_length, 0);
+	EXPECT_EQ(st.queue_max, 2);
+	EXPECT_EQ(st.accepted, 0);
+
+	// A full accept queue with a backlog below the system limit
+	net_socket c0, c1;
+	c0.connect("127.0.0.1", port);
+	c1.connect("127.0.0.1", port);
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	st = server.get_listen_statistics();
+	EXPECT_EQ(st.queue_length, 2);
+	EXPECT_EQ(st.backlog_limited, net_socket::get_somaxconn() > 2);
+
+	unique_ptr<net_socket> w0 = server.accept();
+	unique_ptr<net_socket> w1 = server.accept();
+	st = server.get_listen_statistics();
+	EXPECT_EQ(st.queue_length, 0);
+	EXPECT_EQ(st.accepted, 2);
+	EXPECT_GE(st.max_accept_latency, std::chrono::milliseconds(40));
+	EXPECT_GE(st.total_accept_latency, st.max_accept_latency);
+}
+
+TEST(NetSocket, MultipathTests ) {
+	unsigned short port = get_random_port();
+	net_socket server, client, plain;
+	server.set_multipath(true);
+	client.set_multipath(true);
+	EXPECT_TRUE(client.multipath_enabled());
+	EXPECT_FALSE(client.is_multipath());
+	EXPECT_THROW(plain.get_multipath_info(), runtime_error);
+	server.listen("127.0.0.1", port);
+	client.connect("127.0.0.1", port);
+	unique_ptr<net_socket> worker = server.accept();
+	EXPECT_TRUE(worker->multipath_enabled());
+
+	// Data flows whether or not the kernel supports MPTCP
+	char buf[6] = {};
+	client.send_all("hello", 6);
+	worker->recv_all(buf, 6);
+	EXPECT_STREQ(buf, "hello");
+	auto subflows = client.get_subflow_addresses();
+	ASSERT_GE(subflows.size(), 1);
+	EXPECT_EQ(subflows[0].first, client.get_local_address());
+	EXPECT_EQ(subflows[0].second, client.get_remote_address());
+	if( !server.is_multipath() ) {
+		GTEST_SKIP() << "MPTCP not supported by the kernel";
+	}
+
+	EXPECT_TRUE(client.is_multipath());
+	EXPECT_TRUE(worker->is_multipath());
+	auto info = client.get_multipath_info();
+	EXPECT_FALSE(info.fallback);
+	EXPECT_NE(info.token, 0);
+	EXPECT_THROW(plain.get_multipath_info(), runtime_error);
+
+	// A plain TCP peer makes the connection fall back to TCP
+	plain.connect("127.0.0.1", port);
+	unique_ptr<net_socket> fallback = server.accept();
+	EXPECT_FALSE(fallback->is_multipath());
+	plain.send_all("again", 6);
+	fallback->recv_all(buf, 6);
+	EXPECT_STREQ(buf, "again");
+	EXPECT_EQ(fallback->get_subflow_addresses().size(), 1);
+}
+
 TEST(NetSocket, AddressClassesTests ) {
 	struct sockaddr_in addr4;
 	memset(&addr4, 0, sizeof(addr4));
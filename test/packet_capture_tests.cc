@@ -0,0 +1,173 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <chrono>
+#include <linux/if_ether.h>
+#include "packet_capture.h"
+#include "multicast_socket.h"
+
+using std::runtime_error;
+using std::invalid_argument;
+using std::unique_ptr;
+using std::thread;
+using std::string;
+using network_socket::net_socket;
+using network_socket::multicast_socket;
+using network_socket::packet_capture;
+using network_socket::packet_view;
+using network_socket::timeout_exception;
+using network_socket::address;
+
+static unsigned short get_random_capture_port() {
+	return 5000 + std::chrono::system_clock::now().time_since_epoch().count()%45000;
+}
+
+// Capturing requires CAP_NET_RAW, so skip the test when it is unavailable
+#define OPEN_OR_SKIP(cap, ...) \
+	try { \
+		(cap).open(__VA_ARGS__); \
+	} \
+	catch( runtime_error &e ) { \
+		GTEST_SKIP() << "Unable to open capture: " << e.what(); \
+	}
+
+// Dispatch blocks until `done` returns true or no more frames arrive
+template<typename F>
+static void capture_until(packet_capture &cap, F done,
+	const std::function<void(const packet_view&)> &handler) {
+
+	cap.set_timeout(0.5);
+	try {
+		while( !done() ) {
+			cap.dispatch(handler);
+		}
+	}
+	catch( timeout_exception& ) {}
+}
+
+TEST( PacketCapture, ConstructorTests ) {
+	packet_capture cap;
+	EXPECT_FALSE(cap.is_open());
+	EXPECT_EQ(cap.get_socket_descriptor(), -1);
+	EXPECT_FALSE(cap.timeout_is_set());
+
+	EXPECT_THROW(cap.dispatch([](const packet_view&) {}), runtime_error);
+	EXPECT_THROW(cap.set_fanout(1), runtime_error);
+	EXPECT_THROW(cap.get_statistics(), runtime_error);
+	EXPECT_THROW(cap.open("no_such_if0"), invalid_argument);
+	EXPECT_THROW(cap.open("lo", 1000), invalid_argument);
+	EXPECT_THROW(cap.open("lo", 1 << 16, 0), invalid_argument);
+	EXPECT_THROW(cap.set_timeout(-1), invalid_argument);
+}
+
+TEST( PacketCapture, UdpCaptureTests ) {
+	packet_capture cap;
+	OPEN_OR_SKIP(cap, "lo", 1 << 16, 4, 5);
+	EXPECT_TRUE(cap.is_open());
+	EXPECT_EQ(cap.get_block_size(), 1 << 16);
+	EXPECT_EQ(cap.get_block_count(), 4);
+	cap.set_ignore_outgoing(true);
+
+	unsigned short port = get_random_capture_port();
+	multicast_socket rx, tx;
+	rx.bind(port);
+	string msg("captured datagram");
+	const int count = 20;
+	for( int i = 0; i < count; ++i ) {
+		tx.send_to(msg.data(), msg.length(), "127.0.0.1", port);
+	}
+
+	int seen = 0;
+	capture_until(cap, [&seen]() {return seen == count;},
+		[&](const packet_view &p) {
+			if( !p.is_udp() || (p.get_destination().get_port() != port) ) {
+				return;
+			}
+			++seen;
+			EXPECT_FALSE(p.is_outgoing());
+			EXPECT_EQ(p.get_ethertype(), ETH_P_IP);
+			EXPECT_TRUE(p.is_ipv4());
+			EXPECT_EQ(p.get_ip_protocol(), IPPROTO_UDP);
+			EXPECT_FALSE(p.is_tcp());
+			EXPECT_EQ(p.get_source().get_address(), "127.0.0.1");
+			EXPECT_EQ(p.get_destination().get_address(), "127.0.0.1");
+			ASSERT_EQ(p.payload_length(), msg.length());
+			EXPECT_EQ(string(reinterpret_cast<const char*>(p.payload()), p.payload_length()), msg);
+			EXPECT_GE(p.original_length(), p.length());
+			EXPECT_GT(p.get_timestamp().tv_sec, 0);
+		});
+	EXPECT_EQ(seen, count);
+	EXPECT_GE(cap.get_statistics().packets, count);
+
+	cap.close();
+	EXPECT_FALSE(cap.is_open());
+}
+
+TEST( PacketCapture, TcpCaptureTests ) {
+	packet_capture cap;
+	OPEN_OR_SKIP(cap, "lo");
+	cap.set_ignore_outgoing(true);
+
+	unsigned short port = get_random_capture_port();
+	net_socket server;
+	server.listen("127.0.0.1", port);
+	thread st([&server]() {
+		unique_ptr<net_socket> worker = server.accept();
+		char c;
+		worker->set_timeout(1.0);
+		worker->recv(&c, 1);
+	});
+
+	net_socket client;
+	client.connect("127.0.0.1", port);
+	address local = client.get_local_address();
+	string msg("tcp payload");
+	client.send(msg);
+
+	bool found = false;
+	capture_until(cap, [&found]() {return found;},
+		[&](const packet_view &p) {
+			if( !p.is_tcp() || (p.get_source() != local) || (p.payload_length() == 0) ) {
+				return;
+			}
+			found = true;
+			EXPECT_EQ(p.get_destination().get_port(), port);
+			EXPECT_EQ(p.payload_length(), msg.length()+1);
+			EXPECT_STREQ(reinterpret_cast<const char*>(p.payload()), msg.c_str());
+		});
+	EXPECT_TRUE(found);
+
+	st.join();
+}
+
+TEST( PacketCapture, FanoutTests ) {
+	packet_capture cap0, cap1;
+	OPEN_OR_SKIP(cap0, "lo", 1 << 16, 4, 5);
+	cap1.open("lo", 1 << 16, 4, 5);
+	uint16_t group = get_random_capture_port();
+	cap0.set_fanout(group, packet_capture::fanout_mode::load_balance);
+	cap1.set_fanout(group, packet_capture::fanout_mode::load_balance);
+
+	unsigned short port = get_random_capture_port();
+	multicast_socket rx, tx;
+	rx.bind(port);
+	const int count = 40;
+	for( int i = 0; i < count; ++i ) {
+		tx.send_to("x", 1, "127.0.0.1", port);
+	}
+
+	// Each frame goes to exactly one member of the group
+	int seen[2] = {0, 0};
+	packet_capture *caps[2] = {&cap0, &cap1};
+	for( int c = 0; c < 2; ++c ) {
+		capture_until(*caps[c], []() {return false;},
+			[&](const packet_view &p) {
+				if( p.is_udp() && (p.get_destination().get_port() == port) ) {
+					++seen[c];
+				}
+			});
+	}
+	EXPECT_GT(seen[0], 0);
+	EXPECT_GT(seen[1], 0);
+	// Sent and received copies on loopback
+	EXPECT_EQ(seen[0] + seen[1], 2*count);
+}
@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <chrono>
+#include <ranges>
+#include <numeric>
+#include "net_socket.h"
+
+using std::invalid_argument;
+using std::unique_ptr;
+using std::thread;
+using std::string;
+using std::vector;
+using network_socket::net_socket;
+using network_socket::recv_range;
+using network_socket::timeout_exception;
+
+static_assert(std::ranges::input_range<recv_range<string>>);
+static_assert(std::ranges::view<recv_range<vector<char>>>);
+
+class RecvRange : public ::testing::Test {
+protected:
+	net_socket server, client;
+	unique_ptr<net_socket> worker;
+
+	void SetUp() override {
+		unsigned short port = 5000 + std::chrono::system_clock::now().time_since_epoch().count()%45000;
+		server.listen("localhost", port);
+		client.connect("localhost", port);
+		worker = server.accept();
+		worker->set_timeout(1.0);
+	}
+};
+
+TEST_F( RecvRange, ChunkTests ) {
+	const size_t total = 100000;
+	thread tx([this, total]() {
+		vector<char> data(total);
+		std::iota(data.begin(), data.end(), 0);
+		client.send_all(data.data(), data.size());
+		client.close();
+	});
+
+	// Chunks are bounded by the requested size and arrive in order
+	size_t rcvd = 0;
+	bool in_order = true;
+	for( const auto &chunk : worker->chunks(4096) ) {
+		EXPECT_GT(chunk.size(), 0);
+		EXPECT_LE(chunk.size(), 4096);
+		for( char c : chunk ) {
+			in_order = in_order && (c == static_cast<char>(rcvd++));
+		}
+	}
+	tx.join();
+	EXPECT_EQ(rcvd, total);
+	EXPECT_TRUE(in_order);
+	EXPECT_FALSE(worker->is_connected());
+}
+
+TEST_F( RecvRange, RecordTests ) {
+	thread tx([this]() {
+		for( char c = 'a'; c <= 'j'; ++c ) {
+			string rec(8, c);
+			client.send_all(rec.data(), rec.size());
+		}
+		client.send_all("xyz", 3);   // Incomplete record
+		client.close();
+	});
+
+	// Odd records only, transformed to their first byte
+	auto firsts = worker->records(8)
+		| std::views::filter([](const vector<char> &r) {return (r[0] - 'a')%2 == 0;})
+		| std::views::transform([](const vector<char> &r) {return r[0];});
+	string got;
+	for( char c : firsts ) {
+		got += c;
+	}
+	tx.join();
+	EXPECT_EQ(got, "acegi");
+	EXPECT_THROW(worker->records(0), invalid_argument);
+}
+
+TEST_F( RecvRange, StringTests ) {
+	for( int i = 0; i < 10; ++i ) {
+		client.send("line " + std::to_string(i));
+	}
+
+	// Only as many strings as needed are received
+	vector<string> lines;
+	for( const auto &s : worker->strings() | std::views::take(3) ) {
+		lines.push_back(s);
+	}
+	EXPECT_EQ(lines, (vector<string>{"line 0", "line 1", "line 2"}));
+	string next;
+	worker->recv_all(next);
+	EXPECT_EQ(next, "line 3");
+
+	// A stall ends the iteration with the timeout
+	auto rest = worker->strings();
+	auto it = rest.begin();
+	for( int i = 4; i < 10; ++i, ++it ) {
+		EXPECT_EQ(*it, "line " + std::to_string(i));
+	}
+	EXPECT_THROW(*it, timeout_exception);
+}
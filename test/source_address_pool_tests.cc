@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <memory>
+#include <set>
+#include "source_address_pool.h"
+
+using std::runtime_error;
+using std::invalid_argument;
+using std::unique_ptr;
+using std::shared_ptr;
+using std::make_shared;
+using std::string;
+using std::vector;
+using network_socket::net_socket;
+using network_socket::source_address_pool;
+using network_socket::address;
+
+static unsigned short get_random_pool_port() {
+	return 5000 + std::chrono::system_clock::now().time_since_epoch().count()%45000;
+}
+
+static address make_address(const string &s, unsigned short port = 0) {
+	address a;
+	a.set_address(s);
+	a.set_port(port);
+	return a;
+}
+
+TEST( SourceAddressPool, ConstructorTests ) {
+	source_address_pool pool;
+	EXPECT_TRUE(pool.empty());
+	EXPECT_FALSE(pool.local_port_range_is_set());
+	EXPECT_THROW(pool.next(AF_INET), runtime_error);
+	EXPECT_THROW(pool.get(0), std::out_of_range);
+	EXPECT_THROW(pool.add(make_address("127.0.0.1", 80)), invalid_argument);
+
+	pool.add_range(make_address("10.0.0.254"), 4);
+	ASSERT_EQ(pool.size(), 4);
+	EXPECT_EQ(pool.get(0).get_address(), "10.0.0.254");
+	EXPECT_EQ(pool.get(1).get_address(), "10.0.0.255");
+	EXPECT_EQ(pool.get(2).get_address(), "10.0.1.0");
+	EXPECT_EQ(pool.get(3).get_address(), "10.0.1.1");
+	pool.add(make_address("::1"));
+	EXPECT_TRUE(pool.has_family(AF_INET6));
+
+	// Round-robin within a family
+	EXPECT_EQ(pool.next(AF_INET6).get_address(), "::1");
+	EXPECT_EQ(pool.next(AF_INET6).get_address(), "::1");
+	string first = pool.next(AF_INET).get_address();
+	EXPECT_NE(pool.next(AF_INET).get_address(), first);
+
+	pool.set_local_port_range(40000, 40100);
+	EXPECT_TRUE(pool.local_port_range_is_set());
+	EXPECT_EQ(pool.get_local_port_low(), 40000);
+	EXPECT_EQ(pool.get_local_port_high(), 40100);
+	EXPECT_THROW(pool.set_local_port_range(2, 1), invalid_argument);
+	pool.clear_local_port_range();
+	EXPECT_FALSE(pool.local_port_range_is_set());
+
+	source_address_pool v4only({make_address("127.0.0.1")});
+	EXPECT_FALSE(v4only.has_family(AF_INET6));
+}
+
+TEST( SourceAddressPool, ConnectTests ) {
+	unsigned short port = get_random_pool_port();
+	net_socket server;
+	server.set_backlog(64);
+	server.listen("127.0.0.1", port);
+
+	auto pool = make_shared<source_address_pool>();
+	pool->add_range(make_address("127.0.0.10"), 4);
+	pool->set_local_port_range(40000, 40999);
+
+	// Connections spread across the pool's addresses in turn
+	vector<net_socket> clients(8);
+	std::multiset<string> used;
+	for( auto &c : clients ) {
+		c.set_source_address_pool(pool);
+		EXPECT_EQ(c.get_source_address_pool(), pool);
+		c.connect("127.0.0.1", port);
+		address local = c.get_local_address();
+		used.insert(local.get_address());
+		EXPECT_GE(local.get_port(), 40000);
+		EXPECT_LE(local.get_port(), 40999);
+	}
+	for( int i = 10; i < 14; ++i ) {
+		EXPECT_EQ(used.count("127.0.0." + std::to_string(i)), 2);
+	}
+
+	// A source address replaces the pool and the other way around
+	net_socket c;
+	c.set_source_address_pool(pool);
+	c.set_source_address(make_address("127.0.0.2"));
+	EXPECT_FALSE(c.get_source_address_pool());
+	c.set_source_address_pool(pool);
+	EXPECT_FALSE(c.source_address_is_set());
+
+	// Only remote addresses of the pool's families are tried
+	EXPECT_THROW(c.connect("::1", port), runtime_error);
+	c.set_source_address_pool(nullptr);
+	EXPECT_FALSE(c.get_source_address_pool());
+}
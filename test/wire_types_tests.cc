@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include <cstring>
+#include "wire_types.h"
+#include "net_socket.h"
+
+using std::vector;
+using std::unique_ptr;
+using network_socket::net_socket;
+using network_socket::network_order;
+using network_socket::be_u16;
+using network_socket::be_u32;
+using network_socket::be_u64;
+using network_socket::be_f64;
+
+TEST( WireTypes, ConversionTests ) {
+	static_assert(sizeof(be_u16) == 2);
+	static_assert(sizeof(be_u32) == 4);
+	static_assert(sizeof(be_u64) == 8);
+	static_assert(sizeof(be_f64) == 8);
+
+	be_u32 v = 0x01020304u;
+	unsigned char bytes[4];
+	memcpy(bytes, &v, sizeof(v));
+	EXPECT_EQ(bytes[0], 1);
+	EXPECT_EQ(bytes[3], 4);
+	EXPECT_EQ(v.get(), 0x01020304u);
+	uint32_t h = v;
+	EXPECT_EQ(h, 0x01020304u);
+
+	be_u64 w;
+	EXPECT_EQ(w.get(), 0);
+	w = 0x0102030405060708ull;
+	memcpy(bytes, &w, sizeof(bytes));
+	EXPECT_EQ(bytes[0], 1);
+	EXPECT_EQ(w, be_u64(0x0102030405060708ull));
+
+	be_f64 d = -2.5;
+	EXPECT_EQ(d.get(), -2.5);
+	EXPECT_EQ(be_u16(0xabcd).get(), 0xabcd);
+	EXPECT_EQ(network_order(network_order(1.5f)), 1.5f);
+	EXPECT_EQ(network_order(uint8_t(7)), 7);
+}
+
+TEST( WireTypes, SocketTests ) {
+	net_socket server, client;
+	server.listen("127.0.0.1", 0);
+	client.connect(server.get_local_address());
+	unique_ptr<net_socket> worker = server.accept();
+
+	// Vectors of arithmetic types are sent in network byte order
+	vector<uint32_t> out = {0x01020304u, 0xa0b0c0d0u};
+	EXPECT_EQ(client.send_all(out), 8);
+	unsigned char raw[8];
+	EXPECT_EQ(worker->recv_all(raw, 8), 8);
+	EXPECT_EQ(raw[0], 1);
+	EXPECT_EQ(raw[4], 0xa0);
+
+	// and received as wire-order values without conversion
+	vector<uint64_t> big = {1, 0x0102030405060708ull, ~0ull};
+	vector<double> reals = {0.5, -1e300};
+	client.send_all(big);
+	client.send_all(reals);
+	vector<be_u64> in;
+	EXPECT_EQ(worker->recv_all(in, 24), 24);
+	ASSERT_EQ(in.size(), 3);
+	EXPECT_EQ(in[1].get(), 0x0102030405060708ull);
+	EXPECT_EQ(in[2].get(), ~0ull);
+	vector<be_f64> fin;
+	EXPECT_EQ(worker->recv_all(fin, 16), 16);
+	EXPECT_EQ(fin[1].get(), -1e300);
+
+	// Forwarded unchanged, then converted on receipt
+	EXPECT_EQ(worker->send_all(in), 24);
+	vector<uint64_t> back;
+	EXPECT_EQ(client.recv_all(back, 24), 24);
+	EXPECT_EQ(back, big);
+}